@@ -961,9 +961,16 @@ int ANTIC_Initialise(int *argc, char *argv[])
 			}
 			else a_m = TRUE;
 		}
+#ifdef NEW_CYCLE_EXACT
+		else if (strcmp(argv[i], "-cycleexact") == 0)
+			ANTIC_cycle_exact_auto = FALSE;
+#endif
 		else {
 			if (strcmp(argv[i], "-help") == 0) {
 				Log_print("\t-artif <num>     Set artifacting mode 0-4 (0 = disable)");
+#ifdef NEW_CYCLE_EXACT
+				Log_print("\t-cycleexact      Always draw the screen cycle-exactly");
+#endif
 			}
 			argv[j++] = argv[i];
 		}
@@ -1439,7 +1446,8 @@ static void draw_an_gtia_bug(const ULONG *t_pm_scanline_ptr)
 #endif /* USE_COLOUR_TRANSLATION_TABLE */
 
 #ifdef NEW_CYCLE_EXACT
-#define ADD_FONT_CYCLES
+/* cycle-exact drawing takes the font cycles into account in the cycle maps */
+#define ADD_FONT_CYCLES do { if (!ANTIC_DRAWING_SCREEN) ANTIC_xpos += font_cycles[md]; } while (0)
 #else
 #define ADD_FONT_CYCLES ANTIC_xpos += font_cycles[md]
 #endif
@@ -2835,7 +2843,124 @@ static void antic_load(void)
 
 #ifdef NEW_CYCLE_EXACT
 int ANTIC_cur_screen_pos = ANTIC_NOT_DRAWING;
-#endif
+int ANTIC_cycle_exact_auto = TRUE;
+int ANTIC_midline_check = FALSE;
+
+/* Number of drawn frames that stay cycle-exact after the last frame
+   with a mid-line write, so that effects used only now and then
+   don't make the drawing mode flip every frame. */
+#define CYCLE_EXACT_HOLD_FRAMES 50
+
+static int midline_writes = 0;
+static int cycle_exact_hold = 0;
+static int cycle_exact_frame = TRUE;
+
+void ANTIC_CheckMidlineWrite(void)
+{
+	/* The whole-line drawing takes the registers' values at SCR_C,
+	   so only writes between that and WSYNC are drawn wrong. */
+	int x = ANTIC_XPOS;
+	if (x >= SCR_C && x < ANTIC_WSYNC_C)
+		midline_writes++;
+}
+
+#ifndef NO_GTIA11_DELAY
+/* GTIA mode 11 delay for the current scanline, taking PRIOR changes
+   during the previous and the current scanline into account. */
+static void gtia11_delay_cycle_exact(void)
+{
+	int stop;
+	int old_curline_prior_pos;
+	int last_pos;
+	int change_pos;
+
+/* Basic explaination: */
+/* the ring buffer ANTIC_prior_pos_buf has three pointers: */
+/*     A   B  C              D     E    F      G   */
+/*     ^                     ^                 ^   */
+/* prevline_prior_pos  curline_prior_pos  ANTIC_prior_curpos  */
+/* G would be the most recent change which occurred during drawing */
+/* of the current line, D is the most recent */
+/* change before the current line was drawn, and A is the most recent */
+/* change before the previous line was drawn */
+/* curline_prior_pos is saved in old_curline_prior_pos */
+/* then the code will increase either curline_prior_pos or */
+/* prevline_prior_pos depending if the change at B or E occurred */
+/* earlier in the scanline ignoring which scanline it was */
+/* eg: */
+/*                              A occurs on some previous scanline */
+/* prev:     B                      C                          D     */
+/* current:                     E                    F           G   */
+/* so from the left end of the screen, the changes occurred in the order */
+/* B,E,C,F,D,G */
+/* then the code will read the values in that order, and each time it will */
+/* update prev_prior_val and cur_prior_val to be equal the the PRIOR values */
+/* "in effect" *before* those changes occurred.  If those PRIOR values */
+/* should cause a GTIA11_DELAY effect to occur then this is processed */
+/* for that portion of the scanline */
+/* At the end of processing, the buffer would look like: */
+/* the ring buffer ANTIC_prior_pos_buf has three pointers: */
+/*     A   B  C              D     E    F      G   */
+/*                           ^                 ^   */
+/*                    prevline_prior_pos  curline_prior_pos==ANTIC_prior_curpos  */
+
+	stop = FALSE;
+	last_pos = LBORDER_START;
+	old_curline_prior_pos = curline_prior_pos;
+	do {
+
+		UBYTE prev_prior_val;
+		UBYTE cur_prior_val;
+		prev_prior_val = ANTIC_prior_val_buf[prevline_prior_pos];
+		cur_prior_val = ANTIC_prior_val_buf[curline_prior_pos];
+
+		if (prevline_prior_pos == old_curline_prior_pos &&
+			curline_prior_pos == ANTIC_prior_curpos) {
+		/* no more changes */
+			change_pos = RBORDER_END;
+			stop = TRUE;
+		}
+		else if (prevline_prior_pos != old_curline_prior_pos &&
+			curline_prior_pos != ANTIC_prior_curpos) {
+		/* find leftmost change */
+			int pnext = (prevline_prior_pos + 1) % ANTIC_PRIOR_BUF_SIZE;
+			int cnext = (curline_prior_pos + 1) % ANTIC_PRIOR_BUF_SIZE;
+			if (ANTIC_prior_pos_buf[pnext] < ANTIC_prior_pos_buf[cnext]) {
+				change_pos = ANTIC_prior_pos_buf[pnext];
+				prevline_prior_pos = pnext;
+			}
+			else {
+				change_pos = ANTIC_prior_pos_buf[cnext];
+				curline_prior_pos = cnext;
+			}
+		}
+		else if (prevline_prior_pos != old_curline_prior_pos) {
+			/* only have prevline change */
+			prevline_prior_pos = (prevline_prior_pos + 1) % ANTIC_PRIOR_BUF_SIZE;
+			change_pos = ANTIC_prior_pos_buf[prevline_prior_pos];
+		}
+		else {
+			/* must only have curline change */
+			curline_prior_pos = (curline_prior_pos + 1) % ANTIC_PRIOR_BUF_SIZE;
+			change_pos = ANTIC_prior_pos_buf[curline_prior_pos];
+		}
+
+		if (prev_prior_val >= 0xc0 && cur_prior_val < 0xc0 &&
+			change_pos > LBORDER_START &&
+			change_pos > last_pos && last_pos < RBORDER_END) {
+			int adj_change_pos = (change_pos > RBORDER_END) ? RBORDER_END : change_pos;
+			UWORD *ptr = (scrn_ptr + last_pos);
+			int k = adj_change_pos - last_pos;
+			do {
+				WRITE_VIDEO(ptr, *ptr | *(ptr - Screen_WIDTH / 2));
+				ptr++;
+			} while (--k);
+		}
+		last_pos = (change_pos > last_pos) ? change_pos: last_pos;
+	} while (!stop);
+}
+#endif /* NO_GTIA11_DELAY */
+#endif /* NEW_CYCLE_EXACT */
 
 #ifdef USE_CURSES
 void curses_display_line(int anticmode, const UBYTE *screendata);
@@ -2864,15 +2989,7 @@ void ANTIC_Frame(int draw_display)
 	int cpu2antic_index;
 #endif /* NEW_CYCLE_EXACT */
 #ifndef NO_GTIA11_DELAY
-#ifdef NEW_CYCLE_EXACT
-	int stop = FALSE;
-/* can be negative, leave as signed ints */
-	int old_curline_prior_pos;
-	int last_pos;
-	int change_pos;
-#else
 	int delayed_gtia11 = 250;
-#endif /* NEW_CYCLE_EXACT */
 #endif /* NO_GTIA11_DELAY */
 
 	ANTIC_ypos = 0;
@@ -2884,6 +3001,26 @@ void ANTIC_Frame(int draw_display)
 	scrn_ptr = (UWORD *) Screen_atari;
 #ifdef NEW_CYCLE_EXACT
 	ANTIC_cur_screen_pos = ANTIC_NOT_DRAWING;
+	if (draw_display) {
+		/* choose the drawing mode from what happened in the previous drawn frame */
+		if (midline_writes > 0)
+			cycle_exact_hold = CYCLE_EXACT_HOLD_FRAMES;
+		else if (cycle_exact_hold > 0)
+			cycle_exact_hold--;
+		midline_writes = 0;
+		if (!ANTIC_cycle_exact_auto || cycle_exact_hold > 0) {
+#ifndef NO_GTIA11_DELAY
+			if (!cycle_exact_frame) {
+				/* PRIOR changes weren't tracked in whole-line mode */
+				prevline_prior_pos = curline_prior_pos = ANTIC_prior_curpos;
+			}
+#endif
+			cycle_exact_frame = TRUE;
+		}
+		else
+			cycle_exact_frame = FALSE;
+		ANTIC_midline_check = ANTIC_cycle_exact_auto;
+	}
 #endif
 	need_dl = TRUE;
 	do {
@@ -3018,7 +3155,7 @@ void ANTIC_Frame(int draw_display)
 
 #ifdef NEW_CYCLE_EXACT
 		/* begin drawing here */
-		if (draw_display) {
+		if (draw_display && cycle_exact_frame) {
 			ANTIC_cur_screen_pos = LBORDER_START;
 			ANTIC_xpos = ANTIC_antic2cpu_ptr[ANTIC_xpos]; /* convert antic to cpu(need for WSYNC) */
 			if (dctr == lastline) {
@@ -3083,73 +3220,83 @@ void ANTIC_Frame(int draw_display)
 #endif /* NO_YPOS_BREAK_FLICKER */
 
 #ifdef NEW_CYCLE_EXACT
-		GTIA_NewPmScanline();
-		if (anticmode < 2 || (ANTIC_DMACTL & 3) == 0) {
+		if (cycle_exact_frame) {
+			GTIA_NewPmScanline();
+			if (anticmode < 2 || (ANTIC_DMACTL & 3) == 0) {
+				GOEOL_CYCLE_EXACT;
+				draw_partial_scanline(ANTIC_cur_screen_pos, RBORDER_END);
+				UPDATE_DMACTL;
+				UPDATE_GTIA_BUG;
+				ANTIC_cur_screen_pos = ANTIC_NOT_DRAWING;
+				YPOS_BREAK_FLICKER;
+				scrn_ptr += Screen_WIDTH / 2;
+				if (no_jvb) {
+					dctr++;
+					dctr &= 0xf;
+				}
+				continue;
+			}
+
 			GOEOL_CYCLE_EXACT;
 			draw_partial_scanline(ANTIC_cur_screen_pos, RBORDER_END);
 			UPDATE_DMACTL;
 			UPDATE_GTIA_BUG;
 			ANTIC_cur_screen_pos = ANTIC_NOT_DRAWING;
-			YPOS_BREAK_FLICKER;
-			scrn_ptr += Screen_WIDTH / 2;
-			if (no_jvb) {
-				dctr++;
-				dctr &= 0xf;
-			}
-			continue;
 		}
+		else
+#endif /* NEW_CYCLE_EXACT */
+		{
+			if (need_load && anticmode <= 5 && ANTIC_DMACTL & 3)
+				ANTIC_xpos += before_cycles[md];
 
-		GOEOL_CYCLE_EXACT;
-		draw_partial_scanline(ANTIC_cur_screen_pos, RBORDER_END);
-		UPDATE_DMACTL;
-		UPDATE_GTIA_BUG;
-		ANTIC_cur_screen_pos = ANTIC_NOT_DRAWING;
-
-#else /* NEW_CYCLE_EXACT not defined */
-		if (need_load && anticmode <= 5 && ANTIC_DMACTL & 3)
-			ANTIC_xpos += before_cycles[md];
-
-		CPU_GO(SCR_C);
-		GTIA_NewPmScanline();
+			CPU_GO(SCR_C);
+			GTIA_NewPmScanline();
+#ifdef NEW_CYCLE_EXACT
+			GTIA_UpdatePmplColls();
+#endif
 
-		ANTIC_xpos += ANTIC_DMAR;
+			ANTIC_xpos += ANTIC_DMAR;
 
-		if (anticmode < 2 || (ANTIC_DMACTL & 3) == 0) {
-			draw_antic_0_ptr();
-			GOEOL;
-			YPOS_BREAK_FLICKER;
-			scrn_ptr += Screen_WIDTH / 2;
-			if (no_jvb) {
-				dctr++;
-				dctr &= 0xf;
+			if (anticmode < 2 || (ANTIC_DMACTL & 3) == 0) {
+				draw_antic_0_ptr();
+				GOEOL;
+				YPOS_BREAK_FLICKER;
+				scrn_ptr += Screen_WIDTH / 2;
+				if (no_jvb) {
+					dctr++;
+					dctr &= 0xf;
+				}
+				continue;
 			}
-			continue;
-		}
 
-		if (need_load) {
-			antic_load();
+			if (need_load) {
+				antic_load();
 #ifdef USE_CURSES
-			/* Normally, we would call curses_display_line here,
-			   and not use scanlines_to_curses_display at all.
-			   That would however cause incorrect color of the "MEMORY"
-			   menu item in Self Test - it isn't set properly
-			   in the first scanline. We therefore postpone
-			   curses_display_line call to the next scanline. */
-			scanlines_to_curses_display = 1;
+				/* Normally, we would call curses_display_line here,
+				   and not use scanlines_to_curses_display at all.
+				   That would however cause incorrect color of the "MEMORY"
+				   menu item in Self Test - it isn't set properly
+				   in the first scanline. We therefore postpone
+				   curses_display_line call to the next scanline. */
+				scanlines_to_curses_display = 1;
 #endif
-			ANTIC_xpos += load_cycles[md];
-			if (anticmode <= 5)	/* extra cycles in font modes */
-				ANTIC_xpos -= extra_cycles[md];
-		}
+				ANTIC_xpos += load_cycles[md];
+				if (anticmode <= 5)	/* extra cycles in font modes */
+					ANTIC_xpos -= extra_cycles[md];
+			}
 
-		draw_antic_ptr(chars_displayed[md],
-			antic_memory + ANTIC_margin + ch_offset[md],
-			scrn_ptr + x_min[md],
-			(ULONG *) &GTIA_pm_scanline[x_min[md]]);
+			draw_antic_ptr(chars_displayed[md],
+				antic_memory + ANTIC_margin + ch_offset[md],
+				scrn_ptr + x_min[md],
+				(ULONG *) &GTIA_pm_scanline[x_min[md]]);
 
-#endif /* NEW_CYCLE_EXACT */
+		}
 #ifndef NO_GTIA11_DELAY
-#ifndef NEW_CYCLE_EXACT
+#ifdef NEW_CYCLE_EXACT
+		if (cycle_exact_frame)
+			gtia11_delay_cycle_exact();
+		else
+#endif
 		if (GTIA_PRIOR >= 0xc0)
 			delayed_gtia11 = ANTIC_ypos + 1;
 		else
@@ -3161,101 +3308,21 @@ void ANTIC_Frame(int draw_display)
 					ptr++;
 				} while (--k);
 			}
-#else /* NEW_CYCLE_EXACT defined */
-/* Basic explaination: */
-/* the ring buffer ANTIC_prior_pos_buf has three pointers: */
-/*     A   B  C              D     E    F      G   */
-/*     ^                     ^                 ^   */
-/* prevline_prior_pos  curline_prior_pos  ANTIC_prior_curpos  */
-/* G would be the most recent change which occurred during drawing */
-/* of the current line, D is the most recent */
-/* change before the current line was drawn, and A is the most recent */
-/* change before the previous line was drawn */
-/* curline_prior_pos is saved in old_curline_prior_pos */
-/* then the code will increase either curline_prior_pos or */
-/* prevline_prior_pos depending if the change at B or E occurred */
-/* earlier in the scanline ignoring which scanline it was */
-/* eg: */
-/*                              A occurs on some previous scanline */
-/* prev:     B                      C                          D     */
-/* current:                     E                    F           G   */
-/* so from the left end of the screen, the changes occurred in the order */
-/* B,E,C,F,D,G */
-/* then the code will read the values in that order, and each time it will */
-/* update prev_prior_val and cur_prior_val to be equal the the PRIOR values */
-/* "in effect" *before* those changes occurred.  If those PRIOR values */
-/* should cause a GTIA11_DELAY effect to occur then this is processed */
-/* for that portion of the scanline */
-/* At the end of processing, the buffer would look like: */
-/* the ring buffer ANTIC_prior_pos_buf has three pointers: */
-/*     A   B  C              D     E    F      G   */
-/*                           ^                 ^   */
-/*                    prevline_prior_pos  curline_prior_pos==ANTIC_prior_curpos  */
-
-		stop = FALSE;
-		last_pos = LBORDER_START;
-		old_curline_prior_pos = curline_prior_pos;
-		do {
-
-			UBYTE prev_prior_val;
-			UBYTE cur_prior_val;
-			prev_prior_val = ANTIC_prior_val_buf[prevline_prior_pos];
-			cur_prior_val = ANTIC_prior_val_buf[curline_prior_pos];
-
-			if (prevline_prior_pos == old_curline_prior_pos &&
-				curline_prior_pos == ANTIC_prior_curpos) {
-			/* no more changes */
-				change_pos = RBORDER_END;
-				stop = TRUE;
-			}
-			else if (prevline_prior_pos != old_curline_prior_pos &&
-				curline_prior_pos != ANTIC_prior_curpos) {
-			/* find leftmost change */
-				int pnext = (prevline_prior_pos + 1) % ANTIC_PRIOR_BUF_SIZE;
-				int cnext = (curline_prior_pos + 1) % ANTIC_PRIOR_BUF_SIZE;
-				if (ANTIC_prior_pos_buf[pnext] < ANTIC_prior_pos_buf[cnext]) {
-					change_pos = ANTIC_prior_pos_buf[pnext];
-					prevline_prior_pos = pnext;
-				}
-				else {
-					change_pos = ANTIC_prior_pos_buf[cnext];
-					curline_prior_pos = cnext;
-				}
-			}
-			else if (prevline_prior_pos != old_curline_prior_pos) {
-				/* only have prevline change */
-				prevline_prior_pos = (prevline_prior_pos + 1) % ANTIC_PRIOR_BUF_SIZE;
-				change_pos = ANTIC_prior_pos_buf[prevline_prior_pos];
-			}
-			else {
-				/* must only have curline change */
-				curline_prior_pos = (curline_prior_pos + 1) % ANTIC_PRIOR_BUF_SIZE;
-				change_pos = ANTIC_prior_pos_buf[curline_prior_pos];
-			}
-
-			if (prev_prior_val >= 0xc0 && cur_prior_val < 0xc0 &&
-				change_pos > LBORDER_START &&
-				change_pos > last_pos && last_pos < RBORDER_END) {
-				int adj_change_pos = (change_pos > RBORDER_END) ? RBORDER_END : change_pos;
-				UWORD *ptr = (scrn_ptr + last_pos);
-				int k = adj_change_pos - last_pos;
-				do {
-					WRITE_VIDEO(ptr, *ptr | *(ptr - Screen_WIDTH / 2));
-					ptr++;
-				} while (--k);
-			}
-			last_pos = (change_pos > last_pos) ? change_pos: last_pos;
-		} while (!stop);
-#endif /* NEW_CYCLE_EXACT */
 #endif /* NO_GTIA11_DELAY */
-#ifndef NEW_CYCLE_EXACT
-		GOEOL;
-#endif /* NEW_CYCLE_EXACT */
+#ifdef NEW_CYCLE_EXACT
+		if (!cycle_exact_frame)
+#endif
+		{
+			GOEOL;
+		}
 		YPOS_BREAK_FLICKER;
 		scrn_ptr += Screen_WIDTH / 2;
 		dctr++;
 		dctr &= 0xf;
 	} while (ANTIC_ypos < (Screen_HEIGHT + 8));
+#ifdef NEW_CYCLE_EXACT
+	ANTIC_midline_check = FALSE;
+#endif
 
 /* TODO: cycle-exact overscreen lines */
 	POKEY_Scanline();		/* check and generate IRQ */
@@ -3764,6 +3831,12 @@ void ANTIC_SetPrior(UBYTE byte)
 
 void ANTIC_PutByte(UWORD addr, UBYTE byte)
 {
+#ifdef NEW_CYCLE_EXACT
+	/* registers that the whole-line drawing reads once per scanline */
+	if (ANTIC_midline_check && ((1 << (addr & 0xf)) & ((1 << ANTIC_OFFSET_DMACTL) | (1 << ANTIC_OFFSET_CHACTL)
+		| (1 << ANTIC_OFFSET_HSCROL) | (1 << ANTIC_OFFSET_CHBASE))))
+		ANTIC_CheckMidlineWrite();
+#endif
 	switch (addr & 0xf) {
 	case ANTIC_OFFSET_DLISTL:
 		ANTIC_dlist = (ANTIC_dlist & 0xff00) | byte;
@@ -4194,6 +4267,17 @@ void ANTIC_StateSave(void)
 	StateSav_SaveINT(&ANTIC_xpos, 1);
 	StateSav_SaveINT(&ANTIC_xpos_limit, 1);
 	StateSav_SaveINT(&ANTIC_ypos, 1);
+
+#ifdef NEW_CYCLE_EXACT
+	/* not in state files, but snapshots must choose the drawing mode
+	   (and so draw the same screens) as the emulation they came from */
+	if (StateSav_in_memory) {
+		StateSav_SaveINT(&midline_writes, 1);
+		StateSav_SaveINT(&cycle_exact_hold, 1);
+		StateSav_SaveINT(&cycle_exact_frame, 1);
+		StateSav_SaveINT(&ANTIC_midline_check, 1);
+	}
+#endif
 }
 
 void ANTIC_StateRead(void)
@@ -4220,6 +4304,27 @@ void ANTIC_StateRead(void)
 	StateSav_ReadINT(&ANTIC_xpos_limit, 1);
 	StateSav_ReadINT(&ANTIC_ypos, 1);
 
+#ifdef NEW_CYCLE_EXACT
+	if (StateSav_in_memory) {
+		StateSav_ReadINT(&midline_writes, 1);
+		StateSav_ReadINT(&cycle_exact_hold, 1);
+		StateSav_ReadINT(&cycle_exact_frame, 1);
+		StateSav_ReadINT(&ANTIC_midline_check, 1);
+	}
+	else {
+		/* draw cycle-exact for a while, whatever was emulated before;
+		   mid-line writes are counted again from the next drawn frame */
+		midline_writes = 0;
+		cycle_exact_hold = CYCLE_EXACT_HOLD_FRAMES;
+#ifndef NO_GTIA11_DELAY
+		if (!cycle_exact_frame)
+			prevline_prior_pos = curline_prior_pos = ANTIC_prior_curpos;
+#endif
+		cycle_exact_frame = TRUE;
+		ANTIC_midline_check = FALSE;
+	}
+#endif
+
 	ANTIC_PutByte(ANTIC_OFFSET_DMACTL, ANTIC_DMACTL);
 	ANTIC_PutByte(ANTIC_OFFSET_CHACTL, ANTIC_CHACTL);
 	ANTIC_PutByte(ANTIC_OFFSET_PMBASE, ANTIC_PMBASE);
@@ -118,6 +118,16 @@ extern UWORD ANTIC_hires_lookup_l[128];
 #define ANTIC_DRAWING_SCREEN (ANTIC_cur_screen_pos!=ANTIC_NOT_DRAWING)
 extern int ANTIC_delayed_wsync;
 extern int ANTIC_cur_screen_pos;
+/* If TRUE (the default), drawn frames use the cycle-exact renderer only
+   while the program changes video registers in the middle of scanlines;
+   other frames are drawn a whole line at a time, which is much faster.
+   If FALSE, all drawn frames are cycle-exact. */
+extern int ANTIC_cycle_exact_auto;
+/* TRUE while the visible lines of a drawn frame are emulated in
+   ANTIC_cycle_exact_auto mode; ANTIC_CheckMidlineWrite() must be called
+   on writes to registers used by the scanline drawing. */
+extern int ANTIC_midline_check;
+void ANTIC_CheckMidlineWrite(void);
 extern const int *ANTIC_cpu2antic_ptr;
 extern const int *ANTIC_antic2cpu_ptr;
 void ANTIC_UpdateScanline(void);
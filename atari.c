@@ -82,11 +82,17 @@
 #include "pbi.h"
 #include "sio.h"
 #include "util.h"
+#include "worker.h"
 #if !defined(BASIC) && !defined(CURSES_BASIC)
 #include "colours.h"
 #include "screen.h"
+#include "vidcap.h"
 #endif
 #ifndef BASIC
+#include "bootcache.h"
+#ifdef EVENT_RECORDING
+#include "movie.h"
+#endif
 #include "statesav.h"
 #ifndef __PLUS
 #include "ui.h"
@@ -136,6 +142,13 @@ int verbose = FALSE;
 int Atari800_display_screen = FALSE;
 int Atari800_nframes = 0;
 int Atari800_refresh_rate = 1;
+int Atari800_turbo = FALSE;
+int Atari800_auto_turbo = FALSE;
+int Atari800_auto_frameskip = FALSE;
+Atari800_tFrameStats Atari800_frame_stats;
+int Atari800_run_ahead = 0;
+double Atari800_run_ahead_time = 0;
+int Atari800_speculating = FALSE;
 int Atari800_collisions_in_skipped_frames = FALSE;
 
 #ifdef BENCHMARK
@@ -316,6 +329,7 @@ int Atari800_Initialise(int *argc, char *argv[])
 	const char *run_direct = NULL;
 #ifndef BASIC
 	const char *state_file = NULL;
+	int seek_frame = 0;
 #endif
 #ifdef __PLUS
 	/* Atari800Win PLus doesn't use configuration files,
@@ -564,6 +578,28 @@ int Atari800_Initialise(int *argc, char *argv[])
 			else if (strcmp(argv[i], "-state") == 0) {
 				if (i_a) state_file = argv[++i]; else a_m = TRUE;
 			}
+			else if (strcmp(argv[i], "-autoframeskip") == 0)
+				Atari800_auto_frameskip = TRUE;
+			else if (strcmp(argv[i], "-turbo") == 0)
+				Atari800_turbo = TRUE;
+			else if (strcmp(argv[i], "-autoturbo") == 0)
+				Atari800_auto_turbo = TRUE;
+			else if (strcmp(argv[i], "-skippedcollisions") == 0)
+				Atari800_collisions_in_skipped_frames = TRUE;
+			else if (strcmp(argv[i], "-seek") == 0) {
+				if (i_a) seek_frame = Util_sscandec(argv[++i]); else a_m = TRUE;
+			}
+			else if (strcmp(argv[i], "-runahead") == 0) {
+				if (i_a) {
+					Atari800_run_ahead = Util_sscandec(argv[++i]);
+					if (Atari800_run_ahead < 0 || Atari800_run_ahead > Atari800_RUN_AHEAD_MAX) {
+						Log_print("Invalid run-ahead frame count, using 0");
+						Atari800_run_ahead = 0;
+					}
+				}
+				else
+					a_m = TRUE;
+			}
 			else if (strcmp(argv[i], "-refresh") == 0) {
 				if (i_a) {
 					Atari800_refresh_rate = Util_sscandec(argv[++i]);
@@ -604,6 +640,12 @@ int Atari800_Initialise(int *argc, char *argv[])
 #ifndef BASIC
 					Log_print("\t-state <file>    Load saved-state file");
 					Log_print("\t-refresh <rate>  Specify screen refresh rate");
+					Log_print("\t-autoframeskip   Adjust refresh rate to keep full speed");
+					Log_print("\t-turbo           Run as fast as possible");
+					Log_print("\t-autoturbo       Run as fast as possible while loading from disk or tape");
+					Log_print("\t-seek <frame>    Fast-forward to <frame> (of the movie if -playback)");
+					Log_print("\t-skippedcollisions Detect collisions in frames not drawn");
+					Log_print("\t-runahead <n>    Run <n> frames ahead to reduce input lag (0-%d)", Atari800_RUN_AHEAD_MAX);
 #endif
 					Log_print("\t-nopatch         Don't patch SIO routine in OS");
 					Log_print("\t-nopatchall      Don't patch OS at all, H: device won't work");
@@ -640,9 +682,11 @@ int Atari800_Initialise(int *argc, char *argv[])
 		|| !RTIME_Initialise(argc, argv)
 		|| !SIO_Initialise (argc, argv)
 		|| !CASSETTE_Initialise(argc, argv)
+		|| !CARTRIDGE_Initialise(argc, argv)
 		|| !PBI_Initialise(argc,argv)
 #ifndef BASIC
 		|| !INPUT_Initialise(argc, argv)
+		|| !BOOTCACHE_Initialise(argc, argv)
 #endif
 #ifdef XEP80_EMULATION
 		|| !XEP80_Initialise(argc, argv)
@@ -754,6 +798,11 @@ int Atari800_Initialise(int *argc, char *argv[])
 #endif /* __PLUS */
 	}
 
+#ifndef BASIC
+	if (state_file == NULL && BOOTCACHE_Start(run_direct))
+		run_direct = NULL; /* already loaded in the cached state */
+#endif
+
 	/* Load Atari executable, if any */
 	if (run_direct != NULL)
 		BINLOAD_Loader(run_direct);
@@ -772,6 +821,11 @@ int Atari800_Initialise(int *argc, char *argv[])
 	signal(SIGINT, sigint_handler);
 #endif
 
+#if !defined(BASIC) && !defined(__PLUS)
+	if (seek_frame > 0 && Atari800_Seek(seek_frame) < 0)
+		Log_print("Cannot seek to frame %d", seek_frame);
+#endif
+
 #ifdef __PLUS
 #ifndef _WX_
 	/* Update the Registry if any parameters were specified */
@@ -826,6 +880,10 @@ int Atari800_Exit(int run_monitor)
 			sums[0], sums[1], sums[2], sums[3], sums[4], sums[5]);
 	}
 #endif /* STAT_UNALIGNED_WORDS */
+#ifndef BASIC
+	if (Atari800_run_ahead_time > 0)
+		Log_print("Run-ahead took %.2f ms per displayed frame", Atari800_run_ahead_time * 1000);
+#endif
 	restart = PLATFORM_Exit(run_monitor);
 #ifndef __PLUS
 	if (!restart) {
@@ -839,6 +897,10 @@ int Atari800_Exit(int run_monitor)
 #ifdef SOUND
 		SndSave_CloseSoundFile();
 #endif
+#if !defined(BASIC) && !defined(CURSES_BASIC)
+		VIDCAP_Stop();
+#endif
+		WORKER_Exit();
 	}
 #endif /* __PLUS */
 	return restart;
@@ -917,6 +979,9 @@ static void Atari_sleep(double s)
 
 #endif /* PS2 */
 
+/* Time when Atari800_Sync() finished sleeping. */
+static double sync_end_time = 0;
+
 void Atari800_Sync(void)
 {
 	static double lasttime = 0;
@@ -933,11 +998,232 @@ void Atari800_Sync(void)
 	Atari_sleep(lasttime - Atari_time());
 #endif
 	curtime = Atari_time();
+	sync_end_time = curtime;
 
 	if ((lasttime + deltatime) < curtime)
 		lasttime = curtime;
 }
 
+#ifndef BASIC
+
+/* Weight of a new measurement in the moving averages. */
+#define AUTO_FRAMESKIP_SMOOTHING    0.1
+/* Measurements longer than this (menus, file dialogs) are ignored. */
+#define AUTO_FRAMESKIP_MAX_TIME     0.25
+/* Number of consecutive drawn frames over the budget before
+   the refresh rate is increased. */
+#define AUTO_FRAMESKIP_UP_DELAY     3
+/* Number of consecutive drawn frames for which the lower refresh rate
+   is predicted to fit in AUTO_FRAMESKIP_DOWN_MARGIN of the budget
+   before it is used. Keeps the rate from oscillating. */
+#define AUTO_FRAMESKIP_DOWN_DELAY   50
+#define AUTO_FRAMESKIP_DOWN_MARGIN  0.85
+
+static double frame_start_time = 0;
+static double frame_end_time = 0;
+static double host_time = 0;	/* not yet accounted host time spent outside Atari800_Frame() */
+static int frame_displayed = FALSE;
+static int over_budget = 0;
+static int under_budget = 0;
+
+static void AutoFrameskip_Average(double *average, double value, unsigned int samples)
+{
+	if (samples == 0)
+		*average = value;
+	else
+		*average += (value - *average) * AUTO_FRAMESKIP_SMOOTHING;
+}
+
+static double AutoFrameskip_Predict(int rate)
+{
+	double skipped = Atari800_frame_stats.skipped_frames > 0
+		? Atari800_frame_stats.skipped_frame : Atari800_frame_stats.drawn_frame;
+	return (Atari800_frame_stats.drawn_frame + Atari800_frame_stats.display + (rate - 1) * skipped) / rate;
+}
+
+static void AutoFrameskip_BeginFrame(void)
+{
+	double last_end = frame_end_time > sync_end_time ? frame_end_time : sync_end_time;
+	frame_start_time = Atari_time();
+	host_time = 0;
+	if (last_end > 0 && frame_start_time - last_end < AUTO_FRAMESKIP_MAX_TIME) {
+		if (frame_displayed)
+			AutoFrameskip_Average(&Atari800_frame_stats.display, frame_start_time - last_end, Atari800_frame_stats.drawn_frames);
+		else
+			host_time = frame_start_time - last_end; /* charged to this frame */
+	}
+}
+
+static void AutoFrameskip_EndFrame(int drawn)
+{
+	double budget = 1.0 / ((Atari800_tv_mode == Atari800_TV_PAL) ? 50 : 60);
+	double cost;
+
+	frame_end_time = Atari_time();
+	frame_displayed = Atari800_display_screen;
+	cost = frame_end_time - frame_start_time + host_time;
+	if (cost >= AUTO_FRAMESKIP_MAX_TIME)
+		return;
+	if (!drawn) {
+		AutoFrameskip_Average(&Atari800_frame_stats.skipped_frame, cost, Atari800_frame_stats.skipped_frames);
+		Atari800_frame_stats.skipped_frames++;
+		return;
+	}
+	AutoFrameskip_Average(&Atari800_frame_stats.drawn_frame, cost, Atari800_frame_stats.drawn_frames);
+	Atari800_frame_stats.drawn_frames++;
+
+	/* decide once per refresh cycle, at its drawn frame */
+	if (AutoFrameskip_Predict(Atari800_refresh_rate) > budget
+	 && Atari800_refresh_rate < Atari800_AUTO_FRAMESKIP_MAX_RATE) {
+		under_budget = 0;
+		if (++over_budget >= AUTO_FRAMESKIP_UP_DELAY) {
+			Atari800_refresh_rate++;
+			Atari800_frame_stats.rate_changes++;
+			over_budget = 0;
+		}
+	}
+	else if (Atari800_refresh_rate > 1
+	 && AutoFrameskip_Predict(Atari800_refresh_rate - 1) < budget * AUTO_FRAMESKIP_DOWN_MARGIN) {
+		over_budget = 0;
+		if (++under_budget >= AUTO_FRAMESKIP_DOWN_DELAY) {
+			Atari800_refresh_rate--;
+			Atari800_frame_stats.rate_changes++;
+			under_budget = 0;
+		}
+	}
+	else
+		over_budget = under_budget = 0;
+}
+
+#if defined(SOUND) && !defined(__PLUS)
+static void (*saved_update)(UWORD, UBYTE, UBYTE, UBYTE);
+#ifdef SERIO_SOUND
+static void (*saved_update_serio)(int, UBYTE);
+#endif
+#ifdef CONSOLE_SOUND
+static void (*saved_update_consol)(int);
+#endif
+#ifdef VOL_ONLY_SOUND
+static void (*saved_update_vol_only)(void);
+#endif
+
+static void NoUpdate(UWORD addr, UBYTE val, UBYTE chip, UBYTE gain)
+{
+}
+
+#ifdef SERIO_SOUND
+static void NoUpdateSerio(int out, UBYTE data)
+{
+}
+#endif
+
+#ifdef CONSOLE_SOUND
+static void NoUpdateConsol(int set)
+{
+}
+#endif
+
+#ifdef VOL_ONLY_SOUND
+static void NoUpdateVolOnly(void)
+{
+}
+#endif
+
+static int mute_count = 0;
+
+/* Disconnects POKEY from the sound output while frames are emulated
+   only for their effect on the machine. Calls nest. */
+static void MuteSound(void)
+{
+	if (mute_count++ > 0)
+		return;
+	saved_update = POKEYSND_Update;
+	POKEYSND_Update = NoUpdate;
+#ifdef SERIO_SOUND
+	saved_update_serio = POKEYSND_UpdateSerio;
+	POKEYSND_UpdateSerio = NoUpdateSerio;
+#endif
+#ifdef CONSOLE_SOUND
+	saved_update_consol = POKEYSND_UpdateConsol;
+	POKEYSND_UpdateConsol = NoUpdateConsol;
+#endif
+#ifdef VOL_ONLY_SOUND
+	saved_update_vol_only = POKEYSND_UpdateVolOnly;
+	POKEYSND_UpdateVolOnly = NoUpdateVolOnly;
+#endif
+}
+
+static void UnmuteSound(void)
+{
+	if (--mute_count > 0)
+		return;
+	POKEYSND_Update = saved_update;
+#ifdef SERIO_SOUND
+	POKEYSND_UpdateSerio = saved_update_serio;
+#endif
+#ifdef CONSOLE_SOUND
+	POKEYSND_UpdateConsol = saved_update_consol;
+#endif
+#ifdef VOL_ONLY_SOUND
+	POKEYSND_UpdateVolOnly = saved_update_vol_only;
+#endif
+}
+#endif /* defined(SOUND) && !defined(__PLUS) */
+
+#if !defined(BASIC) && !defined(CURSES_BASIC)
+
+static UBYTE *run_ahead_buffer = NULL;
+static size_t run_ahead_buffer_size = 0;
+static unsigned int run_ahead_frames = 0;
+
+/* Called after a drawn frame: emulates Atari800_run_ahead more frames
+   with the same input, leaves the last one in Screen_atari and restores
+   the machine to the end of the real frame. */
+static void RunAhead_Frames(void)
+{
+	double start_time;
+	size_t size;
+	int i;
+
+	/* Disk operations would be repeated, and the positions in the
+	   executable, the tape and host files are not in the snapshot. */
+	if (SIO_last_op_time > 0 || BINLOAD_bin_file != NULL || CASSETTE_IsRunning()
+	 || Devices_HostFilesOpen())
+		return;
+	start_time = Atari_time();
+	/* only counts the bytes, so it's cheap; the size changes with the machine */
+	size = StateSav_SaveSnapshot(NULL, 0);
+	if (size > run_ahead_buffer_size) {
+		run_ahead_buffer = (UBYTE *) Util_realloc(run_ahead_buffer, size);
+		run_ahead_buffer_size = size;
+	}
+	if (StateSav_SaveSnapshot(run_ahead_buffer, run_ahead_buffer_size) == 0)
+		return;
+
+#if defined(SOUND) && !defined(__PLUS)
+	MuteSound();
+#endif
+	Atari800_speculating = TRUE;
+	for (i = 1; i <= Atari800_run_ahead; i++) {
+		GTIA_Frame();
+		ANTIC_Frame(i == Atari800_run_ahead ? TRUE : Atari800_collisions_in_skipped_frames);
+		POKEY_Frame();
+	}
+	Atari800_speculating = FALSE;
+#if defined(SOUND) && !defined(__PLUS)
+	UnmuteSound();
+#endif
+	/* also brings the sound registers back */
+	StateSav_ReadSnapshot(run_ahead_buffer, size);
+
+	AutoFrameskip_Average(&Atari800_run_ahead_time, Atari_time() - start_time, run_ahead_frames);
+	run_ahead_frames++;
+}
+
+#endif /* !defined(BASIC) && !defined(CURSES_BASIC) */
+
+#endif /* BASIC */
+
 #ifdef USE_CURSES
 void curses_clear_screen(void);
 #endif
@@ -1097,10 +1383,82 @@ static void basic_frame(void)
 
 #endif /* defined(BASIC) || defined(VERY_SLOW) || defined(CURSES_BASIC) */
 
+#ifndef BASIC
+/* TRUE while Atari800_Seek() runs frames that are not displayed */
+static int seeking = FALSE;
+
+/* Frames that Atari800_auto_turbo stays on after the last serial I/O,
+   to bridge the pauses between sectors and tape records. */
+#define AUTO_TURBO_HOLD 25
+/* Seconds between the frames drawn during the auto turbo. */
+#define AUTO_TURBO_DRAW_INTERVAL 0.1
+
+static int auto_turbo = FALSE;
+static int auto_turbo_hold = 0;
+static double auto_turbo_draw_time = 0.0;
+
+/* The audio of a video capture comes from the sound output, which the host
+   plays in real time, so the capture is made at the normal speed. */
+static int VideoCapture(void)
+{
+#ifndef CURSES_BASIC
+	return VIDCAP_IsRecording();
+#else
+	return FALSE;
+#endif
+}
+
+/* Called at the end of each frame: switches the auto turbo on while bytes
+   are being transferred through POKEY's serial port, and off when
+   the transfers stop. */
+static void AutoTurbo_Update(void)
+{
+	if (VideoCapture())
+		auto_turbo_hold = 0;
+	else if (Atari800_auto_turbo && (POKEY_DELAYED_SERIN_IRQ > 0
+	 || POKEY_DELAYED_SEROUT_IRQ > 0 || POKEY_DELAYED_XMTDONE_IRQ > 0
+	 || CASSETTE_IsRunning()))
+		auto_turbo_hold = AUTO_TURBO_HOLD;
+	else if (auto_turbo_hold > 0)
+		auto_turbo_hold--;
+	if (auto_turbo_hold > 0 && !auto_turbo) {
+		auto_turbo = TRUE;
+		auto_turbo_draw_time = Atari_time();
+#if defined(SOUND) && !defined(__PLUS)
+		MuteSound();
+#endif
+	}
+	else if (auto_turbo_hold == 0 && auto_turbo) {
+		auto_turbo = FALSE;
+#if defined(SOUND) && !defined(__PLUS)
+		UnmuteSound();
+#endif
+	}
+}
+
+/* Returns FALSE for the frames not drawn during the auto turbo. */
+static int AutoTurbo_Draw(void)
+{
+	double time;
+	if (!auto_turbo)
+		return TRUE;
+	time = Atari_time();
+	if (time - auto_turbo_draw_time < AUTO_TURBO_DRAW_INTERVAL)
+		return FALSE;
+	auto_turbo_draw_time = time;
+	return TRUE;
+}
+#endif
+
 void Atari800_Frame(void)
 {
 #ifndef BASIC
 	static int refresh_counter = 0;
+#ifndef CURSES_BASIC
+	int auto_screenshot;
+#endif
+	if (Atari800_auto_frameskip && !seeking)
+		AutoFrameskip_BeginFrame();
 	switch (INPUT_key_code) {
 	case AKEY_COLDSTART:
 		Atari800_Coldstart();
@@ -1145,18 +1503,27 @@ void Atari800_Frame(void)
 	PBI_XLD_VFrame(); /* for the Votrax */
 #endif
 	Devices_Frame();
+	SIO_Frame();
 #ifndef BASIC
 	INPUT_Frame();
 #endif
 	GTIA_Frame();
 #ifdef SOUND
-	Sound_Update();
+#ifndef BASIC
+	if (!seeking && !auto_turbo)
+#endif
+		Sound_Update();
 #endif
 
 #ifdef BASIC
 	basic_frame();
 #else /* BASIC */
-	if (++refresh_counter >= Atari800_refresh_rate) {
+#ifndef CURSES_BASIC
+	auto_screenshot = !seeking && Screen_AutoScreenshotDue();
+	if (auto_screenshot)
+		refresh_counter = Atari800_refresh_rate; /* don't skip this frame */
+#endif
+	if (!seeking && ++refresh_counter >= Atari800_refresh_rate && AutoTurbo_Draw()) {
 		refresh_counter = 0;
 #ifdef USE_CURSES
 		curses_clear_screen();
@@ -1165,9 +1532,6 @@ void Atari800_Frame(void)
 		basic_frame();
 #else
 		ANTIC_Frame(TRUE);
-		INPUT_DrawMousePointer();
-		Screen_DrawAtariSpeed(Atari_time());
-		Screen_DrawDiskLED();
 #endif /* CURSES_BASIC */
 #ifdef DONT_DISPLAY
 		Atari800_display_screen = FALSE;
@@ -1185,7 +1549,32 @@ void Atari800_Frame(void)
 	}
 #endif /* BASIC */
 	POKEY_Frame();
+#if !defined(BASIC) && !defined(CURSES_BASIC)
+	if (refresh_counter == 0 && !seeking) {
+		if (Atari800_run_ahead > 0)
+			RunAhead_Frames();
+		if (auto_screenshot)
+			Screen_SaveNextScreenshot(FALSE);
+		INPUT_DrawMousePointer();
+		Screen_DrawAtariSpeed(Atari_time());
+		Screen_DrawDiskLED();
+	}
+	if (!seeking)
+		VIDCAP_Frame(refresh_counter == 0);
+#endif
 	Atari800_nframes++;
+#ifndef BASIC
+	BOOTCACHE_Frame();
+	if (seeking) {
+#ifdef EVENT_RECORDING
+		MOVIE_ScreenNotDrawn();
+#endif
+		return;
+	}
+	AutoTurbo_Update();
+	if (Atari800_auto_frameskip && !auto_turbo)
+		AutoFrameskip_EndFrame(refresh_counter == 0);
+#endif
 #ifdef BENCHMARK
 	if (Atari800_nframes >= BENCHMARK) {
 		double benchmark_time = Atari_time() - benchmark_start_time;
@@ -1195,6 +1584,11 @@ void Atari800_Frame(void)
 	}
 #else
 
+#ifndef BASIC
+	if ((!Atari800_turbo && !auto_turbo) || VideoCapture())
+#else
+	if (!Atari800_turbo)
+#endif
 #ifdef ALTERNATE_SYNC_WITH_HOST
 	if (refresh_counter == 0)
 #endif
@@ -1202,6 +1596,48 @@ void Atari800_Frame(void)
 #endif /* BENCHMARK */
 }
 
+#ifndef BASIC
+int Atari800_Seek(int frame)
+{
+	int reached;
+
+#ifdef EVENT_RECORDING
+	if (MOVIE_IsPlaying()) {
+		/* go back to a snapshot if needed */
+		if (frame < MOVIE_frame || frame - MOVIE_frame > MOVIE_snapshot_interval) {
+			reached = MOVIE_Seek(frame);
+			if (reached < 0)
+				return -1;
+		}
+		reached = MOVIE_frame;
+	}
+	else
+#endif
+		reached = Atari800_nframes;
+	if (frame < reached)
+		return -1;
+
+	/* keys pressed before the seek would be repeated in every frame */
+	INPUT_key_code = AKEY_NONE;
+	seeking = TRUE;
+#if defined(SOUND) && !defined(__PLUS)
+	MuteSound();
+#endif
+	for (; reached < frame - 1; reached++)
+		Atari800_Frame();
+#if defined(SOUND) && !defined(__PLUS)
+	UnmuteSound();
+#endif
+	seeking = FALSE;
+	/* the last frame is a normal one, so it's displayed */
+	if (reached < frame) {
+		Atari800_Frame();
+		reached++;
+	}
+	return reached;
+}
+#endif /* BASIC */
+
 #endif /* __PLUS */
 
 #ifndef BASIC
@@ -1290,6 +1726,8 @@ void Atari800_StateRead(void)
 	int os;
 	int default_system;
 	int pil_on;
+	int old_machine_type = Atari800_machine_type;
+	int old_ram_size = MEMORY_ram_size;
 
 	StateSav_ReadUBYTE(&temp, 1);
 	new_tv_mode = (temp == 0) ? Atari800_TV_PAL : Atari800_TV_NTSC;
@@ -1353,7 +1791,10 @@ void Atari800_StateRead(void)
 	StateSav_ReadINT(&pil_on, 1);
 	StateSav_ReadINT(&default_tv_mode, 1);
 	StateSav_ReadINT(&default_system, 1);
-	load_roms();
+	/* the ROMs of the current machine are still loaded */
+	if (!StateSav_in_memory || Atari800_machine_type != old_machine_type
+	 || MEMORY_ram_size != old_ram_size)
+		load_roms();
 	/* XXX: what about patches? */
 }
 
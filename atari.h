@@ -67,6 +67,60 @@ extern int Atari800_nframes;
 /* How often the screen is updated (1 = every Atari frame). */
 extern int Atari800_refresh_rate;
 
+/* If TRUE, Atari800_Frame() doesn't wait for the real time of the frame. */
+extern int Atari800_turbo;
+
+/* If TRUE, Atari800_Frame() runs like with Atari800_turbo, without drawing
+   most frames or producing sound, while the Atari transfers data through
+   POKEY's serial port (disk drives with the SIO patch off, cassette).
+   Only the real time changes, the emulation is the same. */
+extern int Atari800_auto_turbo;
+
+/* Emulates frames as fast as possible until frame is reached: without
+   drawing them (except the last one), producing sound or waiting for the
+   real time. frame counts Atari800_nframes, or movie frames during
+   playback, when seeking backwards restores the last snapshot before
+   frame. Skipped frames are emulated exactly like with -refresh, so the
+   result only depends on the start state and the input; set
+   Atari800_collisions_in_skipped_frames for programs that rely on
+   collisions. Returns the frame reached, or -1 if it can't be reached. */
+int Atari800_Seek(int frame);
+
+/* If TRUE, Atari800_Frame() measures how long drawing, skipping
+   and displaying a frame takes on the host and adjusts
+   Atari800_refresh_rate (1 to Atari800_AUTO_FRAMESKIP_MAX_RATE)
+   so that the emulation keeps real-time speed. */
+extern int Atari800_auto_frameskip;
+#define Atari800_AUTO_FRAMESKIP_MAX_RATE 6
+
+/* Measurements of the automatic frame skip. Times are moving averages
+   in seconds; they are only updated while Atari800_auto_frameskip is on. */
+typedef struct {
+	double drawn_frame;    /* Atari800_Frame() with the screen drawn */
+	double skipped_frame;  /* Atari800_Frame() with drawing skipped */
+	double display;        /* host time between Atari800_Frame() calls
+	                          after a frame was displayed */
+	unsigned int drawn_frames;
+	unsigned int skipped_frames;
+	unsigned int rate_changes;
+} Atari800_tFrameStats;
+extern Atari800_tFrameStats Atari800_frame_stats;
+
+/* Number of frames emulated ahead of the displayed one (0 = off).
+   After each drawn frame the machine is snapshotted, run this many frames
+   further with the same input and without sound, and restored; the screen
+   shows the last of them. Hides the input lag of games that read
+   the controllers in their VBI. */
+extern int Atari800_run_ahead;
+#define Atari800_RUN_AHEAD_MAX 4
+/* Moving average of the host time (seconds) run-ahead adds
+   to a displayed frame. */
+extern double Atari800_run_ahead_time;
+/* TRUE while run-ahead emulates the frames that will be thrown away.
+   Restoring the snapshot can't undo writes to the host (disk images,
+   the tape, H:, P: and R:), so they fail meanwhile. */
+extern int Atari800_speculating;
+
 /* Set to TRUE for faster emulation with Atari800_refresh_rate > 1.
    Set to FALSE for accurate emulation with Atari800_refresh_rate > 1. */
 extern int Atari800_collisions_in_skipped_frames;
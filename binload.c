@@ -24,6 +24,7 @@
 
 #include "config.h"
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "atari.h"
 #include "binload.h"
@@ -33,18 +34,33 @@
 #include "log.h"
 #include "memory.h"
 #include "sio.h"
+#include "util.h"
 
 int BINLOAD_start_binloading = FALSE;
 int BINLOAD_loading_basic = 0;
 FILE *BINLOAD_bin_file = NULL;
 
+/* A binary file is read into memory at once by BINLOAD_Loader() and its
+   segments are copied from there. BINLOAD_bin_file stays open while
+   the program is being loaded. */
+static UBYTE *bin_data = NULL;
+static size_t bin_size = 0;
+static size_t bin_pos = 0;
+
+static void close_bin_file(void)
+{
+	fclose(BINLOAD_bin_file);
+	BINLOAD_bin_file = NULL;
+	free(bin_data);
+	bin_data = NULL;
+}
+
 /* Read a word from file */
 static int read_word(void)
 {
-	UBYTE buf[2];
-	if (fread(buf, 1, 2, BINLOAD_bin_file) != 2) {
-		fclose(BINLOAD_bin_file);
-		BINLOAD_bin_file = NULL;
+	int word;
+	if (bin_size - bin_pos < 2) {
+		close_bin_file();
 		if (BINLOAD_start_binloading) {
 			BINLOAD_start_binloading = FALSE;
 			Log_print("binload: not valid BIN file");
@@ -53,7 +69,25 @@ static int read_word(void)
 		CPU_regPC = MEMORY_dGetWordAligned(0x2e0);
 		return -1;
 	}
-	return buf[0] + (buf[1] << 8);
+	word = bin_data[bin_pos] + (bin_data[bin_pos + 1] << 8);
+	bin_pos += 2;
+	return word;
+}
+
+/* Copies length bytes of the file to the Atari memory at from,
+   through MEMORY_PutByte() so that writes to ROM and I/O behave as usual. */
+static void copy_segment(UWORD from, int length)
+{
+	const UBYTE *data = bin_data + bin_pos;
+	bin_pos += length;
+	if ((int) from + length > 0x10000) {
+		int first = 0x10000 - from;
+		MEMORY_CopyToMem(data, from, first);
+		data += first;
+		length -= first;
+		from = 0;
+	}
+	MEMORY_CopyToMem(data, from, length);
 }
 
 /* Start or continue loading */
@@ -68,11 +102,14 @@ static void loader_cont(void)
 	else
 		CPU_regS += 2;	/* pop ESC code */
 
+	/* Copy segments until one sets INITAD: its init routine must run
+	   before the next segment is loaded. */
 	MEMORY_dPutByte(0x2e3, 0xd7);
 	do {
 		int temp;
 		UWORD from;
 		UWORD to;
+		int length;
 		do
 			temp = read_word();
 		while (temp == 0xffff);
@@ -90,31 +127,33 @@ static void loader_cont(void)
 			BINLOAD_start_binloading = FALSE;
 		}
 
-		to++;
-		do {
-			int byte = fgetc(BINLOAD_bin_file);
-			if (byte == EOF) {
-				fclose(BINLOAD_bin_file);
-				BINLOAD_bin_file = NULL;
-				CPU_regPC = MEMORY_dGetWordAligned(0x2e0);
-				if (MEMORY_dGetByte(0x2e3) != 0xd7) {
-					/* run INIT routine which RTSes directly to RUN routine */
-					CPU_regPC--;
-					MEMORY_dPutByte(0x0100 + CPU_regS--, CPU_regPC >> 8);		/* high */
-					MEMORY_dPutByte(0x0100 + CPU_regS--, CPU_regPC & 0xff);	/* low */
-					CPU_regPC = MEMORY_dGetWordAligned(0x2e2);
-				}
-				return;
+		/* a segment may wrap around from 0xffff to 0 */
+		length = (UWORD) (to - from) + 1;
+		if ((size_t) length > bin_size - bin_pos) {
+			/* truncated file: load what is there and run */
+			length = (int) (bin_size - bin_pos);
+			copy_segment(from, length);
+			close_bin_file();
+			CPU_regPC = MEMORY_dGetWordAligned(0x2e0);
+			if (MEMORY_dGetByte(0x2e3) != 0xd7) {
+				/* run INIT routine which RTSes directly to RUN routine */
+				CPU_regPC--;
+				MEMORY_dPutByte(0x0100 + CPU_regS, CPU_regPC >> 8);		/* high */
+				CPU_regS--;
+				MEMORY_dPutByte(0x0100 + CPU_regS, CPU_regPC & 0xff);	/* low */
+				CPU_regS--;
+				CPU_regPC = MEMORY_dGetWordAligned(0x2e2);
 			}
-			MEMORY_PutByte(from, (UBYTE) byte);
-			from++;
-		} while (from != to);
+			return;
+		}
+		copy_segment(from, length);
 	} while (MEMORY_dGetByte(0x2e3) == 0xd7);
 
 	CPU_regS--;
 	ESC_Add((UWORD) (0x100 + CPU_regS), ESC_BINLOADER_CONT, loader_cont);
 	CPU_regS--;
-	MEMORY_dPutByte(0x0100 + CPU_regS--, 0x01);	/* high */
+	MEMORY_dPutByte(0x0100 + CPU_regS, 0x01);	/* high */
+	CPU_regS--;
 	MEMORY_dPutByte(0x0100 + CPU_regS, CPU_regS + 1);	/* low */
 	CPU_regS--;
 	CPU_regPC = MEMORY_dGetWordAligned(0x2e2);
@@ -161,6 +200,12 @@ int BINLOAD_Loader(const char *filename)
 		SIO_DisableDrive(1);
 	if (fread(buf, 1, 2, BINLOAD_bin_file) == 2) {
 		if (buf[0] == 0xff && buf[1] == 0xff) {
+			free(bin_data);
+			bin_size = Util_flen(BINLOAD_bin_file);
+			bin_data = (UBYTE *) Util_malloc(bin_size);
+			Util_rewind(BINLOAD_bin_file);
+			bin_size = fread(bin_data, 1, bin_size, BINLOAD_bin_file);
+			bin_pos = 2;
 			BINLOAD_start_binloading = TRUE; /* force SIO to call BINLOAD_LoaderStart at boot */
 			Atari800_Coldstart();             /* reboot */
 			return TRUE;
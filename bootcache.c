@@ -0,0 +1,232 @@
+/*
+ * bootcache.c - cache of the machine state after booting
+ *
+ * Copyright (C) 2026 Atari800 development team (see DOC/CREDITS)
+ *
+ * This file is part of the Atari800 emulator project which emulates
+ * the Atari 400, 800, 800XL, 130XE, and 5200 8-bit computers.
+ *
+ * Atari800 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Atari800 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atari800; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "atari.h"
+#include "binload.h"
+#include "bootcache.h"
+#include "cartridge.h"
+#include "cassette.h"
+#include "devices.h"
+#include "esc.h"
+#include "gtia.h"
+#include "input.h"
+#include "log.h"
+#include "memory.h"
+#include "sio.h"
+#include "statesav.h"
+#include "util.h"
+#ifdef EVENT_RECORDING
+#include "movie.h"
+#endif
+
+char BOOTCACHE_dir[FILENAME_MAX] = "";
+int BOOTCACHE_frames = 300;
+
+/* the state file to be written at the end of the boot, if not empty */
+static char cache_filename[FILENAME_MAX] = "";
+static int frames_left;
+
+/* Two independent 32-bit hashes (FNV-1a and sdbm), so that the names of
+   different setups practically never collide. */
+static ULONG hash1;
+static ULONG hash2;
+
+static void hash_bytes(const UBYTE *data, size_t len)
+{
+	ULONG h1 = hash1;
+	ULONG h2 = hash2;
+	while (len-- > 0) {
+		h1 = ((h1 ^ *data) * 16777619) & 0xffffffff;
+		h2 = (*data + (h2 << 6) + (h2 << 16) - h2) & 0xffffffff;
+		data++;
+	}
+	hash1 = h1;
+	hash2 = h2;
+}
+
+static void hash_int(int value)
+{
+	UBYTE bytes[4];
+	bytes[0] = (UBYTE) value;
+	bytes[1] = (UBYTE) (value >> 8);
+	bytes[2] = (UBYTE) (value >> 16);
+	bytes[3] = (UBYTE) (value >> 24);
+	hash_bytes(bytes, 4);
+}
+
+/* Hashes the name and contents of a media file. */
+static int hash_file(const char *filename)
+{
+	UBYTE buffer[16384];
+	FILE *fp;
+	size_t len;
+
+	hash_bytes((const UBYTE *) filename, strlen(filename) + 1);
+	fp = fopen(filename, "rb");
+	if (fp == NULL)
+		return FALSE;
+	while ((len = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+		hash_bytes(buffer, len);
+	fclose(fp);
+	return TRUE;
+}
+
+/* Computes the hash of everything that affects the boot.
+   Returns FALSE if a media file can't be read. */
+static int hash_setup(const char *program)
+{
+	int i;
+
+	hash1 = 2166136261UL;
+	hash2 = 0;
+	hash_bytes((const UBYTE *) Atari800_TITLE, strlen(Atari800_TITLE));
+	hash_int(BOOTCACHE_frames);
+
+	hash_int(Atari800_machine_type);
+	hash_int(Atari800_tv_mode);
+	hash_int(Atari800_disable_basic);
+	hash_int(MEMORY_ram_size);
+	hash_int(MEMORY_axlon_enabled);
+	hash_int(MEMORY_axlon_bankmask);
+	hash_int(MEMORY_axlon_0f_mirror);
+	hash_int(MEMORY_mosaic_enabled);
+	hash_int(MEMORY_mosaic_maxbank);
+	hash_int(ESC_enable_sio_patch);
+	hash_int(Devices_enable_h_patch);
+	hash_int(Devices_enable_p_patch);
+	hash_int(Devices_enable_r_patch);
+	hash_bytes(MEMORY_os, sizeof(MEMORY_os));
+	hash_bytes(MEMORY_basic, sizeof(MEMORY_basic));
+
+	hash_int(CARTRIDGE_type);
+	if (CARTRIDGE_type != CARTRIDGE_NONE && !hash_file(CARTRIDGE_filename))
+		return FALSE;
+	for (i = 0; i < SIO_MAX_DRIVES; i++) {
+		hash_int(SIO_drive_status[i]);
+		if (SIO_drive_status[i] != SIO_OFF && SIO_drive_status[i] != SIO_NO_DISK
+		 && !hash_file(SIO_filename[i]))
+			return FALSE;
+	}
+	if (program != NULL && !hash_file(program))
+		return FALSE;
+	return TRUE;
+}
+
+int BOOTCACHE_Initialise(int *argc, char *argv[])
+{
+	int i;
+	int j;
+	for (i = j = 1; i < *argc; i++) {
+		int i_a = (i + 1 < *argc);		/* is argument available? */
+		int a_m = FALSE;			/* error, argument missing! */
+
+		if (strcmp(argv[i], "-bootcache") == 0) {
+			if (i_a)
+				Util_strlcpy(BOOTCACHE_dir, argv[++i], sizeof(BOOTCACHE_dir));
+			else a_m = TRUE;
+		}
+		else if (strcmp(argv[i], "-bootcache-frames") == 0) {
+			if (i_a) {
+				BOOTCACHE_frames = Util_sscandec(argv[++i]);
+				if (BOOTCACHE_frames < 1) {
+					Log_print("Invalid boot cache frame count, using 300");
+					BOOTCACHE_frames = 300;
+				}
+			}
+			else a_m = TRUE;
+		}
+		else {
+			if (strcmp(argv[i], "-help") == 0) {
+				Log_print("\t-bootcache <dir> Cache the state after booting in <dir>");
+				Log_print("\t-bootcache-frames <n>");
+				Log_print("\t                 Frames after the cold start to cache (default 300)");
+			}
+			argv[j++] = argv[i];
+		}
+
+		if (a_m) {
+			Log_print("Missing argument for '%s'", argv[i]);
+			return FALSE;
+		}
+	}
+	*argc = j;
+
+	return TRUE;
+}
+
+int BOOTCACHE_Start(const char *program)
+{
+	char name[32];
+
+	cache_filename[0] = '\0';
+	if (BOOTCACHE_dir[0] == '\0')
+		return FALSE;
+	/* the state file doesn't include the tape position nor an executable
+	   opened from the command line, and movies must start with a cold start */
+	if (strcmp(CASSETTE_filename, "None") != 0 || BINLOAD_bin_file != NULL)
+		return FALSE;
+#ifdef EVENT_RECORDING
+	if (MOVIE_IsRecording() || MOVIE_IsPlaying())
+		return FALSE;
+#endif
+	if (!hash_setup(program))
+		return FALSE;
+
+	sprintf(name, "%08lx%08lx.a8s", (unsigned long) hash1, (unsigned long) hash2);
+	Util_catpath(cache_filename, BOOTCACHE_dir, name);
+	if (Util_fileexists(cache_filename)) {
+		if (StateSav_ReadAtariState(cache_filename, "rb")) {
+			/* Don't press Option */
+			GTIA_consol_table[1] = GTIA_consol_table[2] = 0x0f;
+			cache_filename[0] = '\0';
+			return TRUE;
+		}
+		Log_print("Boot cache %s is invalid, booting", cache_filename);
+		/* the machine may be partly restored */
+		Atari800_Coldstart();
+	}
+	frames_left = BOOTCACHE_frames;
+	return FALSE;
+}
+
+void BOOTCACHE_Frame(void)
+{
+	if (cache_filename[0] == '\0')
+		return;
+	/* the user took over: the state would depend on the input */
+	if (!INPUT_Idle()) {
+		cache_filename[0] = '\0';
+		return;
+	}
+	if (--frames_left > 0)
+		return;
+	/* wait for the end of a disk or executable transfer */
+	if (SIO_last_op_time > 0 || BINLOAD_bin_file != NULL)
+		return;
+	StateSav_SaveAtariStateAsync(cache_filename, "wb", FALSE, NULL, NULL);
+	cache_filename[0] = '\0';
+}
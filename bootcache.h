@@ -0,0 +1,29 @@
+#ifndef BOOTCACHE_H_
+#define BOOTCACHE_H_
+
+#include "atari.h"
+
+/* Boot cache: the machine state reached a fixed number of frames after
+   the cold start is saved in a directory, under a name derived from
+   everything that affects the boot (ROMs, machine type, RAM size,
+   cartridge and disk contents). The next start with the same setup
+   restores it instead of booting again. */
+
+/* Directory of the cached states, or empty if the cache is disabled. */
+extern char BOOTCACHE_dir[FILENAME_MAX];
+
+/* Number of frames after the cold start at which the state is cached. */
+extern int BOOTCACHE_frames;
+
+int BOOTCACHE_Initialise(int *argc, char *argv[]);
+
+/* Called once the machine and media are set up at startup, before
+   the program given with -run (or NULL) is loaded. Restores the cached
+   state if there is one and returns TRUE; the program is then already
+   loaded. Otherwise prepares to save the state. */
+int BOOTCACHE_Start(const char *program);
+
+/* Called at the end of each frame. */
+void BOOTCACHE_Frame(void);
+
+#endif /* BOOTCACHE_H_ */
@@ -26,10 +26,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#define CART_MMAP
+#endif
 
 #include "atari.h"
 #include "binload.h" /* BINLOAD_loading_basic */
 #include "cartridge.h"
+#include "log.h"
 #include "memory.h"
 #include "pia.h"
 #include "rtime.h"
@@ -102,7 +107,17 @@ int CARTRIDGE_IsFor5200(int type)
 }
 
 static UBYTE *cart_image = NULL;		/* cartridge memory */
-static char cart_filename[FILENAME_MAX];
+#ifdef CART_MMAP
+/* Images of at least CART_MMAP_MIN bytes are mapped read-only from the file
+   instead of being read into memory, so that multi-megabyte cartridges
+   share their pages with the system's file cache. Small images are still
+   read, so that rewriting the file while it is in use can't crash the
+   emulator. If cart_mapping is not NULL, cart_image points into it. */
+#define CART_MMAP_MIN 0x40000
+static void *cart_mapping = NULL;
+static size_t cart_mapping_size = 0;
+#endif
+char CARTRIDGE_filename[FILENAME_MAX];
 int CARTRIDGE_type = CARTRIDGE_NONE;
 
 static int bank;
@@ -457,10 +472,321 @@ int CARTRIDGE_Checksum(const UBYTE *image, int nbytes)
 	return checksum;
 }
 
+/* Sets cart_image to len bytes of fp at offset. */
+static void load_image(FILE *fp, int offset, int len)
+{
+#ifdef CART_MMAP
+	/* a mapping must not extend beyond the end of the file */
+	if (len >= CART_MMAP_MIN && Util_flen(fp) >= offset + len) {
+		void *p = mmap(NULL, offset + len, PROT_READ, MAP_SHARED, fileno(fp), 0);
+		if (p != MAP_FAILED) {
+			cart_mapping = p;
+			cart_mapping_size = offset + len;
+			cart_image = (UBYTE *) p + offset;
+			return;
+		}
+	}
+#endif
+	cart_image = (UBYTE *) Util_malloc(len);
+	fseek(fp, offset, SEEK_SET);
+	fread(cart_image, 1, len, fp);
+}
+
+static void free_image(void)
+{
+#ifdef CART_MMAP
+	if (cart_mapping != NULL) {
+		munmap(cart_mapping, cart_mapping_size);
+		cart_mapping = NULL;
+		cart_image = NULL;
+		return;
+	}
+#endif
+	free(cart_image);
+	cart_image = NULL;
+}
+
+/* Type detection for raw images ----------------------------------------- */
+
+char CARTRIDGE_db_filename[FILENAME_MAX] = "";
+
+/* The database is an open-addressing hash table indexed by the low bits
+   of the CRC-32 of the image. A slot with type CARTRIDGE_NONE is free. */
+typedef struct {
+	ULONG crc;
+	int type;
+} db_entry;
+
+static db_entry *db_table = NULL;
+static ULONG db_mask = 0;	/* number of slots - 1 */
+static ULONG db_count = 0;
+
+static ULONG crc_table[256];
+
+static ULONG crc32(const UBYTE *data, int len)
+{
+	ULONG crc = 0xffffffff;
+	if (crc_table[1] == 0) {
+		int i;
+		for (i = 0; i < 256; i++) {
+			ULONG c = i;
+			int j;
+			for (j = 0; j < 8; j++)
+				c = (c & 1) ? (c >> 1) ^ 0xedb88320 : c >> 1;
+			crc_table[i] = c;
+		}
+	}
+	while (len-- > 0)
+		crc = crc_table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+	return crc ^ 0xffffffff;
+}
+
+static void db_insert(ULONG crc, int type)
+{
+	ULONG i;
+	if (db_count * 2 >= db_mask) {
+		/* keep the table at most half full, so that probes stay short */
+		db_entry *old_table = db_table;
+		ULONG old_size = db_table == NULL ? 0 : db_mask + 1;
+		db_mask = old_size == 0 ? 255 : old_size * 2 - 1;
+		db_table = (db_entry *) Util_malloc((db_mask + 1) * sizeof(db_entry));
+		for (i = 0; i <= db_mask; i++)
+			db_table[i].type = CARTRIDGE_NONE;
+		db_count = 0;
+		for (i = 0; i < old_size; i++)
+			if (old_table[i].type != CARTRIDGE_NONE)
+				db_insert(old_table[i].crc, old_table[i].type);
+		free(old_table);
+	}
+	for (i = crc & db_mask; db_table[i].type != CARTRIDGE_NONE; i = (i + 1) & db_mask)
+		if (db_table[i].crc == crc) {
+			/* later entries override earlier ones */
+			db_table[i].type = type;
+			return;
+		}
+	db_table[i].crc = crc;
+	db_table[i].type = type;
+	db_count++;
+}
+
+static int db_lookup(ULONG crc)
+{
+	ULONG i;
+	if (db_table == NULL)
+		return CARTRIDGE_NONE;
+	for (i = crc & db_mask; db_table[i].type != CARTRIDGE_NONE; i = (i + 1) & db_mask)
+		if (db_table[i].crc == crc)
+			return db_table[i].type;
+	return CARTRIDGE_NONE;
+}
+
+/* Reads the database file: each line has the CRC-32 of a raw image
+   in hexadecimal and the cartridge type in decimal. Empty lines
+   and lines starting with '#' are ignored. */
+static int load_db(const char *filename)
+{
+	FILE *fp;
+	char line[256];
+	int line_no = 0;
+	fp = fopen(filename, "r");
+	if (fp == NULL) {
+		Log_print("Cannot open cartridge database %s", filename);
+		return FALSE;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		unsigned int crc;
+		int type;
+		line_no++;
+		Util_chomp(line);
+		Util_trim(line);
+		if (line[0] == '\0' || line[0] == '#')
+			continue;
+		if (sscanf(line, "%x %d", &crc, &type) != 2
+		 || type < 1 || type > CARTRIDGE_LAST_SUPPORTED) {
+			Log_print("%s:%d: invalid cartridge database entry", filename, line_no);
+			continue;
+		}
+		db_insert(crc, type);
+	}
+	fclose(fp);
+	return TRUE;
+}
+
+/* Returns 1 for an absolute read of a 6502 instruction, 2 for an absolute
+   write, 0 for anything else. Only the instructions usual in bank switching
+   code are recognised, to keep the number of false hits in data low. */
+static int abs_access(UBYTE opcode)
+{
+	switch (opcode) {
+	case 0x2c: /* BIT abs */
+	case 0xac: /* LDY abs */
+	case 0xad: /* LDA abs */
+	case 0xae: /* LDX abs */
+		return 1;
+	case 0x8c: /* STY abs */
+	case 0x8d: /* STA abs */
+	case 0x8e: /* STX abs */
+	case 0x9d: /* STA abs,X */
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+/* Number of different addresses in D5lo-D5hi that the image accesses. */
+static int d5_addresses(const int hits[256], int lo, int hi)
+{
+	int n = 0;
+	for (; lo <= hi; lo++)
+		if (hits[lo] != 0)
+			n++;
+	return n;
+}
+
+/* TRUE if the 8 KB bank ending at end looks like the top of an Atari 800
+   cartridge: cartridge present flag and init vector in 8000-BFFF. */
+static int is_800_top(const UBYTE *end)
+{
+	return end[-4] == 0 && end[-1] >= 0x80 && end[-1] < 0xc0;
+}
+
+/* Guesses the type of a raw image of kb kilobytes when more than one type
+   has that size, from the 6502 instructions that access the bank switching
+   registers in D500-D5FF and from the vectors at the end of the image.
+   This is a heuristic. Returns CARTRIDGE_NONE, so that the user selects
+   the type, if nothing in the image points to one type: in particular
+   types that only differ in the values written (XEGS, Switchable XEGS,
+   MegaCart, Atrax) can't be told apart. */
+static int probe_type(const UBYTE *image, int kb)
+{
+	int len = kb << 10;
+	int hits[256];
+	int i;
+	const UBYTE *end = image + len;
+	int for5200 = Atari800_machine_type == Atari800_MACHINE_5200;
+
+	memset(hits, 0, sizeof(hits));
+	for (i = 0; i + 2 < len; i++)
+		if (image[i + 2] == 0xd5 && abs_access(image[i]) != 0)
+			hits[image[i + 1]]++;
+	/* R-Time 8 registers are not bank switching */
+	hits[0xb8] = hits[0xb9] = 0;
+
+	/* a 5200 cartridge has no D5xx registers and its start vector
+	   is at the end, in 4000-BFFF */
+	if (!for5200 && kb <= 40 && !is_800_top(end) && d5_addresses(hits, 0x00, 0xff) == 0)
+		for5200 = end[-1] >= 0x40 && end[-1] < 0xc0;
+	if (for5200) {
+		switch (kb) {
+		case 4:
+			return CARTRIDGE_5200_4;
+		case 8:
+			return CARTRIDGE_5200_8;
+		case 16:
+			/* the one-chip cartridge is only visible in 8000-BFFF */
+			return end[-1] < 0x80 ? CARTRIDGE_5200_EE_16 : CARTRIDGE_5200_NS_16;
+		case 32:
+			return CARTRIDGE_5200_32;
+		case 40:
+			return CARTRIDGE_5200_40;
+		default:
+			break;
+		}
+	}
+
+	switch (kb) {
+	case 8:
+		/* without bank switching (Phoenix) the init vector tells
+		   the left cartridge (A000-BFFF) from the right one (8000-9FFF) */
+		if (is_800_top(end) && d5_addresses(hits, 0x00, 0xff) == 0)
+			return end[-1] >= 0xa0 ? CARTRIDGE_STD_8 : CARTRIDGE_RIGHT_8;
+		break;
+	case 16:
+		/* OSS cartridges switch banks by accessing D500-D509;
+		   OSS2 has its fixed bank at the start of the image */
+		if (d5_addresses(hits, 0x00, 0x0f) >= 2)
+			return is_800_top(end) ? CARTRIDGE_OSS_16 : CARTRIDGE_OSS2_16;
+		/* MegaCart and Blizzard access D5xx */
+		if (is_800_top(end) && d5_addresses(hits, 0x00, 0xff) == 0)
+			return CARTRIDGE_STD_16;
+		break;
+	case 32:
+		/* XEGS selects the bank by the value written to D500, DB and
+		   Williams by the address; Williams starts in the first bank */
+		if (d5_addresses(hits, 0x00, 0x0f) >= 2)
+			return is_800_top(end) ? CARTRIDGE_DB_32 : CARTRIDGE_WILL_32;
+		break;
+	case 40:
+		/* the other type of this size is for the 5200 */
+		if (is_800_top(end))
+			return CARTRIDGE_BBSB_40;
+		break;
+	case 64:
+		{
+			int exp = d5_addresses(hits, 0x70, 0x7f);
+			int diamond = d5_addresses(hits, 0xd0, 0xdf);
+			int sdx = d5_addresses(hits, 0xe0, 0xef);
+			if (exp >= 2 || diamond >= 2 || sdx >= 2) {
+				if (exp > diamond && exp > sdx)
+					return CARTRIDGE_EXP_64;
+				return diamond > sdx ? CARTRIDGE_DIAMOND_64 : CARTRIDGE_SDX_64;
+			}
+			if (d5_addresses(hits, 0x00, 0x07) >= 2)
+				return CARTRIDGE_WILL_64;
+		}
+		break;
+	case 128:
+		if (d5_addresses(hits, 0xe0, 0xff) >= 2)
+			return CARTRIDGE_SDX_128;
+		if (d5_addresses(hits, 0x00, 0x1f) >= 3)
+			return CARTRIDGE_ATMAX_128;
+		break;
+	case 1024:
+		if (d5_addresses(hits, 0x00, 0x7f) >= 8)
+			return CARTRIDGE_ATMAX_1024;
+		break;
+	default:
+		break;
+	}
+	return CARTRIDGE_NONE;
+}
+
+int CARTRIDGE_Initialise(int *argc, char *argv[])
+{
+	int i;
+	int j;
+	for (i = j = 1; i < *argc; i++) {
+		int i_a = (i + 1 < *argc);		/* is argument available? */
+		int a_m = FALSE;			/* error, argument missing! */
+
+		if (strcmp(argv[i], "-cartdb") == 0) {
+			if (i_a)
+				Util_strlcpy(CARTRIDGE_db_filename, argv[++i], sizeof(CARTRIDGE_db_filename));
+			else a_m = TRUE;
+		}
+		else {
+			if (strcmp(argv[i], "-help") == 0)
+				Log_print("\t-cartdb <file>   Read types of raw cartridge images from <file>");
+			argv[j++] = argv[i];
+		}
+
+		if (a_m) {
+			Log_print("Missing argument for '%s'", argv[i]);
+			return FALSE;
+		}
+	}
+	*argc = j;
+
+	if (CARTRIDGE_db_filename[0] != '\0')
+		return load_db(CARTRIDGE_db_filename);
+	return TRUE;
+}
+
 int CARTRIDGE_Insert(const char *filename)
 {
 	FILE *fp;
 	int len;
+	int kb;
 	int type;
 	UBYTE header[16];
 
@@ -476,30 +802,42 @@ int CARTRIDGE_Insert(const char *filename)
 	Util_rewind(fp);
 
 	/* Save Filename for state save */
-	strcpy(cart_filename, filename);
+	strcpy(CARTRIDGE_filename, filename);
 
 	/* if full kilobytes, assume it is raw image */
 	if ((len & 0x3ff) == 0) {
 		/* alloc memory and read data */
-		cart_image = (UBYTE *) Util_malloc(len);
-		fread(cart_image, 1, len, fp);
+		load_image(fp, 0, len);
 		fclose(fp);
 		/* find cart type */
 		CARTRIDGE_type = CARTRIDGE_NONE;
-		len >>= 10;	/* number of kilobytes */
+		kb = len >> 10;	/* number of kilobytes */
 		for (type = 1; type <= CARTRIDGE_LAST_SUPPORTED; type++)
-			if (CARTRIDGE_kb[type] == len) {
+			if (CARTRIDGE_kb[type] == kb) {
 				if (CARTRIDGE_type == CARTRIDGE_NONE)
 					CARTRIDGE_type = type;
-				else
-					return len;	/* more than one cartridge type of such length - user must select */
+				else {
+					/* more than one cartridge type of such length:
+					   look the image up in the database, then guess */
+					ULONG crc = crc32(cart_image, len);
+					type = db_lookup(crc);
+					if (type != CARTRIDGE_NONE && CARTRIDGE_kb[type] == kb)
+						CARTRIDGE_type = type;
+					else {
+						CARTRIDGE_type = probe_type(cart_image, kb);
+						if (CARTRIDGE_type == CARTRIDGE_NONE)
+							return kb;	/* user must select */
+						Log_print("Guessed type %d for cartridge image with CRC-32 %08X",
+							CARTRIDGE_type, crc);
+					}
+					break;
+				}
 			}
 		if (CARTRIDGE_type != CARTRIDGE_NONE) {
 			CARTRIDGE_Start();
 			return 0;	/* ok */
 		}
-		free(cart_image);
-		cart_image = NULL;
+		free_image();
 		return CARTRIDGE_BAD_FORMAT;
 	}
 	/* if not full kilobytes, assume it is CART file */
@@ -516,8 +854,7 @@ int CARTRIDGE_Insert(const char *filename)
 			int checksum;
 			len = CARTRIDGE_kb[type] << 10;
 			/* alloc memory and read data */
-			cart_image = (UBYTE *) Util_malloc(len);
-			fread(cart_image, 1, len, fp);
+			load_image(fp, 16, len);
 			fclose(fp);
 			checksum = (header[8] << 24) |
 				(header[9] << 16) |
@@ -535,10 +872,8 @@ int CARTRIDGE_Insert(const char *filename)
 void CARTRIDGE_Remove(void)
 {
 	CARTRIDGE_type = CARTRIDGE_NONE;
-	if (cart_image != NULL) {
-		free(cart_image);
-		cart_image = NULL;
-	}
+	if (cart_image != NULL)
+		free_image();
 	CARTRIDGE_Start();
 }
 
@@ -770,13 +1105,25 @@ void CARTRIDGE_StateRead(void)
 	StateSav_ReadINT(&savedCartType, 1);
 	if (savedCartType != CARTRIDGE_NONE) {
 		char filename[FILENAME_MAX];
+		int savedBank = 0;
 		StateSav_ReadFNAME(filename);
-		if (filename[0]) {
+		if (StateSav_chunk_version >= 2)
+			StateSav_ReadINT(&savedBank, 1);
+		if (StateSav_in_memory && savedCartType == CARTRIDGE_type
+		 && strcmp(filename, CARTRIDGE_filename) == 0) {
+			/* the same cartridge is still inserted; the selected bank
+			   and whether it is switched on are restored with the memory
+			   by MEMORY_StateRead(), so don't restart it */
+			bank = savedBank;
+		}
+		else if (filename[0]) {
 			/* Insert the cartridge... */
 			if (CARTRIDGE_Insert(filename) >= 0) {
 				/* And set the type to the saved type, in case it was a raw cartridge image */
 				CARTRIDGE_type = savedCartType;
 				CARTRIDGE_Start();
+				if (StateSav_chunk_version >= 2)
+					bank = savedBank;
 			}
 		}
 	}
@@ -787,7 +1134,9 @@ void CARTRIDGE_StateSave(void)
 	/* Save the cartridge type, or CARTRIDGE_NONE if there isn't one...*/
 	StateSav_SaveINT(&CARTRIDGE_type, 1);
 	if (CARTRIDGE_type != CARTRIDGE_NONE) {
-		StateSav_SaveFNAME(cart_filename);
+		StateSav_SaveFNAME(CARTRIDGE_filename);
+		/* chunk version 2 */
+		StateSav_SaveINT(&bank, 1);
 	}
 }
 
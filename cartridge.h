@@ -53,6 +53,13 @@
 #define CARTRIDGE_MAX_SIZE	(1024 * 1024)
 extern int CARTRIDGE_kb[CARTRIDGE_LAST_SUPPORTED + 1];
 extern int CARTRIDGE_type;
+/* The file the cartridge was inserted from (if CARTRIDGE_type != CARTRIDGE_NONE). */
+extern char CARTRIDGE_filename[FILENAME_MAX];
+
+/* Database of the types of raw images, keyed by CRC-32 (empty if none). */
+extern char CARTRIDGE_db_filename[FILENAME_MAX];
+
+int CARTRIDGE_Initialise(int *argc, char *argv[]);
 
 int CARTRIDGE_IsFor5200(int type);
 int CARTRIDGE_Checksum(const UBYTE *image, int nbytes);
@@ -60,6 +67,9 @@ int CARTRIDGE_Checksum(const UBYTE *image, int nbytes);
 #define CARTRIDGE_CANT_OPEN		-1	/* Can't open cartridge image file */
 #define CARTRIDGE_BAD_FORMAT		-2	/* Unknown cartridge format */
 #define CARTRIDGE_BAD_CHECKSUM	-3	/* Warning: bad CART checksum */
+/* Returns 0 on success, a negative error code or, for a raw image
+   whose type is neither in the database nor can be guessed, its size
+   in kilobytes - the caller must then select the type. */
 int CARTRIDGE_Insert(const char *filename);
 
 void CARTRIDGE_Remove(void);
@@ -46,7 +46,7 @@ static SLONG cassette_elapsedtime;  /* elapsed time since begin of file */
 static SLONG cassette_savetime;	    /* helper for cas save */
 static SLONG cassette_nextirqevent; /* timestamp of next irq in scanlines */
 
-static char cassette_filename[FILENAME_MAX];
+char CASSETTE_filename[FILENAME_MAX];
 static char cassette_description[CASSETTE_DESCRIPTION_MAX];
 static int cassette_current_blockbyte = 0;
 static int cassette_current_block;
@@ -62,8 +62,26 @@ static int cassette_baudblock[MAX_BLOCKS];
 int CASSETTE_hold_start_on_reboot = 0;
 int CASSETTE_hold_start = 0;
 int CASSETTE_press_space = 0;
+int CASSETTE_fast = FALSE;
 static int eof_of_tape = 0;
 
+/* Fast loading (without the SIO patch): the mark tone before a record
+   is cut to FAST_GAP scanlines as soon as the program waits for data,
+   i.e. polls the I/O line or enables the serial input interrupt, and
+   bytes come every FAST_BYTE scanlines while the program only takes
+   them through the interrupt. Bytes of which the program samples the
+   bits keep their real timing, so that the OS can measure the speed
+   on the sync bytes and loaders that read the bits directly work. */
+#define FAST_GAP 10
+#define FAST_BYTE 20
+/* the line is polled if read at least this many times in a scanline;
+   the OS reads SKSTAT for the keyboard only once a frame */
+#define FAST_POLLS 3
+static int line_polls = 0;		/* I/O line reads in this scanline */
+static int byte_polled = FALSE;	/* the line was polled during this byte */
+static int fast_byte = FALSE;	/* this byte comes in FAST_BYTE scanlines */
+static SLONG saved_time = 0;	/* scanlines saved by fast loading */
+
 typedef struct {
 	char identifier[4];
 	UBYTE length_lo;
@@ -93,7 +111,7 @@ int CASSETTE_Initialise(int *argc, char *argv[])
 	int i;
 	int j;
 
-	strcpy(cassette_filename, "None");
+	strcpy(CASSETTE_filename, "None");
 	memset(cassette_description, 0, sizeof(cassette_description));
 
 	for (i = j = 1; i < *argc; i++) {
@@ -112,10 +130,13 @@ int CASSETTE_Initialise(int *argc, char *argv[])
 			}
 			else a_m = TRUE;
 		}
+		else if (strcmp(argv[i], "-fasttape") == 0)
+			CASSETTE_fast = TRUE;
 		else {
 			if (strcmp(argv[i], "-help") == 0) {
 				Log_print("\t-tape <file>     Insert cassette image");
 				Log_print("\t-boottape <file> Insert cassette image and boot it");
+				Log_print("\t-fasttape        Skip gaps and speed up data when loading from tape");
 			}
 			argv[j++] = argv[i];
 		}
@@ -281,7 +302,7 @@ int CASSETTE_CreateFile(const char *filename, FILE **fp, int *isCAS)
 int CASSETTE_Insert(const char *filename)
 {
 	CASSETTE_Remove();
-	strcpy(cassette_filename, filename);
+	strcpy(CASSETTE_filename, filename);
 	cassette_elapsedtime = 0;
 	cassette_savetime = 0;
 	cassette_nextirqevent = 0;
@@ -292,22 +313,34 @@ int CASSETTE_Insert(const char *filename)
 	eof_of_tape = 0;
 	cassette_savefile = FALSE;
 	cassette_baudrate = 600;
+	byte_polled = FALSE;
+	fast_byte = FALSE;
+	saved_time = 0;
 	return CASSETTE_CheckFile(filename, &cassette_file, cassette_description,
 		 &cassette_max_block, &cassette_isCAS);
 }
 
+static void LogSavedTime(void)
+{
+	if (saved_time > 0) {
+		Log_print("Fast tape loading saved %d seconds", (int) (saved_time / (312 * 50)));
+		saved_time = 0;
+	}
+}
+
 void CASSETTE_Remove(void)
 {
 	if (cassette_file != NULL) {
 		/* save last block, ignore trailing space tone */
 		if ((cassette_current_blockbyte > 0) && cassette_savefile)
 			CASSETTE_Write(cassette_current_blockbyte);
+		LogSavedTime();
 
 		fclose(cassette_file);
 		cassette_file = NULL;
 	}
 	cassette_max_block = 0;
-	strcpy(cassette_filename, "None");
+	strcpy(CASSETTE_filename, "None");
 	memset(cassette_description, 0, sizeof(cassette_description));
 }
 
@@ -436,11 +469,14 @@ int CASSETTE_Read(void)
 int CASSETTE_Write(int length)
 {
 	/* there must be a filename given for saving */
-	if (strcmp(cassette_filename, "None") == 0)
+	if (strcmp(CASSETTE_filename, "None") == 0)
+		return -1;
+	/* run-ahead couldn't take the record back */
+	if (Atari800_speculating)
 		return -1;
 	/* if file doesn't exist (or has no records), create the header */
 	if ((cassette_file == NULL || ftell(cassette_file) == 0) &&
-			(CASSETTE_CreateFile(cassette_filename,
+			(CASSETTE_CreateFile(CASSETTE_filename,
 			&cassette_file,&cassette_isCAS) == FALSE))
 		return -1;
 	/* on a raw file, saving is denied because it can hold
@@ -478,6 +514,7 @@ static int ReadRecord_POKEY(void)
 			cassette_nextirqevent = -1;
 			length = -1;
 			eof_of_tape = 1;
+			LogSavedTime();
 			return length;
 		}
 		else {
@@ -508,6 +545,7 @@ static int ReadRecord_POKEY(void)
 			memset(CASSETTE_buffer + 3, 0, 128);
 			if (cassette_current_block > cassette_max_block) {
 				eof_of_tape = 1;
+				LogSavedTime();
 			}
 		}
 		else {
@@ -553,11 +591,19 @@ static int SetNextByteTime_POKEY(int adjust)
 	cassette_current_blockbyte += 1;
 	/* if there are still bytes in the buffer, take next byte */
 	if (cassette_current_blockbyte < cassette_max_blockbytes) {
-		cassette_nextirqevent = cassette_elapsedtime + adjust
-			+ MSToScanLines(10 * 1000 / (cassette_isCAS?cassette_baudblock[
+		SLONG interval = MSToScanLines(10 * 1000 / (cassette_isCAS?cassette_baudblock[
 			cassette_current_block-1]:600));
+		fast_byte = CASSETTE_fast && !byte_polled && interval > FAST_BYTE;
+		if (fast_byte) {
+			saved_time += interval - FAST_BYTE;
+			interval = FAST_BYTE;
+		}
+		byte_polled = FALSE;
+		cassette_nextirqevent = cassette_elapsedtime + adjust + interval;
 		return 0;
 	}
+	fast_byte = FALSE;
+	byte_polled = FALSE;
 
 	/* if buffer is exhausted, load next record */
 	length = ReadRecord_POKEY();
@@ -591,6 +637,7 @@ int CASSETTE_IOLineStatus(void)
 		|| (eof_of_tape != 0)) {
 		return 1;
 	}
+	line_polls++;
 
 	/* exam rate; if elapsed time > nextirq - duration of one byte */
 	if (cassette_elapsedtime >
@@ -642,7 +689,7 @@ int CASSETTE_GetInputIRQDelay(void)
 		/* return time span */
 		timespan = cassette_nextirqevent - cassette_elapsedtime;
 	}
-	if (timespan < 40) {
+	if (timespan < 40 && !fast_byte) {
 		timespan += ((312 * 50 - 1) / (cassette_isCAS?cassette_baudblock[
 			cassette_current_block-1]:600)) * 10;
 	}
@@ -730,6 +777,35 @@ void CASSETTE_TapeMotor(int onoff)
 	}
 }
 
+int CASSETTE_IsRunning(void)
+{
+	return cassette_motor && cassette_file != NULL
+		&& (eof_of_tape == 0 || cassette_savefile);
+}
+
+/* Cuts the mark tone before the next record if the program waits for it. */
+static void SkipGap(void)
+{
+	int polled = line_polls >= FAST_POLLS;
+	line_polls = 0;
+	if (polled)
+		byte_polled = TRUE;
+	/* no byte of the record delivered yet */
+	if (cassette_current_blockbyte == 0 && cassette_nextirqevent >= 0
+	 && (polled || (POKEY_IRQEN & 0x20))) {
+		SLONG wait = FAST_GAP + MSToScanLines(10 * 1000 / (cassette_isCAS
+			? cassette_baudblock[cassette_current_block - 1] : 600));
+		if (cassette_nextirqevent - cassette_elapsedtime > wait) {
+			saved_time += cassette_nextirqevent - cassette_elapsedtime - wait;
+			cassette_nextirqevent = cassette_elapsedtime + wait;
+			/* if the serial input interrupt is already scheduled, move it
+			   (POKEY counts it down later in this scanline) */
+			if (POKEY_DELAYED_SERIN_IRQ > 0)
+				POKEY_DELAYED_SERIN_IRQ = wait + 1;
+		}
+	}
+}
+
 void CASSETTE_AddScanLine(void)
 {
 	int tmp;
@@ -739,6 +815,9 @@ void CASSETTE_AddScanLine(void)
 		&& ((eof_of_tape == 0) || cassette_savefile)) {
 		cassette_elapsedtime++;
 
+		if (CASSETTE_fast && !cassette_savefile)
+			SkipGap();
+
 		/* only for loading: set next byte interrupt time */
 		/* valid cassette times are up to 870 baud, giving
 		   a time span of 18 scanlines, so comparing with
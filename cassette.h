@@ -14,9 +14,14 @@ int CASSETTE_CreateFile(const char *filename, FILE **fp, int *isCAS);
 int CASSETTE_Insert(const char *filename);
 void CASSETTE_Remove(void);
 
+/* The inserted tape image, or "None". */
+extern char CASSETTE_filename[FILENAME_MAX];
 extern int CASSETTE_hold_start;
 extern int CASSETTE_hold_start_on_reboot; /* preserve hold_start after reboot */
 extern int CASSETTE_press_space;
+/* TRUE to load without waiting for gaps and at more than the tape speed
+   when the SIO patch is off. */
+extern int CASSETTE_fast;
 
 int CASSETTE_AddGap(int gaptime);
 void CASSETTE_LeaderLoad(void);
@@ -29,6 +34,8 @@ int CASSETTE_GetInputIRQDelay(void);
 int CASSETTE_IsSaveFile(void);
 void CASSETTE_PutByte(int byte);
 void CASSETTE_TapeMotor(int onoff);
+/* Returns TRUE while the motor is on and the tape is read or recorded. */
+int CASSETTE_IsRunning(void);
 void CASSETTE_AddScanLine(void);
 extern UBYTE CASSETTE_buffer[4096];
 
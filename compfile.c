@@ -69,6 +69,41 @@ int CompFile_ExtractGZ(const char *infilename, FILE *outfp)
 #endif	/* HAVE_LIBZ */
 }
 
+UBYTE *CompFile_ExtractGZToMemory(const char *infilename, ULONG *size)
+{
+#ifndef HAVE_LIBZ
+	Log_print("This executable cannot decompress ZLIB files");
+	return NULL;
+#else
+	gzFile gzf = gzopen(infilename, "rb");
+	UBYTE *buf;
+	ULONG alloc = UNCOMPRESS_BUFFER_SIZE;
+	int result;
+	if (gzf == NULL) {
+		Log_print("ZLIB could not open file %s", infilename);
+		return NULL;
+	}
+	buf = (UBYTE *) Util_malloc(alloc);
+	*size = 0;
+	for (;;) {
+		if (alloc - *size < UNCOMPRESS_BUFFER_SIZE) {
+			alloc *= 2;
+			buf = (UBYTE *) Util_realloc(buf, alloc);
+		}
+		result = gzread(gzf, buf + *size, UNCOMPRESS_BUFFER_SIZE);
+		if (result <= 0)
+			break;
+		*size += result;
+	}
+	gzclose(gzf);
+	if (result < 0) {
+		free(buf);
+		return NULL;
+	}
+	return buf;
+#endif	/* HAVE_LIBZ */
+}
+
 
 /* DCM decompression ----------------------------------------------------- */
 
@@ -97,12 +132,33 @@ static int fsave(void *buf, int size, FILE *fp)
 
 typedef struct {
 	FILE *fp;
+	/* if fp is NULL, the ATR is written to buf */
+	UBYTE *buf;
+	ULONG pos;
+	ULONG size;
+	ULONG alloc;
 	int sectorcount;
 	int sectorsize;
 	int current_sector;
 } ATR_Info;
 
-static int write_atr_header(const ATR_Info *pai)
+static int atr_save(ATR_Info *pai, void *data, int size)
+{
+	if (pai->fp != NULL)
+		return fsave(data, size, pai->fp);
+	if (pai->pos + size > pai->alloc) {
+		while (pai->pos + size > pai->alloc)
+			pai->alloc *= 2;
+		pai->buf = (UBYTE *) Util_realloc(pai->buf, pai->alloc);
+	}
+	memcpy(pai->buf + pai->pos, data, size);
+	pai->pos += size;
+	if (pai->pos > pai->size)
+		pai->size = pai->pos;
+	return TRUE;
+}
+
+static int write_atr_header(ATR_Info *pai)
 {
 	int sectorcount;
 	int sectorsize;
@@ -122,12 +178,12 @@ static int write_atr_header(const ATR_Info *pai)
 	header.seccounthi = (UBYTE) (paras >> 8);
 	header.hiseccountlo = (UBYTE) (paras >> 16);
 	header.hiseccounthi = (UBYTE) (paras >> 24);
-	return fsave(&header, sizeof(header), pai->fp);
+	return atr_save(pai, &header, sizeof(header));
 }
 
 static int write_atr_sector(ATR_Info *pai, UBYTE *buf)
 {
-	return fsave(buf, pai->current_sector++ <= 3 ? 128 : pai->sectorsize, pai->fp);
+	return atr_save(pai, buf, pai->current_sector++ <= 3 ? 128 : pai->sectorsize);
 }
 
 static int pad_till_sector(ATR_Info *pai, int till_sector)
@@ -233,11 +289,10 @@ static int dcm_pass(FILE *infp, ATR_Info *pai)
 	}
 }
 
-int CompFile_DCMtoATR(FILE *infp, FILE *outfp)
+static int dcm_to_atr(FILE *infp, ATR_Info *pai)
 {
 	int archive_type;
 	int archive_flags;
-	ATR_Info ai;
 	int pass_flags;
 	int last_sector;
 	archive_type = fgetc(infp);
@@ -252,32 +307,31 @@ int CompFile_DCMtoATR(FILE *infp, FILE *outfp)
 			Log_print("It seems that DCMs of a multi-file archive have been combined in wrong order");
 		return FALSE;
 	}
-	ai.fp = outfp;
-	ai.current_sector = 1;
+	pai->current_sector = 1;
 	switch ((archive_flags >> 5) & 3) {
 	case 0:
-		ai.sectorcount = 720;
-		ai.sectorsize = 128;
+		pai->sectorcount = 720;
+		pai->sectorsize = 128;
 		break;
 	case 1:
-		ai.sectorcount = 720;
-		ai.sectorsize = 256;
+		pai->sectorcount = 720;
+		pai->sectorsize = 256;
 		break;
 	case 2:
-		ai.sectorcount = 1040;
-		ai.sectorsize = 128;
+		pai->sectorcount = 1040;
+		pai->sectorsize = 128;
 		break;
 	default:
 		Log_print("Unrecognized density");
 		return FALSE;
 	}
-	if (!write_atr_header(&ai))
+	if (!write_atr_header(pai))
 		return FALSE;
 	pass_flags = archive_flags;
 	for (;;) {
 		/* pass */
 		int block_type;
-		if (!dcm_pass(infp, &ai))
+		if (!dcm_pass(infp, pai))
 			return FALSE;
 		if (pass_flags & 0x80)
 			break;
@@ -301,11 +355,38 @@ int CompFile_DCMtoATR(FILE *infp, FILE *outfp)
 		}
 		/* TODO: check pass number, this is tricky for >31 */
 	}
-	last_sector = ai.current_sector - 1;
-	if (last_sector <= ai.sectorcount)
-		return pad_till_sector(&ai, ai.sectorcount + 1);
+	last_sector = pai->current_sector - 1;
+	if (last_sector <= pai->sectorcount)
+		return pad_till_sector(pai, pai->sectorcount + 1);
 	/* more sectors written: update ATR header */
-	ai.sectorcount = last_sector;
-	Util_rewind(outfp);
-	return write_atr_header(&ai);
+	pai->sectorcount = last_sector;
+	if (pai->fp != NULL)
+		Util_rewind(pai->fp);
+	else
+		pai->pos = 0;
+	return write_atr_header(pai);
+}
+
+int CompFile_DCMtoATR(FILE *infp, FILE *outfp)
+{
+	ATR_Info ai;
+	ai.fp = outfp;
+	return dcm_to_atr(infp, &ai);
+}
+
+UBYTE *CompFile_DCMtoATRMemory(FILE *infp, ULONG *size)
+{
+	ATR_Info ai;
+	ai.fp = NULL;
+	ai.pos = 0;
+	ai.size = 0;
+	/* enough for a single density disk */
+	ai.alloc = 16 + 720 * 128;
+	ai.buf = (UBYTE *) Util_malloc(ai.alloc);
+	if (!dcm_to_atr(infp, &ai)) {
+		free(ai.buf);
+		return NULL;
+	}
+	*size = ai.size;
+	return ai.buf;
 }
@@ -3,7 +3,14 @@
 
 #include <stdio.h>  /* FILE */
 
+#include "atari.h"  /* UBYTE, ULONG */
+
 int CompFile_ExtractGZ(const char *infilename, FILE *outfp);
 int CompFile_DCMtoATR(FILE *infp, FILE *outfp);
 
+/* Same as above, but decompress to a buffer allocated with Util_malloc().
+   Return NULL on error. */
+UBYTE *CompFile_ExtractGZToMemory(const char *infilename, ULONG *size);
+UBYTE *CompFile_DCMtoATRMemory(FILE *infp, ULONG *size);
+
 #endif /* COMPFILE_H_ */
@@ -123,7 +123,7 @@ void CPU_PutStatus(void)
 
 /* 6502 stack handling */
 #define PL                  MEMORY_dGetByte(0x0100 + ++S)
-#define PH(x)               MEMORY_dPutByte(0x0100 + S--, x)
+#define PH(x)               (MEMORY_dirty[1] = 1, MEMORY_mem[0x0100 + S--] = (x))
 #define PHW(x)              PH((x) >> 8); PH((x) & 0xff)
 
 /* 6502 code fetching */
@@ -2361,7 +2361,7 @@ void CPU_Reset(void)
 
 #if !defined(BASIC) && !defined(ASAP)
 
-void CPU_StateSave(UBYTE SaveVerbose)
+void CPU_StateSave(void)
 {
 	StateSav_SaveUBYTE(&CPU_regA, 1);
 
@@ -2373,8 +2373,6 @@ void CPU_StateSave(UBYTE SaveVerbose)
 	StateSav_SaveUBYTE(&CPU_regY, 1);
 	StateSav_SaveUBYTE(&CPU_IRQ, 1);
 
-	MEMORY_StateSave(SaveVerbose);
-
 	StateSav_SaveUWORD(&CPU_regPC, 1);
 }
 
@@ -2390,7 +2388,9 @@ void CPU_StateRead(UBYTE SaveVerbose, UBYTE StateVersion)
 	StateSav_ReadUBYTE(&CPU_regY, 1);
 	StateSav_ReadUBYTE(&CPU_IRQ, 1);
 
-	MEMORY_StateRead(SaveVerbose, StateVersion);
+	/* memory has its own chunk since version 7 */
+	if (StateVersion < 7)
+		MEMORY_StateRead(SaveVerbose, StateVersion);
 
 	StateSav_ReadUWORD(&CPU_regPC, 1);
 }
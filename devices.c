@@ -106,6 +106,8 @@
 
 #ifdef WIN32
 
+#define Devices_DirChanged()
+
 static char dir_path[FILENAME_MAX];
 static WIN32_FIND_DATA wfd;
 static HANDLE dh = INVALID_HANDLE_VALUE;
@@ -229,49 +231,129 @@ static int match(const char *pattern, const char *filename)
 
 static char dir_path[FILENAME_MAX];
 static char filename_pattern[FILENAME_MAX];
-static DIR *dp = NULL;
 
-static int Devices_OpenDir(const char *filename)
+/* The names in the last read directory are kept in memory, together with
+   the names that match the last pattern, so that listing, renaming and
+   deleting files in a large directory don't read it again and again.
+   The names are reused while the modification time of the directory
+   stays the same. Because the time has a resolution of one or two
+   seconds, a directory modified shortly before it was read is read again
+   next time. H: operations that change the directory drop the cache. */
+static char cache_dir_path[FILENAME_MAX];
+static char cache_pattern[FILENAME_MAX];
+static int cache_valid = FALSE;
+#if defined(HAVE_STAT) && defined(HAVE_TIME)
+static time_t cache_mtime;
+#endif
+/* names separated by '\0' */
+static char *cache_names = NULL;
+static size_t cache_names_size = 0;
+static size_t cache_names_alloc = 0;
+/* offsets of the names in cache_names */
+static size_t *cache_entries = NULL;
+static int cache_count = 0;
+static int cache_entries_alloc = 0;
+/* indexes of the names matching cache_pattern */
+static int *cache_matches = NULL;
+static int cache_match_count = 0;
+static int cache_read_pos = 0;
+
+static void Devices_DirChanged(void)
 {
-	Util_splitpath(filename, dir_path, filename_pattern);
-	if (dp != NULL)
-		closedir(dp);
-	dp = opendir(dir_path);
-	return dp != NULL;
+	cache_valid = FALSE;
 }
 
-static int Devices_ReadDir(char *fullpath, char *filename, int *isdir,
-                          int *readonly, int *size, char *timetext)
+static int Devices_ScanDir(void)
 {
+	DIR *dp;
 	struct dirent *entry;
-	char temppath[FILENAME_MAX];
-#ifdef HAVE_STAT
+	dp = opendir(dir_path);
+	if (dp == NULL)
+		return FALSE;
+	cache_names_size = 0;
+	cache_count = 0;
+	while ((entry = readdir(dp)) != NULL) {
+		size_t len;
+		/* never match "." nor ".." */
+		if (entry->d_name[0] == '.'
+		 && (entry->d_name[1] == '\0' || (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))
+			continue;
+		len = strlen(entry->d_name) + 1;
+		if (cache_names_size + len > cache_names_alloc) {
+			cache_names_alloc = (cache_names_size + len) * 2;
+			cache_names = (char *) Util_realloc(cache_names, cache_names_alloc);
+		}
+		if (cache_count >= cache_entries_alloc) {
+			cache_entries_alloc = cache_count * 2 + 64;
+			cache_entries = (size_t *) Util_realloc(cache_entries, cache_entries_alloc * sizeof(size_t));
+		}
+		memcpy(cache_names + cache_names_size, entry->d_name, len);
+		cache_entries[cache_count++] = cache_names_size;
+		cache_names_size += len;
+	}
+	closedir(dp);
+	cache_matches = (int *) Util_realloc(cache_matches, (cache_count > 0 ? cache_count : 1) * sizeof(int));
+	return TRUE;
+}
+
+static int Devices_OpenDir(const char *filename)
+{
+	int rescan;
+#if defined(HAVE_STAT) && defined(HAVE_TIME)
 	struct stat status;
 #endif
-	for (;;) {
-		entry = readdir(dp);
-		if (entry == NULL) {
-			closedir(dp);
-			dp = NULL;
+	Util_splitpath(filename, dir_path, filename_pattern);
+	rescan = !cache_valid || strcmp(dir_path, cache_dir_path) != 0;
+#if defined(HAVE_STAT) && defined(HAVE_TIME)
+	if (stat(dir_path, &status) != 0) {
+		cache_valid = FALSE;
+		return FALSE;
+	}
+	if (status.st_mtime != cache_mtime)
+		rescan = TRUE;
+#endif
+	if (rescan) {
+		cache_valid = FALSE;
+		if (!Devices_ScanDir())
 			return FALSE;
-		}
-		if (entry->d_name[0] == '.') {
+		strcpy(cache_dir_path, dir_path);
+		cache_pattern[0] = '\0';
+#if defined(HAVE_STAT) && defined(HAVE_TIME)
+		cache_mtime = status.st_mtime;
+		cache_valid = status.st_mtime < time(NULL) - 2;
+#endif
+	}
+	if (rescan || strcmp(filename_pattern, cache_pattern) != 0) {
+		int i;
+		cache_match_count = 0;
+		for (i = 0; i < cache_count; i++) {
+			const char *name = cache_names + cache_entries[i];
 			/* don't match Unix hidden files unless specifically requested */
-			if (filename_pattern[0] != '.')
-				continue;
-			/* never match "." */
-			if (entry->d_name[1] == '\0')
-				continue;
-			/* never match ".." */
-			if (entry->d_name[1] == '.' && entry->d_name[2] == '\0')
+			if (name[0] == '.' && filename_pattern[0] != '.')
 				continue;
+			if (match(filename_pattern, name))
+				cache_matches[cache_match_count++] = i;
 		}
-		if (match(filename_pattern, entry->d_name))
-			break;
+		strcpy(cache_pattern, filename_pattern);
 	}
+	cache_read_pos = 0;
+	return TRUE;
+}
+
+static int Devices_ReadDir(char *fullpath, char *filename, int *isdir,
+                          int *readonly, int *size, char *timetext)
+{
+	const char *name;
+	char temppath[FILENAME_MAX];
+#ifdef HAVE_STAT
+	struct stat status;
+#endif
+	if (cache_read_pos >= cache_match_count)
+		return FALSE;
+	name = cache_names + cache_entries[cache_matches[cache_read_pos++]];
 	if (filename != NULL)
-		strcpy(filename, entry->d_name);
-	Util_catpath(temppath, dir_path, entry->d_name);
+		strcpy(filename, name);
+	Util_catpath(temppath, dir_path, name);
 	if (fullpath != NULL)
 		strcpy(fullpath, temppath);
 #ifdef HAVE_STAT
@@ -322,6 +404,8 @@ static int Devices_ReadDir(char *fullpath, char *filename, int *isdir,
 
 #elif defined(PS2)
 
+#define Devices_DirChanged()
+
 extern char dir_path[FILENAME_MAX];
 
 int Atari_OpenDir(const char *filename);
@@ -350,6 +434,10 @@ static int Devices_ReadDir(char *fullpath, char *filename, int *isdir,
 
 #endif /* defined(PS2) */
 
+#ifndef DO_DIR
+#define Devices_DirChanged()
+#endif
+
 
 /* Rename File/Directory abstraction layer ------------------------------- */
 
@@ -748,6 +836,17 @@ static int Devices_GetIOCB(void)
 	return TRUE;
 }
 
+/* Host files opened or changed during run-ahead would stay so after
+   the snapshot is restored, so the operation fails then. */
+static int Devices_Speculating(void)
+{
+	if (!Atari800_speculating)
+		return FALSE;
+	CPU_regY = 138; /* device timeout */
+	CPU_SetN;
+	return TRUE;
+}
+
 static int Devices_GetNumber(int set_textmode)
 {
 	int devnum;
@@ -798,6 +897,9 @@ static void Devices_H_Open(void)
 	if (devbug)
 		Log_print("HHOPEN");
 
+	if (Devices_Speculating())
+		return;
+
 	if (Devices_GetHostPath(TRUE) == 0)
 		return;
 
@@ -937,6 +1039,8 @@ static void Devices_H_Open(void)
 				fp = Util_fopen(host_path, mode, h_tmpbuf[h_iocb]);
 			}
 		}
+		/* the file may have been created */
+		Devices_DirChanged();
 		if (fp != NULL) {
 			CPU_regY = 1;
 			CPU_ClrN;
@@ -968,6 +1072,78 @@ static void Devices_H_Close(void)
 	CPU_ClrN;
 }
 
+/* CIO calls the handler once per byte of GET/PUT CHARACTERS, with the
+   buffer pointer and the remaining length in ZIOCB. For these commands
+   H: transfers the block at once, except for the last byte, and advances
+   ZIOCB past it, so CIO then makes only one more call for the last byte.
+   Returns the number of bytes that may be transferred this way. */
+static int Devices_H_BlockLength(UBYTE command)
+{
+	UWORD bufadr;
+	int length;
+	if (MEMORY_dGetByte(Devices_ICCOMZ) != command
+	 || MEMORY_dGetByte(Devices_ICIDNO) != CPU_regX)
+		return 0; /* not called by CIO */
+	bufadr = MEMORY_dGetWordAligned(Devices_ICBALZ);
+	length = MEMORY_dGetWordAligned(Devices_ICBLLZ) - 1;
+	if (length > 0x10000 - bufadr)
+		length = 0x10000 - bufadr;
+	return length;
+}
+
+static void Devices_H_AdvanceBlock(int length)
+{
+	MEMORY_dPutWordAligned(Devices_ICBALZ, MEMORY_dGetWordAligned(Devices_ICBALZ) + length);
+	MEMORY_dPutWordAligned(Devices_ICBLLZ, MEMORY_dGetWordAligned(Devices_ICBLLZ) - length);
+}
+
+static UBYTE h_block[0x10000];
+
+/* Reads up to length bytes to h_block, converting EOLs in text mode
+   exactly like Devices_H_Read() does. Returns the number of bytes stored. */
+static int Devices_H_ReadBlock(int length)
+{
+	FILE *fp = h_fp[h_iocb];
+	int n = (int) fread(h_block, 1, length, fp);
+	int i;
+	int o = 0;
+	if (!h_textmode[h_iocb])
+		return n;
+	for (i = 0; i < n; i++) {
+		UBYTE ch = h_block[i];
+		switch (ch) {
+		case 0x0d:
+			h_wascr[h_iocb] = TRUE;
+			ch = 0x9b;
+			break;
+		case 0x0a:
+			if (h_wascr[h_iocb]) {
+				/* ignore LF next to CR */
+				if (i + 1 >= n) {
+					/* leave it for the byte-by-byte code */
+					ungetc(0x0a, fp);
+					return o;
+				}
+				ch = h_block[++i];
+				if (ch == 0x0d) {
+					h_wascr[h_iocb] = TRUE;
+					ch = 0x9b;
+				}
+				else
+					h_wascr[h_iocb] = FALSE;
+			}
+			else
+				ch = 0x9b;
+			break;
+		default:
+			h_wascr[h_iocb] = FALSE;
+			break;
+		}
+		h_block[o++] = ch;
+	}
+	return o;
+}
+
 static void Devices_H_Read(void)
 {
 	if (devbug)
@@ -976,9 +1152,16 @@ static void Devices_H_Read(void)
 		return;
 	if (h_fp[h_iocb] != NULL) {
 		int ch;
+		int length;
 		if (h_lastop[h_iocb] == 'w')
 			fseek(h_fp[h_iocb], 0, SEEK_CUR);
 		h_lastop[h_iocb] = 'r';
+		length = Devices_H_BlockLength(0x07); /* GET CHARACTERS */
+		if (length > 0) {
+			length = Devices_H_ReadBlock(length);
+			MEMORY_CopyToMem(h_block, (UWORD) MEMORY_dGetWordAligned(Devices_ICBALZ), length);
+			Devices_H_AdvanceBlock(length);
+		}
 		ch = fgetc(h_fp[h_iocb]);
 		if (ch != EOF) {
 			if (h_textmode[h_iocb]) {
@@ -1036,9 +1219,30 @@ static void Devices_H_Write(void)
 		return;
 	if (h_fp[h_iocb] != NULL) {
 		int ch;
+		int length;
 		if (h_lastop[h_iocb] == 'r')
 			fseek(h_fp[h_iocb], 0, SEEK_CUR);
 		h_lastop[h_iocb] = 'w';
+		/* A holds the first byte of the block */
+		length = Devices_H_BlockLength(0x0b); /* PUT CHARACTERS */
+		if (length > 1) {
+			UWORD bufadr = MEMORY_dGetWordAligned(Devices_ICBALZ);
+			if (MEMORY_GetByte(bufadr) == CPU_regA) {
+				int i;
+				MEMORY_CopyFromMem(bufadr, h_block, length);
+				if (h_textmode[h_iocb]) {
+					for (i = 0; i < length; i++)
+						if (h_block[i] == 0x9b)
+							h_block[i] = '\n';
+				}
+				fwrite(h_block, 1, length, h_fp[h_iocb]);
+				/* CIO advances past the first byte */
+				Devices_H_AdvanceBlock(length - 1);
+				CPU_regY = 1;
+				CPU_ClrN;
+				return;
+			}
+		}
 		ch = CPU_regA;
 		if (ch == 0x9b && h_textmode[h_iocb])
 			ch = '\n';
@@ -1170,6 +1374,7 @@ static void Devices_H_Rename(void)
 				num_failed++;
 		}
 	}
+	Devices_DirChanged();
 
 	if (devbug)
 		Log_print("%d renamed, %d failed, %d locked",
@@ -1228,6 +1433,7 @@ static void Devices_H_Delete(void)
 			else
 				num_failed++;
 	}
+	Devices_DirChanged();
 
 	if (devbug)
 		Log_print("%d deleted, %d failed, %d locked",
@@ -1433,8 +1639,10 @@ static void Devices_H_BinLoaderCont(void)
 				if (initBinFile && (MEMORY_dGetByte(0x2e3) != 0xd7)) {
 					/* run INIT routine which RTSes directly to RUN routine */
 					CPU_regPC--;
-					MEMORY_dPutByte(0x0100 + CPU_regS--, CPU_regPC >> 8);	/* high */
-					MEMORY_dPutByte(0x0100 + CPU_regS--, CPU_regPC & 0xff);	/* low */
+					MEMORY_dPutByte(0x0100 + CPU_regS, CPU_regPC >> 8);	/* high */
+					CPU_regS--;
+					MEMORY_dPutByte(0x0100 + CPU_regS, CPU_regPC & 0xff);	/* low */
+					CPU_regS--;
 					CPU_regPC = MEMORY_dGetWordAligned(0x2e2);
 				}
 				return;
@@ -1447,7 +1655,8 @@ static void Devices_H_BinLoaderCont(void)
 	CPU_regS--;
 	ESC_Add((UWORD) (0x100 + CPU_regS), ESC_BINLOADER_CONT, Devices_H_BinLoaderCont);
 	CPU_regS--;
-	MEMORY_dPutByte(0x0100 + CPU_regS--, 0x01);	/* high */
+	MEMORY_dPutByte(0x0100 + CPU_regS, 0x01);	/* high */
+	CPU_regS--;
 	MEMORY_dPutByte(0x0100 + CPU_regS, CPU_regS + 1);	/* low */
 	CPU_regS--;
 	CPU_regPC = MEMORY_dGetWordAligned(0x2e2);
@@ -1604,6 +1813,7 @@ static void Devices_H_MakeDirectory(void)
 	if (Devices_GetHostPath(FALSE) == 0)
 		return;
 
+	Devices_DirChanged();
 	if (Devices_MakeDirectory(host_path)) {
 		CPU_regY = 1;
 		CPU_ClrN;
@@ -1625,6 +1835,7 @@ static void Devices_H_RemoveDirectory(void)
 	if (Devices_GetHostPath(FALSE) == 0)
 		return;
 
+	Devices_DirChanged();
 	CPU_regY = Devices_RemoveDirectory(host_path);
 	if (CPU_regY >= 128)
 		CPU_SetN;
@@ -1732,6 +1943,9 @@ static void Devices_H_Special(void)
 	if (devbug)
 		Log_print("HHSPEC");
 
+	if (Devices_Speculating())
+		return;
+
 	switch (MEMORY_dGetByte(Devices_ICCOMZ)) {
 #ifdef DO_RENAME
 	case 0x20:
@@ -1860,6 +2074,9 @@ static void Devices_P_Open(void)
 	if (devbug)
 		Log_print("PHOPEN");
 
+	if (Devices_Speculating())
+		return;
+
 	if (phf != NULL)
 		Devices_P_Close();
 
@@ -1914,6 +2131,21 @@ static void Devices_P_Init(void)
 
 #endif /* HAVE_SYSTEM */
 
+int Devices_HostFilesOpen(void)
+{
+	if (Devices_H_CountOpen() > 0 || binf != NULL)
+		return TRUE;
+#ifdef HAVE_SYSTEM
+	if (phf != NULL)
+		return TRUE;
+#endif
+#ifdef R_IO_DEVICE
+	if (RDevice_IsOpen())
+		return TRUE;
+#endif
+	return FALSE;
+}
+
 
 /* K: and E: handlers for BASIC version, using getchar() and putchar() --- */
 
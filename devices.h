@@ -25,6 +25,11 @@ extern char Devices_h_current_dir[4][FILENAME_MAX];
 int Devices_H_CountOpen(void);
 void Devices_H_CloseAll(void);
 
+/* Returns TRUE if H:, P: or R: has a host file or connection open.
+   Its position is not part of the machine state, so frames emulated
+   meanwhile can't be undone by restoring a snapshot. */
+int Devices_HostFilesOpen(void);
+
 extern char Devices_print_command[256];
 
 int Devices_SetPrintCommand(const char *command);
@@ -41,6 +46,7 @@ int Devices_SetPrintCommand(const char *command);
 #define	Devices_ICBLHZ	0x0029
 #define	Devices_ICAX1Z	0x002a
 #define	Devices_ICAX2Z	0x002b
+#define	Devices_ICIDNO	0x002e
 
 #define Devices_IOCB0   0x0340
 #define	Devices_ICHID	0x0000
@@ -545,6 +545,8 @@ void GTIA_PutByte(UWORD addr, UBYTE byte)
 
 #ifdef NEW_CYCLE_EXACT
 	int x; /* the cycle-exact update position in GTIA_pm_scanline */
+	if (ANTIC_midline_check && (addr & 0x1f) < GTIA_OFFSET_VDELAY)
+		ANTIC_CheckMidlineWrite();
 	if (ANTIC_DRAWING_SCREEN) {
 		if ((addr & 0x1f) != GTIA_PRIOR) {
 			ANTIC_UpdateScanline();
@@ -45,7 +45,7 @@
 #include "input_win.h"
 #endif
 #ifdef EVENT_RECORDING
-#include <zlib.h>
+#include "movie.h"
 #endif
 
 #ifdef DREAMCAST
@@ -123,18 +123,8 @@ static int cx85_port = 1;
 static int max_scanline_counter;
 static int scanline_counter;
 
-#ifdef EVENT_RECORDING
-static gzFile recordfp = NULL; /*output file for input recording*/
-static gzFile playbackfp = NULL; /*input file for playback*/
-static int recording = FALSE;
-static int playingback = FALSE;
-static void update_adler32_of_screen(void);
-static unsigned int compute_adler32_of_screen(void);
-static int recording_version;
-#define GZBUFSIZE 256
-static char gzbuf[GZBUFSIZE+1];
-#define EVENT_RECORDING_VERSION 1
-#endif
+/* a joystick or mouse was used in the last frame */
+static int controllers_used = FALSE;
 
 int INPUT_Initialise(int *argc, char *argv[])
 {
@@ -197,41 +187,15 @@ int INPUT_Initialise(int *argc, char *argv[])
 #ifdef EVENT_RECORDING
 		else if (strcmp(argv[i], "-record") == 0) {
 			if (i_a) {
-				char *recfilename = argv[++i];
-				if ((recordfp = gzopen(recfilename, "wb")) == NULL) {
-					Log_print("Cannot open record file");
+				if (!MOVIE_StartRecording(argv[++i]))
 					return FALSE;
-				}
-				else {
-					recording = TRUE;
-					gzprintf(recordfp, "Atari800 event recording, version: %d\n", EVENT_RECORDING_VERSION);
-				}
 			}
 			else a_m = TRUE;
 		}
 		else if (strcmp(argv[i], "-playback") == 0) {
 			if (i_a) {
-				char *pbfilename = argv[++i];
-				if ((playbackfp = gzopen(pbfilename, "rb")) == NULL) {
-					Log_print("Cannot open playback file");
+				if (!MOVIE_StartPlayback(argv[++i]))
 					return FALSE;
-				}
-				else {
-					playingback = TRUE;
-					gzgets(playbackfp, gzbuf, GZBUFSIZE);
-					if (sscanf(gzbuf, "Atari800 event recording, version: %d\n", &recording_version) != 1) {
-						Log_print("Invalid playback file");
-						playingback = FALSE;
-						gzclose(playbackfp);
-						return FALSE;
-					}
-					else if (recording_version > EVENT_RECORDING_VERSION) {
-						Log_print("Newer version of playback file than this version of Atari800 can handle");
-						playingback = FALSE;
-						gzclose(playbackfp);
-						return FALSE;
-					}
-				}
 			}
 			else a_m = TRUE;
 		}
@@ -297,10 +261,7 @@ int INPUT_Initialise(int *argc, char *argv[])
 /* For event recording */
 void INPUT_Exit(void) {
 #ifdef EVENT_RECORDING
-	if (recording) {
-		gzclose(recordfp);
-		recording = FALSE;
-	}
+	MOVIE_Stop();
 #endif
 }
 
@@ -407,9 +368,51 @@ static UBYTE mouse_step(void)
 	return r;
 }
 
+#ifdef EVENT_RECORDING
+static void playback_frame(int *port, int *trig)
+{
+	MOVIE_tFrame frame;
+	int i;
+	if (!MOVIE_ReadFrame(&frame)) {
+		int errors = MOVIE_screen_errors;
+		/* parsed by util/movietest.pl */
+		Log_print("Movie finished: %d frames, %d screen errors, first error at frame %d",
+			MOVIE_frame, errors, MOVIE_first_error_frame);
+		MOVIE_Stop();
+		Atari800_Exit(FALSE);
+		exit(errors > 0 ? 1 : 0); /* return code indicates errors*/
+	}
+	INPUT_key_code = frame.key_code;
+	INPUT_key_shift = frame.key_shift;
+	INPUT_key_consol = frame.key_consol;
+	port[0] = frame.port[0];
+	port[1] = frame.port[1];
+	for (i = 0; i < 4; i++)
+		trig[i] = (frame.trig >> i) & 1;
+}
+
+static void record_frame(const int *port, const int *trig)
+{
+	MOVIE_tFrame frame;
+	int i;
+	frame.key_code = INPUT_key_code;
+	frame.key_shift = INPUT_key_shift;
+	frame.key_consol = INPUT_key_consol;
+	frame.port[0] = (UBYTE) port[0];
+	frame.port[1] = (UBYTE) port[1];
+	frame.trig = 0;
+	for (i = 0; i < 4; i++)
+		if (trig[i])
+			frame.trig |= 1 << i;
+	MOVIE_WriteFrame(&frame);
+}
+#endif /* EVENT_RECORDING */
+
 void INPUT_Frame(void)
 {
 	int i;
+	int port[2];
+	int trig[4];
 	static int last_key_code = AKEY_NONE;
 	static int last_key_break = 0;
 	static UBYTE last_stick[4] = {INPUT_STICK_CENTRE, INPUT_STICK_CENTRE, INPUT_STICK_CENTRE, INPUT_STICK_CENTRE};
@@ -431,14 +434,23 @@ void INPUT_Frame(void)
 	   INPUT_key_code is used for keypad keys and INPUT_key_shift is used for 2nd button.
 	*/
 #ifdef EVENT_RECORDING
-	if (playingback) {
-		gzgets(playbackfp, gzbuf, GZBUFSIZE);
-		sscanf(gzbuf, "%d %d %d ", &INPUT_key_code, &INPUT_key_shift, &INPUT_key_consol);
-	}
-	if (recording) {
-		gzprintf(recordfp, "%d %d %d \n", INPUT_key_code, INPUT_key_shift, INPUT_key_consol);
+	if (MOVIE_IsPlaying())
+		playback_frame(port, trig);
+	else
+#endif
+	{
+		port[0] = PLATFORM_PORT(0);
+		port[1] = PLATFORM_PORT(1);
+		for (i = 0; i < 4; i++)
+			trig[i] = PLATFORM_TRIG(i);
 	}
+#ifdef EVENT_RECORDING
+	if (MOVIE_IsRecording())
+		record_frame(port, trig);
 #endif
+	controllers_used = port[0] != 0xff || port[1] != 0xff
+		|| !trig[0] || !trig[1] || !trig[2] || !trig[3]
+		|| (INPUT_mouse_mode != INPUT_MOUSE_OFF && INPUT_mouse_buttons != 0);
 	i = Atari800_machine_type == Atari800_MACHINE_5200 ? INPUT_key_shift : (INPUT_key_code == AKEY_BREAK);
 	if (i && !last_key_break) {
 		if (POKEY_IRQEN & 0x80) {
@@ -514,37 +526,10 @@ void INPUT_Frame(void)
 	}
 
 	/* handle joysticks */
-#ifdef EVENT_RECORDING
-	if (playingback) {
-		gzgets(playbackfp, gzbuf, GZBUFSIZE);
-		sscanf(gzbuf,"%d ",&i);
-	} else {
-#endif
-		i = PLATFORM_PORT(0);
-#ifdef EVENT_RECORDING
-	}
-	if (recording) {
-		gzprintf(recordfp,"%d \n",i);
-	}
-#endif
-
-	STICK[0] = i & 0x0f;
-	STICK[1] = (i >> 4) & 0x0f;
-#ifdef EVENT_RECORDING
-	if (playingback) {
-		gzgets(playbackfp, gzbuf, GZBUFSIZE);
-		sscanf(gzbuf,"%d ",&i);
-	} else {
-#endif
-		i = PLATFORM_PORT(1);
-#ifdef EVENT_RECORDING
-	}
-	if (recording) {
-		gzprintf(recordfp,"%d \n",i);
-	}
-#endif
-	STICK[2] = i & 0x0f;
-	STICK[3] = (i >> 4) & 0x0f;
+	STICK[0] = port[0] & 0x0f;
+	STICK[1] = (port[0] >> 4) & 0x0f;
+	STICK[2] = port[1] & 0x0f;
+	STICK[3] = (port[1] >> 4) & 0x0f;
 
 	for (i = 0; i < 4; i++) {
 		if (INPUT_joy_block_opposite_directions) {
@@ -572,22 +557,7 @@ void INPUT_Frame(void)
 		else
 			last_stick[i] = STICK[i];
 		/* Joystick Triggers */
-#ifdef EVENT_RECORDING
-		if(playingback){
-			int trigtemp;
-			gzgets(playbackfp, gzbuf, GZBUFSIZE);
-			sscanf(gzbuf,"%d ",&trigtemp);
-			TRIG_input[i] = trigtemp;
-
-		} else {
-#endif
-			TRIG_input[i] = PLATFORM_TRIG(i);
-#ifdef EVENT_RECORDING
-		}
-		if(recording){
-			gzprintf(recordfp,"%d \n",TRIG_input[i]);
-		}
-#endif
+		TRIG_input[i] = trig[i];
 		if ((INPUT_joy_autofire[i] == INPUT_AUTOFIRE_FIRE && !TRIG_input[i]) || (INPUT_joy_autofire[i] == INPUT_AUTOFIRE_CONT))
 			TRIG_input[i] = (Atari800_nframes & 2) ? 1 : 0;
 	}
@@ -845,64 +815,18 @@ void INPUT_Frame(void)
 		PIA_PORT_input[0] = (STICK[1] << 4) | STICK[0];
 		PIA_PORT_input[1] = (STICK[3] << 4) | STICK[2];
 	}
-
-#ifdef EVENT_RECORDING
-	update_adler32_of_screen();
-#endif
 }
 
-#ifdef EVENT_RECORDING
-static void update_adler32_of_screen(void)
+int INPUT_Idle(void)
 {
-	unsigned int adler32val = 0;
-	static unsigned int adler32_errors = 0;
-	static int first = TRUE;
-	if (first) { /* don't calculate the first frame */
-		first = FALSE;
-		adler32val = 0;
-	}
-	else if (recording || playingback){
-		adler32val = compute_adler32_of_screen();
-	}
-
-	if (recording) {
-		gzprintf(recordfp, "%08X \n", adler32val);
-	}
-	if (playingback) {
-		unsigned int pb_adler32val;
-		gzgets(playbackfp, gzbuf, GZBUFSIZE);
-		sscanf(gzbuf, "%08X ", &pb_adler32val);
-		if (pb_adler32val != adler32val){
-			Log_print("adler32 does not match");
-			adler32_errors++;
-		}
-		
-	}
-	if (playingback && gzeof(playbackfp)) {
-		playingback = FALSE;
-		gzclose(playbackfp);
-		Atari800_Exit(FALSE);
-		exit(adler32_errors > 0 ? 1 : 0); /* return code indicates errors*/
-	}
-}
-/* Compute the adler32 value of the visible screen */
-/* Note that the visible portion is 24..360 on the horizontal and */
-/* 0..Screen_HEIGHT on the vertical */
-static unsigned int compute_adler32_of_screen(void)
-{
-	int y;
-	unsigned int adler = adler32(0L,Z_NULL,0);
-	for (y = 0; y < Screen_HEIGHT; y++) {
-		adler = adler32(adler, (unsigned char*)Screen_atari + 24 + Screen_WIDTH*y, 360 - 24);
-	}
-	return adler;
+	return INPUT_key_code == AKEY_NONE && !INPUT_key_shift
+		&& INPUT_key_consol == INPUT_CONSOL_NONE && !controllers_used;
 }
-#endif /* EVENT_RECORDING */
 
 int INPUT_Recording(void)
 {
 #ifdef EVENT_RECORDING
-	return recording;
+	return MOVIE_IsRecording();
 #else
 	return 0;
 #endif
@@ -911,7 +835,7 @@ int INPUT_Recording(void)
 int INPUT_Playingback(void)
 {
 #ifdef EVENT_RECORDING
-	return playingback;
+	return MOVIE_IsPlaying();
 #else
 	return 0;
 #endif
@@ -920,19 +844,14 @@ int INPUT_Playingback(void)
 void INPUT_RecordInt(int i)
 {
 #ifdef EVENT_RECORDING
-	if (recording) gzprintf(recordfp, "%d\n", i);
+	MOVIE_WriteInt(i);
 #endif
 }
 
 int INPUT_PlaybackInt(void)
 {
 #ifdef EVENT_RECORDING
-	int i;
-	if (playingback) {
-		gzgets(playbackfp, gzbuf, GZBUFSIZE);
-		sscanf(gzbuf, "%d", &i);
-	}
-	return i;
+	return MOVIE_ReadInt();
 #else
 	return 0;
 #endif
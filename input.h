@@ -87,6 +87,9 @@ void INPUT_CenterMousePointer(void);
 void INPUT_DrawMousePointer(void);
 int INPUT_Recording(void);
 int INPUT_Playingback(void);
+/* TRUE if nothing was pressed in the last INPUT_Frame(): no key, console
+   key, joystick direction, trigger or mouse button. */
+int INPUT_Idle(void);
 void INPUT_RecordInt(int i);
 int INPUT_PlaybackInt(void);
 
@@ -44,6 +44,7 @@
 #endif
 
 UBYTE MEMORY_mem[65536 + 2];
+UBYTE MEMORY_dirty[256 + 1];
 
 int MEMORY_ram_size = 64;
 
@@ -84,6 +85,18 @@ static UBYTE under_atari_basic[8192];
 static UBYTE *atarixe_memory = NULL;
 static ULONG atarixe_memory_size = 0;
 
+/* dirty page maps of the buffers above, like MEMORY_dirty */
+static UBYTE under_atarixl_os_dirty[16384 >> 8];
+static UBYTE under_atari_basic_dirty[8192 >> 8];
+
+static int cart809F_enabled = FALSE;
+int MEMORY_cartA0BF_enabled = FALSE;
+static UBYTE under_cart809F[8192];
+static UBYTE under_cartA0BF[8192];
+static UBYTE under_cart809F_dirty[8192 >> 8];
+static UBYTE under_cartA0BF_dirty[8192 >> 8];
+static UBYTE *atarixe_dirty = NULL;
+
 int MEMORY_have_basic = FALSE; /* Atari BASIC image has been successfully read (Atari 800 only) */
 
 /* Axlon and Mosaic RAM expansions for Atari 400/800 only */
@@ -93,12 +106,14 @@ static void AxlonPutByte(UWORD addr, UBYTE byte);
 static UBYTE AxlonGetByte(UWORD addr);
 static UBYTE *axlon_ram = NULL;
 static int axlon_ram_size = 0;
+static UBYTE *axlon_dirty = NULL;
 int axlon_curbank = 0;
 int MEMORY_axlon_bankmask = 0x07;
 int MEMORY_axlon_enabled = FALSE;
 int MEMORY_axlon_0f_mirror = FALSE; /* The real Axlon had a mirror bank register at 0x0fc0-0x0fff, compatibles did not*/
 static UBYTE *mosaic_ram = NULL;
 static int mosaic_ram_size = 0;
+static UBYTE *mosaic_dirty = NULL;
 static int mosaic_curbank = 0x3f;
 int MEMORY_mosaic_maxbank = 0;
 int MEMORY_mosaic_enabled = FALSE;
@@ -110,12 +125,18 @@ static void alloc_axlon_memory(void){
 		if ((axlon_ram == NULL) || (axlon_ram_size != new_axlon_ram_size)) {
 			axlon_ram_size = new_axlon_ram_size;
 			if (axlon_ram != NULL) free(axlon_ram);
+			if (axlon_dirty != NULL) free(axlon_dirty);
 			axlon_ram = (UBYTE *)Util_malloc(axlon_ram_size);
+			axlon_dirty = (UBYTE *)Util_malloc(axlon_ram_size >> 8);
 		}
 		memset(axlon_ram, 0, axlon_ram_size);
+		memset(axlon_dirty, 1, axlon_ram_size >> 8);
 	} else {
 		if (axlon_ram != NULL) {
 			free(axlon_ram);
+			free(axlon_dirty);
+			axlon_ram = NULL;
+			axlon_dirty = NULL;
 			axlon_ram_size = 0;
 		}
 	}
@@ -128,18 +149,62 @@ static void alloc_mosaic_memory(void){
 		if ((mosaic_ram == NULL) || (mosaic_ram_size != new_mosaic_ram_size)) {
 			mosaic_ram_size = new_mosaic_ram_size;
 			if (mosaic_ram != NULL) free(mosaic_ram);
+			if (mosaic_dirty != NULL) free(mosaic_dirty);
 			mosaic_ram = (UBYTE *)Util_malloc(mosaic_ram_size);
+			mosaic_dirty = (UBYTE *)Util_malloc(mosaic_ram_size >> 8);
 		}
 		memset(mosaic_ram, 0, mosaic_ram_size);
+		memset(mosaic_dirty, 1, mosaic_ram_size >> 8);
 	} else {
 		if (mosaic_ram != NULL) {
 			free(mosaic_ram);
+			free(mosaic_dirty);
+			mosaic_ram = NULL;
+			mosaic_dirty = NULL;
 			mosaic_ram_size = 0;
 		}
 	}
 
 }
 
+static void set_dirty(UBYTE *map, int offset, int size)
+{
+	memset(map + (offset >> 8), 1, ((offset + size - 1) >> 8) - (offset >> 8) + 1);
+}
+
+void MEMORY_SetDirtyRange(int addr, int size)
+{
+	set_dirty(MEMORY_dirty, addr, size);
+}
+
+#ifdef PAGED_ATTRIB
+/* MEMORY_writemap at the last snapshot: attributes have no write macro */
+static MEMORY_wrfunc snapshot_writemap[256];
+#endif
+
+static void set_all_dirty(int value)
+{
+	memset(MEMORY_dirty, value, sizeof(MEMORY_dirty));
+	memset(under_atarixl_os_dirty, value, sizeof(under_atarixl_os_dirty));
+	memset(under_atari_basic_dirty, value, sizeof(under_atari_basic_dirty));
+	memset(under_cart809F_dirty, value, sizeof(under_cart809F_dirty));
+	memset(under_cartA0BF_dirty, value, sizeof(under_cartA0BF_dirty));
+	if (atarixe_dirty != NULL)
+		memset(atarixe_dirty, value, atarixe_memory_size >> 8);
+	if (axlon_dirty != NULL)
+		memset(axlon_dirty, value, axlon_ram_size >> 8);
+	if (mosaic_dirty != NULL)
+		memset(mosaic_dirty, value, mosaic_ram_size >> 8);
+}
+
+void MEMORY_ClearDirty(void)
+{
+	set_all_dirty(0);
+#ifdef PAGED_ATTRIB
+	memcpy(snapshot_writemap, MEMORY_writemap, sizeof(snapshot_writemap));
+#endif
+}
+
 static void AllocXEMemory(void)
 {
 	if (MEMORY_ram_size > 64) {
@@ -147,17 +212,23 @@ static void AllocXEMemory(void)
 		/* count number of 16 KB banks, add 1 for saving base memory 0x4000-0x7fff */
 		ULONG size = (1 + (MEMORY_ram_size - 64) / 16) * 16384;
 		if (size != atarixe_memory_size) {
-			if (atarixe_memory != NULL)
+			if (atarixe_memory != NULL) {
 				free(atarixe_memory);
+				free(atarixe_dirty);
+			}
 			atarixe_memory = (UBYTE *) Util_malloc(size);
+			atarixe_dirty = (UBYTE *) Util_malloc(size >> 8);
 			atarixe_memory_size = size;
 			memset(atarixe_memory, 0, size);
+			memset(atarixe_dirty, 1, size >> 8);
 		}
 	}
 	/* atarixe_memory not needed, free it */
 	else if (atarixe_memory != NULL) {
 		free(atarixe_memory);
+		free(atarixe_dirty);
 		atarixe_memory = NULL;
+		atarixe_dirty = NULL;
 		atarixe_memory_size = 0;
 	}
 }
@@ -168,7 +239,7 @@ void MEMORY_InitialiseMachine(void)
 	switch (Atari800_machine_type) {
 	case Atari800_MACHINE_OSA:
 	case Atari800_MACHINE_OSB:
-		memcpy(MEMORY_mem + 0xd800, MEMORY_os, 0x2800);
+		MEMORY_dCopyToMem(MEMORY_os, 0xd800, 0x2800);
 		ESC_PatchOS();
 		MEMORY_dFillMem(0x0000, 0x00, MEMORY_ram_size * 1024 - 1);
 		MEMORY_SetRAM(0x0000, MEMORY_ram_size * 1024 - 1);
@@ -210,7 +281,7 @@ void MEMORY_InitialiseMachine(void)
 #endif
 		break;
 	case Atari800_MACHINE_XLXE:
-		memcpy(MEMORY_mem + 0xc000, MEMORY_os, 0x4000);
+		MEMORY_dCopyToMem(MEMORY_os, 0xc000, 0x4000);
 		ESC_PatchOS();
 		if (MEMORY_ram_size == 16) {
 			MEMORY_dFillMem(0x0000, 0x00, 0x4000);
@@ -245,7 +316,7 @@ void MEMORY_InitialiseMachine(void)
 		MEMORY_SetROM(0xd800, 0xffff);
 		break;
 	case Atari800_MACHINE_5200:
-		memcpy(MEMORY_mem + 0xf800, MEMORY_os, 0x800);
+		MEMORY_dCopyToMem(MEMORY_os, 0xf800, 0x800);
 		MEMORY_dFillMem(0x0000, 0x00, 0xf800);
 		MEMORY_SetRAM(0x0000, 0x3fff);
 		MEMORY_SetROM(0x4000, 0xffff);
@@ -311,13 +382,165 @@ void MEMORY_InitialiseMachine(void)
 	AllocXEMemory();
 	alloc_axlon_memory();
 	alloc_mosaic_memory();
+	set_all_dirty(1);
 	Atari800_Coldstart();
 }
 
 #ifndef BASIC
 
+/* Set while reading an incremental snapshot. */
+static int read_incremental = FALSE;
+
+/* Saves npages 256-byte pages. An incremental snapshot stores only the pages
+   marked in the dirty map, after the map itself, in groups of 256 pages. */
+static void save_pages(const UBYTE *buffer, const UBYTE *dirty, int npages)
+{
+	int i;
+	int j;
+	if (!StateSav_incremental) {
+		StateSav_SaveUBYTE(buffer, npages << 8);
+		return;
+	}
+	for (i = 0; i < npages; i += 256) {
+		int n = npages - i < 256 ? npages - i : 256;
+		StateSav_SaveUBYTE(dirty + i, n);
+		for (j = i; j < i + n; j++)
+			if (dirty[j])
+				StateSav_SaveUBYTE(buffer + (j << 8), 256);
+	}
+}
+
+static void read_pages(UBYTE *buffer, int npages)
+{
+	UBYTE map[256];
+	int i;
+	int j;
+	if (!read_incremental) {
+		StateSav_ReadUBYTE(buffer, npages << 8);
+		return;
+	}
+	for (i = 0; i < npages; i += 256) {
+		int n = npages - i < 256 ? npages - i : 256;
+		StateSav_ReadUBYTE(map, n);
+		for (j = 0; j < n; j++)
+			if (map[j])
+				StateSav_ReadUBYTE(buffer + ((i + j) << 8), 256);
+	}
+}
+
+#ifdef PAGED_ATTRIB
+
+static void get_attrib_page(int i, UBYTE *attrib_page)
+{
+	if (MEMORY_writemap[i] == NULL)
+		memset(attrib_page, MEMORY_RAM, 256);
+	else if (MEMORY_writemap[i] == MEMORY_ROM_PutByte)
+		memset(attrib_page, MEMORY_ROM, 256);
+	else if (i == 0x4f || i == 0x5f || i == 0x8f || i == 0x9f) {
+		/* special case: Bounty Bob bank switching registers */
+		memset(attrib_page, MEMORY_ROM, 256);
+		attrib_page[0xf6] = MEMORY_HARDWARE;
+		attrib_page[0xf7] = MEMORY_HARDWARE;
+		attrib_page[0xf8] = MEMORY_HARDWARE;
+		attrib_page[0xf9] = MEMORY_HARDWARE;
+	}
+	else {
+		memset(attrib_page, MEMORY_HARDWARE, 256);
+	}
+}
+
+static void set_attrib_page(int i, const UBYTE *attrib_page)
+{
+	/* note: 0x40 is intentional here:
+	   we want ROM on page 0xd1 if H: patches are enabled */
+	switch (attrib_page[0x40]) {
+	case MEMORY_RAM:
+		MEMORY_readmap[i] = NULL;
+		MEMORY_writemap[i] = NULL;
+		break;
+	case MEMORY_ROM:
+		if (i != 0xd1 && attrib_page[0xf6] == MEMORY_HARDWARE) {
+			if (i == 0x4f || i == 0x8f) {
+				MEMORY_readmap[i] = CARTRIDGE_BountyBob1GetByte;
+				MEMORY_writemap[i] = CARTRIDGE_BountyBob1PutByte;
+			}
+			else if (i == 0x5f || i == 0x9f) {
+				MEMORY_readmap[i] = CARTRIDGE_BountyBob2GetByte;
+				MEMORY_writemap[i] = CARTRIDGE_BountyBob2PutByte;
+			}
+			/* else something's wrong, so we keep current values */
+		}
+		else {
+			MEMORY_readmap[i] = NULL;
+			MEMORY_writemap[i] = MEMORY_ROM_PutByte;
+		}
+		break;
+	case MEMORY_HARDWARE:
+		switch (i) {
+		case 0xc0:
+		case 0xd0:
+			MEMORY_readmap[i] = GTIA_GetByte;
+			MEMORY_writemap[i] = GTIA_PutByte;
+			break;
+		case 0xd1:
+			MEMORY_readmap[i] = PBI_D1GetByte;
+			MEMORY_writemap[i] = PBI_D1PutByte;
+			break;
+		case 0xd2:
+		case 0xe8:
+		case 0xeb:
+			MEMORY_readmap[i] = POKEY_GetByte;
+			MEMORY_writemap[i] = POKEY_PutByte;
+			break;
+		case 0xd3:
+			MEMORY_readmap[i] = PIA_GetByte;
+			MEMORY_writemap[i] = PIA_PutByte;
+			break;
+		case 0xd4:
+			MEMORY_readmap[i] = ANTIC_GetByte;
+			MEMORY_writemap[i] = ANTIC_PutByte;
+			break;
+		case 0xd5:
+			MEMORY_readmap[i] = CARTRIDGE_GetByte;
+			MEMORY_writemap[i] = CARTRIDGE_PutByte;
+			break;
+		case 0xd6:
+			MEMORY_readmap[i] = PBI_D6GetByte;
+			MEMORY_writemap[i] = PBI_D6PutByte;
+			break;
+		case 0xd7:
+			MEMORY_readmap[i] = PBI_D7GetByte;
+			MEMORY_writemap[i] = PBI_D7PutByte;
+			break;
+		case 0xff:
+			if (MEMORY_mosaic_enabled) MEMORY_writemap[0xff] = MosaicPutByte;
+			break;
+		case 0xcf:
+			if (MEMORY_axlon_enabled) MEMORY_writemap[0xcf] = AxlonPutByte;
+			break;
+		case 0x0f:
+			if (MEMORY_axlon_enabled && MEMORY_axlon_0f_mirror) MEMORY_writemap[0x0f] = AxlonPutByte;
+			break;
+		default:
+			/* something's wrong, so we keep current values */
+			break;
+		}
+		break;
+	default:
+		/* something's wrong, so we keep current values */
+		break;
+	}
+}
+
+#endif /* PAGED_ATTRIB */
+
 void MEMORY_StateSave(UBYTE SaveVerbose)
 {
+	if (StateSav_in_memory) {
+		UBYTE incremental = (UBYTE) StateSav_incremental;
+		StateSav_SaveUBYTE(&incremental, 1);
+	}
+
 	/* Axlon/Mosaic for 400/800 */
 	if (Atari800_machine_type == Atari800_MACHINE_OSA  || Atari800_machine_type == Atari800_MACHINE_OSB) {
 		StateSav_SaveINT(&MEMORY_axlon_enabled, 1);
@@ -326,20 +549,20 @@ void MEMORY_StateSave(UBYTE SaveVerbose)
 			StateSav_SaveINT(&MEMORY_axlon_bankmask, 1);
 			StateSav_SaveINT(&MEMORY_axlon_0f_mirror, 1);
 			StateSav_SaveINT(&axlon_ram_size, 1);
-			StateSav_SaveUBYTE(&axlon_ram[0], axlon_ram_size);
+			save_pages(axlon_ram, axlon_dirty, axlon_ram_size >> 8);
 		}
 		StateSav_SaveINT(&MEMORY_mosaic_enabled, 1);
 		if (MEMORY_mosaic_enabled){
 			StateSav_SaveINT(&mosaic_curbank, 1);
 			StateSav_SaveINT(&MEMORY_mosaic_maxbank, 1);
 			StateSav_SaveINT(&mosaic_ram_size, 1);
-			StateSav_SaveUBYTE(&mosaic_ram[0], mosaic_ram_size);
+			save_pages(mosaic_ram, mosaic_dirty, mosaic_ram_size >> 8);
 		}
 	}
 
-	StateSav_SaveUBYTE(&MEMORY_mem[0], 65536);
+	save_pages(MEMORY_mem, MEMORY_dirty, 256);
 #ifndef PAGED_ATTRIB
-	StateSav_SaveUBYTE(&MEMORY_attrib[0], 65536);
+	save_pages(MEMORY_attrib, MEMORY_dirty, 256);
 #else
 	{
 		/* I assume here that consecutive calls to StateSav_SaveUBYTE()
@@ -347,22 +570,16 @@ void MEMORY_StateSave(UBYTE SaveVerbose)
 		   (i.e. StateSav_SaveUBYTE() doesn't write any headers). */
 		UBYTE attrib_page[256];
 		int i;
+		if (StateSav_incremental) {
+			for (i = 0; i < 256; i++)
+				if (MEMORY_writemap[i] != snapshot_writemap[i])
+					MEMORY_dirty[i] = 1;
+			StateSav_SaveUBYTE(&MEMORY_dirty[0], 256);
+		}
 		for (i = 0; i < 256; i++) {
-			if (MEMORY_writemap[i] == NULL)
-				memset(attrib_page, MEMORY_RAM, 256);
-			else if (MEMORY_writemap[i] == MEMORY_ROM_PutByte)
-				memset(attrib_page, MEMORY_ROM, 256);
-			else if (i == 0x4f || i == 0x5f || i == 0x8f || i == 0x9f) {
-				/* special case: Bounty Bob bank switching registers */
-				memset(attrib_page, MEMORY_ROM, 256);
-				attrib_page[0xf6] = MEMORY_HARDWARE;
-				attrib_page[0xf7] = MEMORY_HARDWARE;
-				attrib_page[0xf8] = MEMORY_HARDWARE;
-				attrib_page[0xf9] = MEMORY_HARDWARE;
-			}
-			else {
-				memset(attrib_page, MEMORY_HARDWARE, 256);
-			}
+			if (StateSav_incremental && !MEMORY_dirty[i])
+				continue;
+			get_attrib_page(i, attrib_page);
 			StateSav_SaveUBYTE(&attrib_page[0], 256);
 		}
 	}
@@ -371,18 +588,18 @@ void MEMORY_StateSave(UBYTE SaveVerbose)
 	if (Atari800_machine_type == Atari800_MACHINE_XLXE) {
 		if (SaveVerbose != 0)
 			StateSav_SaveUBYTE(&MEMORY_basic[0], 8192);
-		StateSav_SaveUBYTE(&under_atari_basic[0], 8192);
+		save_pages(under_atari_basic, under_atari_basic_dirty, 8192 >> 8);
 
 		if (SaveVerbose != 0)
 			StateSav_SaveUBYTE(&MEMORY_os[0], 16384);
-		StateSav_SaveUBYTE(&under_atarixl_os[0], 16384);
+		save_pages(under_atarixl_os, under_atarixl_os_dirty, 16384 >> 8);
 	}
 
 	if (MEMORY_ram_size > 64) {
-		StateSav_SaveUBYTE(&atarixe_memory[0], atarixe_memory_size);
+		save_pages(atarixe_memory, atarixe_dirty, atarixe_memory_size >> 8);
 		/* a hack that makes state files compatible with previous versions:
            for 130 XE there's written 192 KB of unused data */
-		if (MEMORY_ram_size == 128) {
+		if (MEMORY_ram_size == 128 && !StateSav_in_memory) {
 			UBYTE buffer[256];
 			int i;
 			memset(buffer, 0, 256);
@@ -390,10 +607,26 @@ void MEMORY_StateSave(UBYTE SaveVerbose)
 				StateSav_SaveUBYTE(&buffer[0], 256);
 		}
 	}
+
+	/* chunk version 2: the cartridge areas and the RAM they hide,
+	   which is only used while they are switched on */
+	StateSav_SaveINT(&cart809F_enabled, 1);
+	StateSav_SaveINT(&MEMORY_cartA0BF_enabled, 1);
+	if (cart809F_enabled)
+		save_pages(under_cart809F, under_cart809F_dirty, 8192 >> 8);
+	if (MEMORY_cartA0BF_enabled)
+		save_pages(under_cartA0BF, under_cartA0BF_dirty, 8192 >> 8);
 }
 
 void MEMORY_StateRead(UBYTE SaveVerbose, UBYTE StateVersion)
 {
+	read_incremental = FALSE;
+	if (StateSav_in_memory) {
+		UBYTE incremental;
+		StateSav_ReadUBYTE(&incremental, 1);
+		read_incremental = incremental;
+	}
+
 	/* Axlon/Mosaic for 400/800 */
 	if ((Atari800_machine_type == Atari800_MACHINE_OSA  || Atari800_machine_type == Atari800_MACHINE_OSB) && StateVersion >= 5) {
 		StateSav_ReadINT(&MEMORY_axlon_enabled, 1);
@@ -402,107 +635,38 @@ void MEMORY_StateRead(UBYTE SaveVerbose, UBYTE StateVersion)
 			StateSav_ReadINT(&MEMORY_axlon_bankmask, 1);
 			StateSav_ReadINT(&MEMORY_axlon_0f_mirror, 1);
 			StateSav_ReadINT(&axlon_ram_size, 1);
-			alloc_axlon_memory();
-			StateSav_ReadUBYTE(&axlon_ram[0], axlon_ram_size);
+			/* an incremental snapshot is applied over its base,
+			   so the expansion RAM must be kept */
+			if (!read_incremental)
+				alloc_axlon_memory();
+			read_pages(axlon_ram, axlon_ram_size >> 8);
 		}
 		StateSav_ReadINT(&MEMORY_mosaic_enabled, 1);
 		if (MEMORY_mosaic_enabled){
 			StateSav_ReadINT(&mosaic_curbank, 1);
 			StateSav_ReadINT(&MEMORY_mosaic_maxbank, 1);
 			StateSav_ReadINT(&mosaic_ram_size, 1);
-			alloc_mosaic_memory();
-			StateSav_ReadUBYTE(&mosaic_ram[0], mosaic_ram_size);
+			if (!read_incremental)
+				alloc_mosaic_memory();
+			read_pages(mosaic_ram, mosaic_ram_size >> 8);
 		}
 	}
 
-	StateSav_ReadUBYTE(&MEMORY_mem[0], 65536);
+	read_pages(MEMORY_mem, 256);
 #ifndef PAGED_ATTRIB
-	StateSav_ReadUBYTE(&MEMORY_attrib[0], 65536);
+	read_pages(MEMORY_attrib, 256);
 #else
 	{
 		UBYTE attrib_page[256];
+		UBYTE map[256];
 		int i;
+		if (read_incremental)
+			StateSav_ReadUBYTE(&map[0], 256);
 		for (i = 0; i < 256; i++) {
+			if (read_incremental && !map[i])
+				continue;
 			StateSav_ReadUBYTE(&attrib_page[0], 256);
-			/* note: 0x40 is intentional here:
-			   we want ROM on page 0xd1 if H: patches are enabled */
-			switch (attrib_page[0x40]) {
-			case MEMORY_RAM:
-				MEMORY_readmap[i] = NULL;
-				MEMORY_writemap[i] = NULL;
-				break;
-			case MEMORY_ROM:
-				if (i != 0xd1 && attrib_page[0xf6] == MEMORY_HARDWARE) {
-					if (i == 0x4f || i == 0x8f) {
-						MEMORY_readmap[i] = CARTRIDGE_BountyBob1GetByte;
-						MEMORY_writemap[i] = CARTRIDGE_BountyBob1PutByte;
-					}
-					else if (i == 0x5f || i == 0x9f) {
-						MEMORY_readmap[i] = CARTRIDGE_BountyBob2GetByte;
-						MEMORY_writemap[i] = CARTRIDGE_BountyBob2PutByte;
-					}
-					/* else something's wrong, so we keep current values */
-				}
-				else {
-					MEMORY_readmap[i] = NULL;
-					MEMORY_writemap[i] = MEMORY_ROM_PutByte;
-				}
-				break;
-			case MEMORY_HARDWARE:
-				switch (i) {
-				case 0xc0:
-				case 0xd0:
-					MEMORY_readmap[i] = GTIA_GetByte;
-					MEMORY_writemap[i] = GTIA_PutByte;
-					break;
-				case 0xd1:
-					MEMORY_readmap[i] = PBI_D1GetByte;
-					MEMORY_writemap[i] = PBI_D1PutByte;
-					break;
-				case 0xd2:
-				case 0xe8:
-				case 0xeb:
-					MEMORY_readmap[i] = POKEY_GetByte;
-					MEMORY_writemap[i] = POKEY_PutByte;
-					break;
-				case 0xd3:
-					MEMORY_readmap[i] = PIA_GetByte;
-					MEMORY_writemap[i] = PIA_PutByte;
-					break;
-				case 0xd4:
-					MEMORY_readmap[i] = ANTIC_GetByte;
-					MEMORY_writemap[i] = ANTIC_PutByte;
-					break;
-				case 0xd5:
-					MEMORY_readmap[i] = CARTRIDGE_GetByte;
-					MEMORY_writemap[i] = CARTRIDGE_PutByte;
-					break;
-				case 0xd6:
-					MEMORY_readmap[i] = PBI_D6GetByte;
-					MEMORY_writemap[i] = PBI_D6PutByte;
-					break;
-				case 0xd7:
-					MEMORY_readmap[i] = PBI_D7GetByte;
-					MEMORY_writemap[i] = PBI_D7PutByte;
-					break;
-				case 0xff:
-					if (MEMORY_mosaic_enabled) MEMORY_writemap[0xff] = MosaicPutByte;
-					break;
-				case 0xcf:
-					if (MEMORY_axlon_enabled) MEMORY_writemap[0xcf] = AxlonPutByte;
-					break;
-				case 0x0f:
-					if (MEMORY_axlon_enabled && MEMORY_axlon_0f_mirror) MEMORY_writemap[0x0f] = AxlonPutByte;
-					break;
-				default:
-					/* something's wrong, so we keep current values */
-					break;
-				}
-				break;
-			default:
-				/* something's wrong, so we keep current values */
-				break;
-			}
+			set_attrib_page(i, attrib_page);
 		}
 	}
 #endif
@@ -510,26 +674,41 @@ void MEMORY_StateRead(UBYTE SaveVerbose, UBYTE StateVersion)
 	if (Atari800_machine_type == Atari800_MACHINE_XLXE) {
 		if (SaveVerbose != 0)
 			StateSav_ReadUBYTE(&MEMORY_basic[0], 8192);
-		StateSav_ReadUBYTE(&under_atari_basic[0], 8192);
+		read_pages(under_atari_basic, 8192 >> 8);
 
 		if (SaveVerbose != 0)
 			StateSav_ReadUBYTE(&MEMORY_os[0], 16384);
-		StateSav_ReadUBYTE(&under_atarixl_os[0], 16384);
+		read_pages(under_atarixl_os, 16384 >> 8);
 	}
 
 	ANTIC_xe_ptr = NULL;
 	AllocXEMemory();
 	if (MEMORY_ram_size > 64) {
-		StateSav_ReadUBYTE(&atarixe_memory[0], atarixe_memory_size);
+		read_pages(atarixe_memory, atarixe_memory_size >> 8);
 		/* a hack that makes state files compatible with previous versions:
            for 130 XE there's written 192 KB of unused data */
-		if (MEMORY_ram_size == 128) {
+		if (MEMORY_ram_size == 128 && !StateSav_in_memory) {
 			UBYTE buffer[256];
 			int i;
 			for (i = 0; i < 192 * 4; i++)
 				StateSav_ReadUBYTE(&buffer[0], 256);
 		}
 	}
+
+	/* older files leave the areas as CARTRIDGE_StateRead() set them */
+	if (StateSav_chunk_version >= 2) {
+		StateSav_ReadINT(&cart809F_enabled, 1);
+		StateSav_ReadINT(&MEMORY_cartA0BF_enabled, 1);
+		if (cart809F_enabled)
+			read_pages(under_cart809F, 8192 >> 8);
+		if (MEMORY_cartA0BF_enabled)
+			read_pages(under_cartA0BF, 8192 >> 8);
+	}
+
+	/* memory no longer matches the last saved snapshot,
+	   so the next incremental one must store every page */
+	set_all_dirty(1);
+	read_incremental = FALSE;
 }
 
 #endif /* BASIC */
@@ -595,13 +774,14 @@ void MEMORY_HandlePORTB(UBYTE byte, UBYTE oldval)
 		/* Note: in Compy Shop bit 5 (ANTIC access) disables Self Test */
 		if (MEMORY_selftest_enabled && (bank != MEMORY_xe_bank || (MEMORY_ram_size == MEMORY_RAM_320_COMPY_SHOP && (byte & 0x20) == 0))) {
 			/* Disable Self Test ROM */
-			memcpy(MEMORY_mem + 0x5000, under_atarixl_os + 0x1000, 0x800);
+			MEMORY_dCopyToMem(under_atarixl_os + 0x1000, 0x5000, 0x800);
 			MEMORY_SetRAM(0x5000, 0x57ff);
 			MEMORY_selftest_enabled = FALSE;
 		}
 		if (bank != MEMORY_xe_bank) {
 			memcpy(atarixe_memory + (MEMORY_xe_bank << 14), MEMORY_mem + 0x4000, 16384);
-			memcpy(MEMORY_mem + 0x4000, atarixe_memory + (bank << 14), 16384);
+			set_dirty(atarixe_dirty, (MEMORY_xe_bank << 14), 16384);
+			MEMORY_dCopyToMem(atarixe_memory + (bank << 14), 0x4000, 16384);
 			MEMORY_xe_bank = bank;
 		}
 		if (MEMORY_ram_size == 128 || MEMORY_ram_size == MEMORY_RAM_320_COMPY_SHOP)
@@ -627,19 +807,21 @@ void MEMORY_HandlePORTB(UBYTE byte, UBYTE oldval)
 			/* Enable OS ROM */
 			if (MEMORY_ram_size > 48) {
 				memcpy(under_atarixl_os, MEMORY_mem + 0xc000, 0x1000);
+				set_dirty(under_atarixl_os_dirty, 0, 0x1000);
 				memcpy(under_atarixl_os + 0x1800, MEMORY_mem + 0xd800, 0x2800);
+				set_dirty(under_atarixl_os_dirty, 0x1800, 0x2800);
 				MEMORY_SetROM(0xc000, 0xcfff);
 				MEMORY_SetROM(0xd800, 0xffff);
 			}
-			memcpy(MEMORY_mem + 0xc000, MEMORY_os, 0x1000);
-			memcpy(MEMORY_mem + 0xd800, MEMORY_os + 0x1800, 0x2800);
+			MEMORY_dCopyToMem(MEMORY_os, 0xc000, 0x1000);
+			MEMORY_dCopyToMem(MEMORY_os + 0x1800, 0xd800, 0x2800);
 			ESC_PatchOS();
 		}
 		else {
 			/* Disable OS ROM */
 			if (MEMORY_ram_size > 48) {
-				memcpy(MEMORY_mem + 0xc000, under_atarixl_os, 0x1000);
-				memcpy(MEMORY_mem + 0xd800, under_atarixl_os + 0x1800, 0x2800);
+				MEMORY_dCopyToMem(under_atarixl_os, 0xc000, 0x1000);
+				MEMORY_dCopyToMem(under_atarixl_os + 0x1800, 0xd800, 0x2800);
 				MEMORY_SetRAM(0xc000, 0xcfff);
 				MEMORY_SetRAM(0xd800, 0xffff);
 			} else {
@@ -649,7 +831,7 @@ void MEMORY_HandlePORTB(UBYTE byte, UBYTE oldval)
 			/* When OS ROM is disabled we also have to disable Self Test - Jindroush */
 			if (MEMORY_selftest_enabled) {
 				if (MEMORY_ram_size > 20) {
-					memcpy(MEMORY_mem + 0x5000, under_atarixl_os + 0x1000, 0x800);
+					MEMORY_dCopyToMem(under_atarixl_os + 0x1000, 0x5000, 0x800);
 					MEMORY_SetRAM(0x5000, 0x57ff);
 				}
 				else
@@ -667,7 +849,7 @@ void MEMORY_HandlePORTB(UBYTE byte, UBYTE oldval)
 			if (now_disabled) {
 				/* Disable BASIC ROM */
 				if (MEMORY_ram_size > 40) {
-					memcpy(MEMORY_mem + 0xa000, under_atari_basic, 0x2000);
+					MEMORY_dCopyToMem(under_atari_basic, 0xa000, 0x2000);
 					MEMORY_SetRAM(0xa000, 0xbfff);
 				}
 				else
@@ -677,9 +859,10 @@ void MEMORY_HandlePORTB(UBYTE byte, UBYTE oldval)
 				/* Enable BASIC ROM */
 				if (MEMORY_ram_size > 40) {
 					memcpy(under_atari_basic, MEMORY_mem + 0xa000, 0x2000);
+					set_dirty(under_atari_basic_dirty, 0, 0x2000);
 					MEMORY_SetROM(0xa000, 0xbfff);
 				}
-				memcpy(MEMORY_mem + 0xa000, MEMORY_basic, 0x2000);
+				MEMORY_dCopyToMem(MEMORY_basic, 0xa000, 0x2000);
 			}
 		}
 	}
@@ -689,7 +872,7 @@ void MEMORY_HandlePORTB(UBYTE byte, UBYTE oldval)
 		if (MEMORY_selftest_enabled) {
 			/* Disable Self Test ROM */
 			if (MEMORY_ram_size > 20) {
-				memcpy(MEMORY_mem + 0x5000, under_atarixl_os + 0x1000, 0x800);
+				MEMORY_dCopyToMem(under_atarixl_os + 0x1000, 0x5000, 0x800);
 				MEMORY_SetRAM(0x5000, 0x57ff);
 			}
 			else
@@ -707,9 +890,10 @@ void MEMORY_HandlePORTB(UBYTE byte, UBYTE oldval)
 			/* Enable Self Test ROM */
 			if (MEMORY_ram_size > 20) {
 				memcpy(under_atarixl_os + 0x1000, MEMORY_mem + 0x5000, 0x800);
+				set_dirty(under_atarixl_os_dirty, 0x1000, 0x800);
 				MEMORY_SetROM(0x5000, 0x57ff);
 			}
-			memcpy(MEMORY_mem + 0x5000, MEMORY_os + 0x1000, 0x800);
+			MEMORY_dCopyToMem(MEMORY_os + 0x1000, 0x5000, 0x800);
 			MEMORY_selftest_enabled = TRUE;
 		}
 	}
@@ -735,18 +919,20 @@ static void MosaicPutByte(UWORD addr, UBYTE byte)
 	if (newbank > MEMORY_mosaic_maxbank && mosaic_curbank <= MEMORY_mosaic_maxbank) {
 		/*ram ->rom*/
 		memcpy(mosaic_ram + mosaic_curbank*0x1000, MEMORY_mem + 0xc000,0x1000);
+		set_dirty(mosaic_dirty, mosaic_curbank*0x1000, 0x1000);
 		MEMORY_dFillMem(0xc000, 0xff, 0x1000);
 		MEMORY_SetROM(0xc000, 0xcfff);
 	}
 	else if (newbank <= MEMORY_mosaic_maxbank && mosaic_curbank > MEMORY_mosaic_maxbank) {
 		/*rom->ram*/
-		memcpy(MEMORY_mem + 0xc000, mosaic_ram+newbank*0x1000,0x1000);
+		MEMORY_dCopyToMem(mosaic_ram+newbank*0x1000, 0xc000, 0x1000);
 		MEMORY_SetRAM(0xc000, 0xcfff);
 	}
 	else {
 		/*ram -> ram*/
 		memcpy(mosaic_ram + mosaic_curbank*0x1000, MEMORY_mem + 0xc000, 0x1000);
-		memcpy(MEMORY_mem + 0xc000, mosaic_ram + newbank*0x1000, 0x1000);
+		set_dirty(mosaic_dirty, mosaic_curbank*0x1000, 0x1000);
+		MEMORY_dCopyToMem(mosaic_ram + newbank*0x1000, 0xc000, 0x1000);
 		MEMORY_SetRAM(0xc000, 0xcfff);
 	}
 	mosaic_curbank = newbank;
@@ -775,7 +961,7 @@ static void AxlonPutByte(UWORD addr, UBYTE byte)
 {
 	int newbank;
 	/*Write-through to RAM if it is the page 0x0f shadow*/
-	if ((addr&0xff00) == 0x0f00) MEMORY_mem[addr] = byte;
+	if ((addr&0xff00) == 0x0f00) MEMORY_dPutByte(addr, byte);
 	if ((addr&0xff) < 0xc0) return; /*0xffc0-0xffff and 0x0fc0-0x0fff only*/
 #ifdef DEBUG
 	Log_print("AxlonPutByte:%4X:%2X", addr, byte);
@@ -783,7 +969,8 @@ static void AxlonPutByte(UWORD addr, UBYTE byte)
 	newbank = (byte&MEMORY_axlon_bankmask);
 	if (newbank == axlon_curbank) return;
 	memcpy(axlon_ram + axlon_curbank*0x4000, MEMORY_mem + 0x4000, 0x4000);
-	memcpy(MEMORY_mem + 0x4000, axlon_ram + newbank*0x4000, 0x4000);
+	set_dirty(axlon_dirty, axlon_curbank*0x4000, 0x4000);
+	MEMORY_dCopyToMem(axlon_ram + newbank*0x4000, 0x4000, 0x4000);
 	axlon_curbank = newbank;
 }
 
@@ -795,16 +982,11 @@ static UBYTE AxlonGetByte(UWORD addr)
 	return MEMORY_mem[addr];
 }
 
-static int cart809F_enabled = FALSE;
-int MEMORY_cartA0BF_enabled = FALSE;
-static UBYTE under_cart809F[8192];
-static UBYTE under_cartA0BF[8192];
-
 void MEMORY_Cart809fDisable(void)
 {
 	if (cart809F_enabled) {
 		if (MEMORY_ram_size > 32) {
-			memcpy(MEMORY_mem + 0x8000, under_cart809F, 0x2000);
+			MEMORY_dCopyToMem(under_cart809F, 0x8000, 0x2000);
 			MEMORY_SetRAM(0x8000, 0x9fff);
 		}
 		else
@@ -818,6 +1000,7 @@ void MEMORY_Cart809fEnable(void)
 	if (!cart809F_enabled) {
 		if (MEMORY_ram_size > 32) {
 			memcpy(under_cart809F, MEMORY_mem + 0x8000, 0x2000);
+			memset(under_cart809F_dirty, 1, sizeof(under_cart809F_dirty));
 			MEMORY_SetROM(0x8000, 0x9fff);
 		}
 		cart809F_enabled = TRUE;
@@ -831,14 +1014,14 @@ void MEMORY_CartA0bfDisable(void)
 		/* or accessing extended 576K or 1088K memory */
 		if ((Atari800_machine_type != Atari800_MACHINE_XLXE) || basic_disabled((UBYTE) (PIA_PORTB | PIA_PORTB_mask))) {
 			if (MEMORY_ram_size > 40) {
-				memcpy(MEMORY_mem + 0xa000, under_cartA0BF, 0x2000);
+				MEMORY_dCopyToMem(under_cartA0BF, 0xa000, 0x2000);
 				MEMORY_SetRAM(0xa000, 0xbfff);
 			}
 			else
 				MEMORY_dFillMem(0xa000, 0xff, 0x2000);
 		}
 		else
-			memcpy(MEMORY_mem + 0xa000, MEMORY_basic, 0x2000);
+			MEMORY_dCopyToMem(MEMORY_basic, 0xa000, 0x2000);
 		MEMORY_cartA0BF_enabled = FALSE;
 		if (Atari800_machine_type == Atari800_MACHINE_XLXE) {
 			GTIA_TRIG[3] = 0;
@@ -857,6 +1040,7 @@ void MEMORY_CartA0bfEnable(void)
 		|| ((PIA_PORTB & 0x10) == 0 && (MEMORY_ram_size == 576 || MEMORY_ram_size == 1088)))) {
 			/* Back-up 0xa000-0xbfff RAM */
 			memcpy(under_cartA0BF, MEMORY_mem + 0xa000, 0x2000);
+			memset(under_cartA0BF_dirty, 1, sizeof(under_cartA0BF_dirty));
 			MEMORY_SetROM(0xa000, 0xbfff);
 		}
 		MEMORY_cartA0BF_enabled = TRUE;
@@ -6,18 +6,30 @@
 
 #include "atari.h"
 
+/* Pages of MEMORY_mem (and MEMORY_attrib) changed since the last
+   incremental snapshot,
+   one byte per 256 bytes; see StateSav_SaveIncrementalSnapshot().
+   The extra byte is for MEMORY_dPutWord(0xffff, ...).
+   Code that writes MEMORY_mem directly must call MEMORY_SetDirty()
+   or MEMORY_SetDirtyRange(). */
+extern UBYTE MEMORY_dirty[256 + 1];
+#define MEMORY_SetDirty(addr)			(MEMORY_dirty[(addr) >> 8] = 1)
+void MEMORY_SetDirtyRange(int addr, int size);
+/* Called after an incremental snapshot is saved. */
+void MEMORY_ClearDirty(void);
+
 #define MEMORY_dGetByte(x)				(MEMORY_mem[x])
-#define MEMORY_dPutByte(x, y)			(MEMORY_mem[x] = y)
+#define MEMORY_dPutByte(x, y)			(MEMORY_SetDirty(x), MEMORY_mem[x] = y)
 
 #ifndef WORDS_BIGENDIAN
 #ifdef WORDS_UNALIGNED_OK
 #define MEMORY_dGetWord(x)				UNALIGNED_GET_WORD(&MEMORY_mem[x], memory_read_word_stat)
-#define MEMORY_dPutWord(x, y)			UNALIGNED_PUT_WORD(&MEMORY_mem[x], (y), memory_write_word_stat)
+#define MEMORY_dPutWord(x, y)			(MEMORY_SetDirty(x), MEMORY_SetDirty((x) + 1), UNALIGNED_PUT_WORD(&MEMORY_mem[x], (y), memory_write_word_stat))
 #define MEMORY_dGetWordAligned(x)		UNALIGNED_GET_WORD(&MEMORY_mem[x], memory_read_aligned_word_stat)
-#define MEMORY_dPutWordAligned(x, y)	UNALIGNED_PUT_WORD(&MEMORY_mem[x], (y), memory_write_aligned_word_stat)
+#define MEMORY_dPutWordAligned(x, y)	(MEMORY_SetDirty(x), UNALIGNED_PUT_WORD(&MEMORY_mem[x], (y), memory_write_aligned_word_stat))
 #else	/* WORDS_UNALIGNED_OK */
 #define MEMORY_dGetWord(x)				(MEMORY_mem[x] + (MEMORY_mem[(x) + 1] << 8))
-#define MEMORY_dPutWord(x, y)			(MEMORY_mem[x] = (UBYTE) (y), MEMORY_mem[(x) + 1] = (UBYTE) ((y) >> 8))
+#define MEMORY_dPutWord(x, y)			(MEMORY_dPutByte(x, (UBYTE) (y)), MEMORY_dPutByte((x) + 1, (UBYTE) ((y) >> 8)))
 /* faster versions of MEMORY_jdGetWord and MEMORY_dPutWord for even addresses */
 /* TODO: guarantee that memory is UWORD-aligned and use UWORD access */
 #define MEMORY_dGetWordAligned(x)		MEMORY_dGetWord(x)
@@ -26,14 +38,14 @@
 #else	/* WORDS_BIGENDIAN */
 /* can't do any word optimizations for big endian machines */
 #define MEMORY_dGetWord(x)				(MEMORY_mem[x] + (MEMORY_mem[(x) + 1] << 8))
-#define MEMORY_dPutWord(x, y)			(MEMORY_mem[x] = (UBYTE) (y), MEMORY_mem[(x) + 1] = (UBYTE) ((y) >> 8))
+#define MEMORY_dPutWord(x, y)			(MEMORY_dPutByte(x, (UBYTE) (y)), MEMORY_dPutByte((x) + 1, (UBYTE) ((y) >> 8)))
 #define MEMORY_dGetWordAligned(x)		MEMORY_dGetWord(x)
 #define MEMORY_dPutWordAligned(x, y)	MEMORY_dPutWord(x, y)
 #endif	/* WORDS_BIGENDIAN */
 
 #define MEMORY_dCopyFromMem(from, to, size)	memcpy(to, MEMORY_mem + (from), size)
-#define MEMORY_dCopyToMem(from, to, size)		memcpy(MEMORY_mem + (to), from, size)
-#define MEMORY_dFillMem(addr1, value, length)	memset(MEMORY_mem + (addr1), value, length)
+#define MEMORY_dCopyToMem(from, to, size)		(MEMORY_SetDirtyRange(to, size), memcpy(MEMORY_mem + (to), from, size))
+#define MEMORY_dFillMem(addr1, value, length)	(MEMORY_SetDirtyRange(addr1, length), memset(MEMORY_mem + (addr1), value, length))
 
 extern UBYTE MEMORY_mem[65536 + 2];
 
@@ -54,10 +66,10 @@ extern int MEMORY_ram_size;
 
 extern UBYTE MEMORY_attrib[65536];
 #define MEMORY_GetByte(addr)		(MEMORY_attrib[addr] == MEMORY_HARDWARE ? MEMORY_HwGetByte(addr) : MEMORY_mem[addr])
-#define MEMORY_PutByte(addr, byte)	 do { if (MEMORY_attrib[addr] == MEMORY_RAM) MEMORY_mem[addr] = byte; else if (MEMORY_attrib[addr] == MEMORY_HARDWARE) MEMORY_HwPutByte(addr, byte); } while (0)
-#define MEMORY_SetRAM(addr1, addr2) memset(MEMORY_attrib + (addr1), MEMORY_RAM, (addr2) - (addr1) + 1)
-#define MEMORY_SetROM(addr1, addr2) memset(MEMORY_attrib + (addr1), MEMORY_ROM, (addr2) - (addr1) + 1)
-#define MEMORY_SetHARDWARE(addr1, addr2) memset(MEMORY_attrib + (addr1), MEMORY_HARDWARE, (addr2) - (addr1) + 1)
+#define MEMORY_PutByte(addr, byte)	 do { if (MEMORY_attrib[addr] == MEMORY_RAM) MEMORY_dPutByte(addr, byte); else if (MEMORY_attrib[addr] == MEMORY_HARDWARE) MEMORY_HwPutByte(addr, byte); } while (0)
+#define MEMORY_SetRAM(addr1, addr2) (MEMORY_SetDirtyRange(addr1, (addr2) - (addr1) + 1), memset(MEMORY_attrib + (addr1), MEMORY_RAM, (addr2) - (addr1) + 1))
+#define MEMORY_SetROM(addr1, addr2) (MEMORY_SetDirtyRange(addr1, (addr2) - (addr1) + 1), memset(MEMORY_attrib + (addr1), MEMORY_ROM, (addr2) - (addr1) + 1))
+#define MEMORY_SetHARDWARE(addr1, addr2) (MEMORY_SetDirtyRange(addr1, (addr2) - (addr1) + 1), memset(MEMORY_attrib + (addr1), MEMORY_HARDWARE, (addr2) - (addr1) + 1))
 
 #else /* PAGED_ATTRIB */
 
@@ -67,12 +79,13 @@ extern MEMORY_rdfunc MEMORY_readmap[256];
 extern MEMORY_wrfunc MEMORY_writemap[256];
 void MEMORY_ROM_PutByte(UWORD addr, UBYTE byte);
 #define MEMORY_GetByte(addr)		(MEMORY_readmap[(addr) >> 8] ? (*MEMORY_readmap[(addr) >> 8])(addr) : MEMORY_mem[addr])
-#define MEMORY_PutByte(addr,byte)	(MEMORY_writemap[(addr) >> 8] ? ((*MEMORY_writemap[(addr) >> 8])(addr, byte), 0) : (MEMORY_mem[addr] = byte))
+#define MEMORY_PutByte(addr,byte)	(MEMORY_writemap[(addr) >> 8] ? ((*MEMORY_writemap[(addr) >> 8])(addr, byte), 0) : MEMORY_dPutByte(addr, byte))
 #define MEMORY_SetRAM(addr1, addr2) do { \
 		int i; \
 		for (i = (addr1) >> 8; i <= (addr2) >> 8; i++) { \
 			MEMORY_readmap[i] = NULL; \
 			MEMORY_writemap[i] = NULL; \
+			MEMORY_dirty[i] = 1; \
 		} \
 	} while (0)
 #define MEMORY_SetROM(addr1, addr2) do { \
@@ -80,6 +93,7 @@ void MEMORY_ROM_PutByte(UWORD addr, UBYTE byte);
 		for (i = (addr1) >> 8; i <= (addr2) >> 8; i++) { \
 			MEMORY_readmap[i] = NULL; \
 			MEMORY_writemap[i] = MEMORY_ROM_PutByte; \
+			MEMORY_dirty[i] = 1; \
 		} \
 	} while (0)
 
@@ -104,7 +118,7 @@ void MEMORY_Cart809fDisable(void);
 void MEMORY_Cart809fEnable(void);
 void MEMORY_CartA0bfDisable(void);
 void MEMORY_CartA0bfEnable(void);
-#define MEMORY_CopyROM(addr1, addr2, src) memcpy(MEMORY_mem + (addr1), src, (addr2) - (addr1) + 1)
+#define MEMORY_CopyROM(addr1, addr2, src) MEMORY_dCopyToMem(src, addr1, (addr2) - (addr1) + 1)
 void MEMORY_GetCharset(UBYTE *cs);
 
 /* Mosaic and Axlon 400/800 RAM extensions */
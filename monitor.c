@@ -1696,6 +1696,7 @@ int MONITOR_Run(void)
 					else {
 						if (fread(&MEMORY_mem[addr], 1, nbytes, f) == 0)
 							perror(filename);
+						MEMORY_SetDirtyRange(addr, nbytes);
 						fclose(f);
 					}
 				}
@@ -0,0 +1,567 @@
+/*
+ * movie.c - binary input movies with snapshots for seeking
+ *
+ * Copyright (C) 2026 Atari800 development team (see DOC/CREDITS)
+ *
+ * This file is part of the Atari800 emulator project which emulates
+ * the Atari 400, 800, 800XL, 130XE, and 5200 8-bit computers.
+ *
+ * Atari800 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Atari800 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atari800; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "atari.h"
+#include "log.h"
+#include "movie.h"
+#include "statesav.h"
+#include "util.h"
+#ifndef CURSES_BASIC
+#include "screen.h"
+#endif
+
+/*
+	File format (all numbers little endian):
+
+	  0   6 bytes  "A8MOV\x1a"
+	  6   1 byte   format version (3)
+	  7   1 byte   reserved (0)
+	  8   4 bytes  offset of the index record (0 if the recording
+	               was not finished)
+	 12   4 bytes  number of frames
+
+	followed by records: 1 byte type, 4 bytes payload length, payload.
+
+	'F'  inputs of one frame: 2 bytes key code, key shift, key consol,
+	     port 0, port 1, trigger bits, 4 bytes screen checksum
+	     of the previous frame (0 = not checked, see screen_checksum())
+	'V'  a value read with MOVIE_ReadInt(): 4 bytes
+	'S'  snapshot taken before the next 'F' record: 4 bytes frame number,
+	     4 bytes snapshot size, the StateSav_SaveSnapshot() data deflated
+	'D'  like 'S', but StateSav_SaveIncrementalSnapshot() data: applied
+	     over the previous 'S' or 'D' record (version 3)
+	'I'  index: 4 bytes snapshot count, then 4 bytes frame number
+	     and 4 bytes file offset of each 'S' and 'D' record
+*/
+
+#define HEADER_SIZE        16
+#define FORMAT_VERSION     3
+#define FRAME_RECORD_SIZE  11
+/* 'D' records between two 'S' records */
+#define DELTAS_PER_KEYFRAME 9
+
+typedef struct {
+	ULONG frame;
+	ULONG offset;
+} index_entry;
+
+int MOVIE_snapshot_interval = 600;
+int MOVIE_frame = 0;
+int MOVIE_screen_errors = 0;
+int MOVIE_first_error_frame = -1;
+
+static FILE *fp = NULL;
+static int recording = FALSE;
+static int playing = FALSE;
+static int write_error;
+static int version;	/* of the movie being played back */
+/* FALSE until Screen_atari holds a frame emulated by this movie */
+static int check_screen;
+/* 'D' records to write before the next 'S' record */
+static int deltas_left;
+
+static index_entry *movie_index = NULL;
+static int index_count;
+static int index_alloc;
+
+static UBYTE *snapshot = NULL;
+static size_t snapshot_alloc = 0;
+static UBYTE *packed = NULL;
+static uLongf packed_alloc = 0;
+
+static void write32(ULONG x, UBYTE *p)
+{
+	p[0] = (UBYTE) x;
+	p[1] = (UBYTE) (x >> 8);
+	p[2] = (UBYTE) (x >> 16);
+	p[3] = (UBYTE) (x >> 24);
+}
+
+static ULONG read32(const UBYTE *p)
+{
+	return p[0] + (p[1] << 8) + (p[2] << 16) + ((ULONG) p[3] << 24);
+}
+
+static void write_record(int type, const UBYTE *data, ULONG size)
+{
+	UBYTE header[5];
+	if (write_error)
+		return;
+	header[0] = (UBYTE) type;
+	write32(size, header + 1);
+	if (fwrite(header, 1, 5, fp) != 5 || (size > 0 && fwrite(data, 1, size, fp) != size)) {
+		Log_print("Movie recording: write error");
+		write_error = TRUE;
+	}
+}
+
+/* Reads the type and payload length of the next record.
+   Returns FALSE at the end of the file. */
+static int read_record_header(int *type, ULONG *size)
+{
+	UBYTE header[5];
+	if (fread(header, 1, 5, fp) != 5)
+		return FALSE;
+	*type = header[0];
+	*size = read32(header + 1);
+	return TRUE;
+}
+
+static void add_index_entry(ULONG frame, ULONG offset)
+{
+	if (index_count >= index_alloc) {
+		index_alloc = index_alloc == 0 ? 64 : index_alloc * 2;
+		movie_index = (index_entry *) Util_realloc(movie_index, index_alloc * sizeof(index_entry));
+	}
+	movie_index[index_count].frame = frame;
+	movie_index[index_count].offset = offset;
+	index_count++;
+}
+
+static void free_buffers(void)
+{
+	free(movie_index);
+	movie_index = NULL;
+	index_count = index_alloc = 0;
+	free(snapshot);
+	snapshot = NULL;
+	snapshot_alloc = 0;
+	free(packed);
+	packed = NULL;
+	packed_alloc = 0;
+}
+
+#ifndef CURSES_BASIC
+
+#ifdef WORDS_BIGENDIAN
+#define LOAD32(p) ((p)[0] + ((p)[1] << 8) + ((p)[2] << 16) + ((ULONG) (p)[3] << 24))
+#else
+/* Screen_atari lines and the visible portion are ULONG-aligned */
+#define LOAD32(p) (*(const ULONG *) (p))
+#endif
+#define ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define HASH_PRIME1 0x9e3779b1U
+#define HASH_PRIME2 0x85ebca77U
+#define HASH_PRIME3 0xc2b2ae3dU
+#define HASH_ROUND(h, p) h = ROTL32(h + LOAD32(p) * HASH_PRIME2, 13) * HASH_PRIME1
+
+/* Checksum of the visible portion of the screen: 24..360 on the horizontal
+   and 0..Screen_HEIGHT on the vertical. The xxHash32 main loop:
+   four independent lanes of 32-bit words, about twice as fast as
+   adler32, which version 1 movies used. */
+static ULONG screen_checksum(void)
+{
+	const UBYTE *line = (const UBYTE *) Screen_atari + 24;
+	ULONG h0 = HASH_PRIME1 + HASH_PRIME2;
+	ULONG h1 = HASH_PRIME2;
+	ULONG h2 = 0;
+	ULONG h3 = 0 - HASH_PRIME1;
+	ULONG h;
+	int y;
+
+	if (version == 1) {
+		uLong adler = adler32(0L, Z_NULL, 0);
+		for (y = 0; y < Screen_HEIGHT; y++)
+			adler = adler32(adler, (const Bytef *) Screen_atari + 24 + Screen_WIDTH * y, 360 - 24);
+		return (ULONG) adler;
+	}
+
+	for (y = 0; y < Screen_HEIGHT; y++) {
+		const UBYTE *p;
+		for (p = line; p < line + 360 - 24; p += 16) {
+			HASH_ROUND(h0, p);
+			HASH_ROUND(h1, p + 4);
+			HASH_ROUND(h2, p + 8);
+			HASH_ROUND(h3, p + 12);
+		}
+		line += Screen_WIDTH;
+	}
+	h = ROTL32(h0, 1) + ROTL32(h1, 7) + ROTL32(h2, 12) + ROTL32(h3, 18);
+	h ^= h >> 15;
+	h *= HASH_PRIME2;
+	h ^= h >> 13;
+	h *= HASH_PRIME3;
+	h ^= h >> 16;
+	/* 0 means "not checked" */
+	return h != 0 ? h : 1;
+}
+
+#else /* CURSES_BASIC */
+
+static ULONG screen_checksum(void)
+{
+	return 0;
+}
+
+#endif /* CURSES_BASIC */
+
+static void write_snapshot(void)
+{
+	int left = deltas_left;
+	int full = left == 0;
+	size_t size = full ? StateSav_SaveSnapshot(NULL, 0) : StateSav_SaveIncrementalSnapshot(NULL, 0);
+	uLongf packed_size;
+	UBYTE *record;
+
+	/* after a failure, the next 'D' record would have nothing to apply to */
+	deltas_left = 0;
+	if (size > snapshot_alloc) {
+		snapshot = (UBYTE *) Util_realloc(snapshot, size);
+		snapshot_alloc = size;
+	}
+	size = full ? StateSav_SaveSnapshot(snapshot, snapshot_alloc) : StateSav_SaveIncrementalSnapshot(snapshot, snapshot_alloc);
+	if (size == 0)
+		return;
+	packed_size = compressBound((uLong) size) + 8;
+	if (packed_size > packed_alloc) {
+		packed = (UBYTE *) Util_realloc(packed, packed_size);
+		packed_alloc = packed_size;
+	}
+	record = packed;
+	packed_size -= 8;
+	if (compress2(record + 8, &packed_size, snapshot, (uLong) size, Z_BEST_SPEED) != Z_OK)
+		return;
+	write32(MOVIE_frame, record);
+	write32((ULONG) size, record + 4);
+	add_index_entry(MOVIE_frame, (ULONG) ftell(fp));
+	write_record(full ? 'S' : 'D', record, packed_size + 8);
+	deltas_left = full ? DELTAS_PER_KEYFRAME : left - 1;
+}
+
+int MOVIE_StartRecording(const char *filename)
+{
+	static const UBYTE header[HEADER_SIZE] = {
+		'A', '8', 'M', 'O', 'V', 0x1a, FORMAT_VERSION, 0,
+		0, 0, 0, 0, 0, 0, 0, 0
+	};
+
+	MOVIE_Stop();
+	fp = fopen(filename, "wb");
+	if (fp == NULL) {
+		Log_print("Cannot open record file");
+		return FALSE;
+	}
+	if (fwrite(header, 1, HEADER_SIZE, fp) != HEADER_SIZE) {
+		Log_print("Movie recording: write error");
+		fclose(fp);
+		fp = NULL;
+		return FALSE;
+	}
+	write_error = FALSE;
+	version = FORMAT_VERSION;
+	check_screen = FALSE;
+	deltas_left = 0;
+	MOVIE_frame = 0;
+	recording = TRUE;
+	return TRUE;
+}
+
+/* Builds the index of a movie whose recording was not finished. */
+static void scan_snapshots(void)
+{
+	int type;
+	ULONG size;
+	long offset = HEADER_SIZE;
+	UBYTE frame[4];
+
+	fseek(fp, offset, SEEK_SET);
+	while (read_record_header(&type, &size)) {
+		if (type == 'S' || type == 'D') {
+			if (fread(frame, 1, 4, fp) != 4)
+				break;
+			add_index_entry(read32(frame), (ULONG) offset);
+		}
+		offset += 5 + size;
+		if (fseek(fp, offset, SEEK_SET) != 0)
+			break;
+	}
+}
+
+static int read_index(ULONG offset)
+{
+	UBYTE buffer[8];
+	int type;
+	ULONG size;
+	ULONG count;
+	ULONG i;
+
+	if (fseek(fp, (long) offset, SEEK_SET) != 0
+	 || !read_record_header(&type, &size) || type != 'I'
+	 || fread(buffer, 1, 4, fp) != 4)
+		return FALSE;
+	count = read32(buffer);
+	for (i = 0; i < count; i++) {
+		if (fread(buffer, 1, 8, fp) != 8)
+			return FALSE;
+		add_index_entry(read32(buffer), read32(buffer + 4));
+	}
+	return TRUE;
+}
+
+int MOVIE_StartPlayback(const char *filename)
+{
+	UBYTE header[HEADER_SIZE];
+
+	MOVIE_Stop();
+	fp = fopen(filename, "rb");
+	if (fp == NULL) {
+		Log_print("Cannot open playback file");
+		return FALSE;
+	}
+	if (fread(header, 1, HEADER_SIZE, fp) != HEADER_SIZE
+	 || memcmp(header, "A8MOV\x1a", 6) != 0) {
+		Log_print("Invalid playback file");
+		fclose(fp);
+		fp = NULL;
+		return FALSE;
+	}
+	if (header[6] > FORMAT_VERSION) {
+		Log_print("Newer version of playback file than this version of Atari800 can handle");
+		fclose(fp);
+		fp = NULL;
+		return FALSE;
+	}
+	if (read32(header + 8) == 0 || !read_index(read32(header + 8))) {
+		index_count = 0;
+		scan_snapshots();
+	}
+	fseek(fp, HEADER_SIZE, SEEK_SET);
+	version = header[6];
+	check_screen = FALSE;
+	MOVIE_frame = 0;
+	MOVIE_screen_errors = 0;
+	MOVIE_first_error_frame = -1;
+	playing = TRUE;
+	return TRUE;
+}
+
+int MOVIE_Stop(void)
+{
+	int result = TRUE;
+
+	if (recording) {
+		UBYTE *buffer = (UBYTE *) Util_malloc(4 + index_count * 8);
+		UBYTE header[8];
+		ULONG index_offset = (ULONG) ftell(fp);
+		int i;
+		write32(index_count, buffer);
+		for (i = 0; i < index_count; i++) {
+			write32(movie_index[i].frame, buffer + 4 + i * 8);
+			write32(movie_index[i].offset, buffer + 8 + i * 8);
+		}
+		write_record('I', buffer, 4 + index_count * 8);
+		free(buffer);
+		write32(index_offset, header);
+		write32(MOVIE_frame, header + 4);
+		if (!write_error && (fseek(fp, 8, SEEK_SET) != 0 || fwrite(header, 1, 8, fp) != 8))
+			write_error = TRUE;
+		if (fclose(fp) != 0)
+			write_error = TRUE;
+		result = !write_error;
+		recording = FALSE;
+	}
+	else if (playing) {
+		fclose(fp);
+		playing = FALSE;
+	}
+	fp = NULL;
+	free_buffers();
+	return result;
+}
+
+int MOVIE_IsRecording(void)
+{
+	return recording;
+}
+
+int MOVIE_IsPlaying(void)
+{
+	return playing;
+}
+
+void MOVIE_WriteFrame(const MOVIE_tFrame *frame)
+{
+	UBYTE record[FRAME_RECORD_SIZE];
+
+	if (!recording)
+		return;
+	if (MOVIE_snapshot_interval > 0 && MOVIE_frame % MOVIE_snapshot_interval == 0)
+		write_snapshot();
+	record[0] = (UBYTE) frame->key_code;
+	record[1] = (UBYTE) (frame->key_code >> 8);
+	record[2] = (UBYTE) frame->key_shift;
+	record[3] = (UBYTE) frame->key_consol;
+	record[4] = frame->port[0];
+	record[5] = frame->port[1];
+	record[6] = frame->trig;
+	write32(check_screen ? screen_checksum() : 0, record + 7);
+	write_record('F', record, FRAME_RECORD_SIZE);
+	check_screen = TRUE;
+	MOVIE_frame++;
+}
+
+int MOVIE_ReadFrame(MOVIE_tFrame *frame)
+{
+	UBYTE record[FRAME_RECORD_SIZE];
+	int type;
+	ULONG size;
+	ULONG checksum;
+
+	if (!playing)
+		return FALSE;
+	for (;;) {
+		if (!read_record_header(&type, &size) || type == 'I')
+			return FALSE;
+		if (type == 'F' && size == FRAME_RECORD_SIZE)
+			break;
+		/* snapshots are only read by MOVIE_Seek() */
+		if (fseek(fp, (long) size, SEEK_CUR) != 0)
+			return FALSE;
+	}
+	if (fread(record, 1, FRAME_RECORD_SIZE, fp) != FRAME_RECORD_SIZE)
+		return FALSE;
+	frame->key_code = (SWORD) (record[0] + (record[1] << 8));
+	frame->key_shift = record[2];
+	frame->key_consol = record[3];
+	frame->port[0] = record[4];
+	frame->port[1] = record[5];
+	frame->trig = record[6];
+	checksum = read32(record + 7);
+	if (check_screen && checksum != 0 && checksum != screen_checksum()) {
+		Log_print("Movie: screen before frame %d differs from the recording", MOVIE_frame);
+		if (MOVIE_screen_errors++ == 0)
+			MOVIE_first_error_frame = MOVIE_frame;
+	}
+	check_screen = TRUE;
+	MOVIE_frame++;
+	return TRUE;
+}
+
+void MOVIE_WriteInt(int value)
+{
+	UBYTE record[4];
+	if (!recording)
+		return;
+	write32((ULONG) value, record);
+	write_record('V', record, 4);
+}
+
+int MOVIE_ReadInt(void)
+{
+	UBYTE record[4];
+	int type;
+	ULONG size;
+	long offset;
+
+	if (!playing)
+		return 0;
+	offset = ftell(fp);
+	if (!read_record_header(&type, &size) || type != 'V' || size != 4
+	 || fread(record, 1, 4, fp) != 4) {
+		/* leave the record for MOVIE_ReadFrame() */
+		fseek(fp, offset, SEEK_SET);
+		return 0;
+	}
+	return (int) read32(record);
+}
+
+/* Returns the type of the record of the index entry i, or 0 on error. */
+static int index_entry_type(int i)
+{
+	int type;
+	ULONG size;
+	if (fseek(fp, (long) movie_index[i].offset, SEEK_SET) != 0
+	 || !read_record_header(&type, &size))
+		return 0;
+	return type;
+}
+
+/* Reads the snapshot of the index entry i. */
+static int read_snapshot(int i)
+{
+	int type;
+	ULONG size;
+	uLongf unpacked_size;
+
+	if (fseek(fp, (long) movie_index[i].offset, SEEK_SET) != 0
+	 || !read_record_header(&type, &size) || (type != 'S' && type != 'D') || size < 8)
+		return FALSE;
+	if (size > packed_alloc) {
+		packed = (UBYTE *) Util_realloc(packed, size);
+		packed_alloc = size;
+	}
+	if (fread(packed, 1, size, fp) != size)
+		return FALSE;
+	unpacked_size = read32(packed + 4);
+	if (unpacked_size > snapshot_alloc) {
+		snapshot = (UBYTE *) Util_realloc(snapshot, unpacked_size);
+		snapshot_alloc = unpacked_size;
+	}
+	return uncompress(snapshot, &unpacked_size, packed + 8, size - 8) == Z_OK
+		&& StateSav_ReadSnapshot(snapshot, unpacked_size);
+}
+
+void MOVIE_ScreenNotDrawn(void)
+{
+	check_screen = FALSE;
+}
+
+int MOVIE_Seek(int frame)
+{
+	int i;
+	int found = -1;
+	int first;
+
+	if (!playing)
+		return -1;
+	for (i = 0; i < index_count; i++)
+		if (movie_index[i].frame <= (ULONG) frame)
+			found = i;
+	if (found < 0)
+		return -1;
+
+	/* 'D' records apply over the chain since the last 'S' record */
+	for (first = found; first >= 0; first--) {
+		int type = index_entry_type(first);
+		if (type == 'S')
+			break;
+		if (type != 'D')
+			return -1;
+	}
+	if (first < 0)
+		return -1;
+	for (i = first; i <= found; i++)
+		if (!read_snapshot(i))
+			return -1;
+
+	/* the screen is not part of the snapshot */
+	check_screen = FALSE;
+	MOVIE_frame = read32(packed);
+	return MOVIE_frame;
+}
@@ -0,0 +1,65 @@
+#ifndef MOVIE_H_
+#define MOVIE_H_
+
+#include "atari.h"
+
+/* Input movies: a binary recording of the inputs read by INPUT_Frame(),
+   one record per frame, with a snapshot of the machine every
+   MOVIE_snapshot_interval frames and an index of the snapshots at the end.
+   Most snapshots store only the memory pages changed since the previous
+   one; MOVIE_Seek() reads the chain from the last full snapshot.
+   Playback can start at any snapshot (MOVIE_Seek()), so a long movie
+   can be checked in independent segments. */
+
+/* Inputs of one frame. */
+typedef struct {
+	int key_code;
+	int key_shift;
+	int key_consol;
+	UBYTE port[2];  /* PLATFORM_PORT(0) and PLATFORM_PORT(1) */
+	UBYTE trig;     /* bit n = PLATFORM_TRIG(n) */
+} MOVIE_tFrame;
+
+/* Frames between snapshots in new recordings. */
+extern int MOVIE_snapshot_interval;
+
+/* Number of the next frame to be recorded or played back. */
+extern int MOVIE_frame;
+
+/* Number of played back frames whose screen differed from the recording. */
+extern int MOVIE_screen_errors;
+/* The first of them, or -1. */
+extern int MOVIE_first_error_frame;
+
+/* Start recording/playback. Return FALSE on error. */
+int MOVIE_StartRecording(const char *filename);
+int MOVIE_StartPlayback(const char *filename);
+
+/* Finishes the recording or playback. Returns FALSE if a write error
+   occurred. */
+int MOVIE_Stop(void);
+
+int MOVIE_IsRecording(void);
+int MOVIE_IsPlaying(void);
+
+/* Stores/reads the inputs of the current frame. Called once per frame
+   from INPUT_Frame(), before the inputs are applied. Both check the
+   screen of the previous frame. MOVIE_ReadFrame() returns FALSE at the end
+   of the movie. */
+void MOVIE_WriteFrame(const MOVIE_tFrame *frame);
+int MOVIE_ReadFrame(MOVIE_tFrame *frame);
+
+/* Stores/reads a value that doesn't come from the controllers
+   (the POKEY random generator seed). */
+void MOVIE_WriteInt(int value);
+int MOVIE_ReadInt(void);
+
+/* Restores the last snapshot at or before frame and continues playback
+   from there. Returns the frame reached, or -1 on error. */
+int MOVIE_Seek(int frame);
+
+/* Called after a frame that was emulated without drawing Screen_atari
+   (while seeking), so the next MOVIE_ReadFrame() doesn't check it. */
+void MOVIE_ScreenNotDrawn(void);
+
+#endif /* MOVIE_H_ */
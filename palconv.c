@@ -0,0 +1,309 @@
+/*
+ * palconv.c - conversion of the Atari screen to host pixel formats
+ *
+ * Copyright (C) 2026 Atari800 development team (see DOC/CREDITS)
+ *
+ * This file is part of the Atari800 emulator project which emulates
+ * the Atari 400, 800, 800XL, 130XE, and 5200 8-bit computers.
+ *
+ * Atari800 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Atari800 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atari800; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "config.h"
+#include <string.h>
+
+#include "atari.h"
+#include "colours.h"
+#include "palconv.h"
+#include "screen.h"
+
+/* The kernels below read the source four pixels at a time with one aligned
+   32-bit load and build each output word from table lookups, so that
+   a 16-bit or YUY2 pixel pair (or a horizontally doubled pixel) is written
+   with a single 32-bit store. */
+
+#ifdef WORDS_BIGENDIAN
+#define PIXEL(quad, n)        ((quad) >> (24 - 8 * (n)) & 0xff)
+#define PACK16(first, second) (((ULONG) (first) << 16) | (second))
+#define PACK8(b0, b1, b2, b3) (((ULONG) (b0) << 24) | ((ULONG) (b1) << 16) | ((ULONG) (b2) << 8) | (b3))
+#else
+#define PIXEL(quad, n)        ((quad) >> (8 * (n)) & 0xff)
+#define PACK16(first, second) (((ULONG) (second) << 16) | (first))
+#define PACK8(b0, b1, b2, b3) (((ULONG) (b3) << 24) | ((ULONG) (b2) << 16) | ((ULONG) (b1) << 8) | (b0))
+#endif
+
+#define IS_ALIGNED(ptr) (((unsigned long) (ptr) & 3) == 0)
+
+static const int *tables_palette = NULL;
+
+static UWORD rgb565[256];
+static ULONG rgb565_x2[256];	/* the same pixel in both halves */
+static ULONG argb8888[256];
+static UBYTE yuv_y[256];
+static UBYTE yuv_u[256];
+static UBYTE yuv_v[256];
+static ULONG yuy2_x2[256];	/* Y U Y V of one pixel */
+
+int PALCONV_BytesPerPixel(int format)
+{
+	switch (format) {
+	case PALCONV_RGB565:
+	case PALCONV_YUY2:
+		return 2;
+	case PALCONV_ARGB8888:
+		return 4;
+	default:
+		return 1;
+	}
+}
+
+void PALCONV_UpdatePalette(void)
+{
+	int i;
+	for (i = 0; i < 256; i++) {
+		int r = Colours_GetR(i);
+		int g = Colours_GetG(i);
+		int b = Colours_GetB(i);
+		/* ITU-R BT.601, studio swing; the bias keeps the shifted values positive */
+		int y = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+		int u = ((-38 * r - 74 * g + 112 * b + 128 + (128 << 8)) >> 8);
+		int v = ((112 * r - 94 * g - 18 * b + 128 + (128 << 8)) >> 8);
+		rgb565[i] = (UWORD) (((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3));
+		rgb565_x2[i] = ((ULONG) rgb565[i] << 16) | rgb565[i];
+		argb8888[i] = 0xff000000 | (ULONG) Colours_table[i];
+		yuv_y[i] = (UBYTE) y;
+		yuv_u[i] = (UBYTE) u;
+		yuv_v[i] = (UBYTE) v;
+		yuy2_x2[i] = PACK8(y, u, y, v);
+	}
+	tables_palette = Colours_table;
+}
+
+static void line_indexed8(const UBYTE *src, UBYTE *dest, int width)
+{
+	memcpy(dest, src, width);
+}
+
+static void line_indexed8_x2(const UBYTE *src, UBYTE *dest, int width)
+{
+	if (IS_ALIGNED(src) && IS_ALIGNED(dest)) {
+		ULONG *d = (ULONG *) dest;
+		for (; width >= 4; width -= 4) {
+			ULONG quad = *(const ULONG *) src;
+			ULONG p0 = PIXEL(quad, 0);
+			ULONG p1 = PIXEL(quad, 1);
+			ULONG p2 = PIXEL(quad, 2);
+			ULONG p3 = PIXEL(quad, 3);
+			d[0] = PACK8(p0, p0, p1, p1);
+			d[1] = PACK8(p2, p2, p3, p3);
+			d += 2;
+			src += 4;
+		}
+		dest = (UBYTE *) d;
+	}
+	while (width-- > 0) {
+		dest[0] = dest[1] = *src++;
+		dest += 2;
+	}
+}
+
+static void line_rgb565(const UBYTE *src, UWORD *dest, int width)
+{
+	if (IS_ALIGNED(src) && IS_ALIGNED(dest)) {
+		ULONG *d = (ULONG *) dest;
+		for (; width >= 4; width -= 4) {
+			ULONG quad = *(const ULONG *) src;
+			d[0] = PACK16(rgb565[PIXEL(quad, 0)], rgb565[PIXEL(quad, 1)]);
+			d[1] = PACK16(rgb565[PIXEL(quad, 2)], rgb565[PIXEL(quad, 3)]);
+			d += 2;
+			src += 4;
+		}
+		dest = (UWORD *) d;
+	}
+	while (width-- > 0)
+		*dest++ = rgb565[*src++];
+}
+
+static void line_rgb565_x2(const UBYTE *src, UWORD *dest, int width)
+{
+	if (!IS_ALIGNED(dest)) {
+		/* odd destination: fall back to 16-bit stores */
+		while (width-- > 0) {
+			UWORD c = rgb565[*src++];
+			dest[0] = dest[1] = c;
+			dest += 2;
+		}
+		return;
+	}
+	{
+		ULONG *d = (ULONG *) dest;
+		while (width > 0 && !IS_ALIGNED(src)) {
+			*d++ = rgb565_x2[*src++];
+			width--;
+		}
+		for (; width >= 4; width -= 4) {
+			ULONG quad = *(const ULONG *) src;
+			d[0] = rgb565_x2[PIXEL(quad, 0)];
+			d[1] = rgb565_x2[PIXEL(quad, 1)];
+			d[2] = rgb565_x2[PIXEL(quad, 2)];
+			d[3] = rgb565_x2[PIXEL(quad, 3)];
+			d += 4;
+			src += 4;
+		}
+		while (width-- > 0)
+			*d++ = rgb565_x2[*src++];
+	}
+}
+
+static void line_argb8888(const UBYTE *src, ULONG *dest, int width)
+{
+	while (width > 0 && !IS_ALIGNED(src)) {
+		*dest++ = argb8888[*src++];
+		width--;
+	}
+	for (; width >= 4; width -= 4) {
+		ULONG quad = *(const ULONG *) src;
+		dest[0] = argb8888[PIXEL(quad, 0)];
+		dest[1] = argb8888[PIXEL(quad, 1)];
+		dest[2] = argb8888[PIXEL(quad, 2)];
+		dest[3] = argb8888[PIXEL(quad, 3)];
+		dest += 4;
+		src += 4;
+	}
+	while (width-- > 0)
+		*dest++ = argb8888[*src++];
+}
+
+static void line_argb8888_x2(const UBYTE *src, ULONG *dest, int width)
+{
+	while (width > 0 && !IS_ALIGNED(src)) {
+		dest[0] = dest[1] = argb8888[*src++];
+		dest += 2;
+		width--;
+	}
+	for (; width >= 4; width -= 4) {
+		ULONG quad = *(const ULONG *) src;
+		ULONG c;
+		c = argb8888[PIXEL(quad, 0)];
+		dest[0] = c;
+		dest[1] = c;
+		c = argb8888[PIXEL(quad, 1)];
+		dest[2] = c;
+		dest[3] = c;
+		c = argb8888[PIXEL(quad, 2)];
+		dest[4] = c;
+		dest[5] = c;
+		c = argb8888[PIXEL(quad, 3)];
+		dest[6] = c;
+		dest[7] = c;
+		dest += 8;
+		src += 4;
+	}
+	while (width-- > 0) {
+		dest[0] = dest[1] = argb8888[*src++];
+		dest += 2;
+	}
+}
+
+/* width is the number of source pixels and must be even */
+static void line_yuy2(const UBYTE *src, ULONG *dest, int width)
+{
+	if (IS_ALIGNED(src)) {
+		for (; width >= 4; width -= 4) {
+			ULONG quad = *(const ULONG *) src;
+			int a = PIXEL(quad, 0);
+			int b = PIXEL(quad, 1);
+			int c = PIXEL(quad, 2);
+			int d = PIXEL(quad, 3);
+			dest[0] = PACK8(yuv_y[a], (yuv_u[a] + yuv_u[b]) >> 1, yuv_y[b], (yuv_v[a] + yuv_v[b]) >> 1);
+			dest[1] = PACK8(yuv_y[c], (yuv_u[c] + yuv_u[d]) >> 1, yuv_y[d], (yuv_v[c] + yuv_v[d]) >> 1);
+			dest += 2;
+			src += 4;
+		}
+	}
+	for (; width >= 2; width -= 2) {
+		int a = src[0];
+		int b = src[1];
+		*dest++ = PACK8(yuv_y[a], (yuv_u[a] + yuv_u[b]) >> 1, yuv_y[b], (yuv_v[a] + yuv_v[b]) >> 1);
+		src += 2;
+	}
+}
+
+static void line_yuy2_x2(const UBYTE *src, ULONG *dest, int width)
+{
+	while (width > 0 && !IS_ALIGNED(src)) {
+		*dest++ = yuy2_x2[*src++];
+		width--;
+	}
+	for (; width >= 4; width -= 4) {
+		ULONG quad = *(const ULONG *) src;
+		dest[0] = yuy2_x2[PIXEL(quad, 0)];
+		dest[1] = yuy2_x2[PIXEL(quad, 1)];
+		dest[2] = yuy2_x2[PIXEL(quad, 2)];
+		dest[3] = yuy2_x2[PIXEL(quad, 3)];
+		dest += 4;
+		src += 4;
+	}
+	while (width-- > 0)
+		*dest++ = yuy2_x2[*src++];
+}
+
+void PALCONV_Convert(int format, int stretch, const UBYTE *src, int src_pitch,
+                     void *dest, int dest_pitch, int width, int height)
+{
+	UBYTE *d = (UBYTE *) dest;
+
+	if (tables_palette != Colours_table)
+		PALCONV_UpdatePalette();
+
+	for (; height > 0; height--) {
+		switch (format) {
+		case PALCONV_RGB565:
+			if (stretch)
+				line_rgb565_x2(src, (UWORD *) d, width);
+			else
+				line_rgb565(src, (UWORD *) d, width);
+			break;
+		case PALCONV_ARGB8888:
+			if (stretch)
+				line_argb8888_x2(src, (ULONG *) d, width);
+			else
+				line_argb8888(src, (ULONG *) d, width);
+			break;
+		case PALCONV_YUY2:
+			if (stretch)
+				line_yuy2_x2(src, (ULONG *) d, width);
+			else
+				line_yuy2(src, (ULONG *) d, width);
+			break;
+		default:
+			if (stretch)
+				line_indexed8_x2(src, d, width);
+			else
+				line_indexed8(src, d, width);
+			break;
+		}
+		src += src_pitch;
+		d += dest_pitch;
+	}
+}
+
+void PALCONV_ConvertScreen(int format, int stretch, void *dest, int dest_pitch)
+{
+	PALCONV_Convert(format, stretch,
+		(const UBYTE *) Screen_atari + Screen_visible_y1 * Screen_WIDTH + Screen_visible_x1,
+		Screen_WIDTH, dest, dest_pitch,
+		Screen_visible_x2 - Screen_visible_x1, Screen_visible_y2 - Screen_visible_y1);
+}
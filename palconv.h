@@ -0,0 +1,38 @@
+#ifndef PALCONV_H_
+#define PALCONV_H_
+
+#include "atari.h"
+
+/* Conversion of the palette-indexed Screen_atari to host pixel formats.
+   All platforms should use these routines instead of their own per-pixel
+   loops over Colours_table. */
+
+/* Destination pixel formats. */
+#define PALCONV_INDEXED8  0	/* plain copy of the Atari colour codes */
+#define PALCONV_RGB565    1	/* 16-bit 5:6:5, native byte order */
+#define PALCONV_ARGB8888  2	/* 32-bit 0xAARRGGBB, native byte order */
+#define PALCONV_YUY2      3	/* packed Y0 U Y1 V, 2 pixels per 32 bits */
+
+/* Bytes per destination pixel for the given format. */
+int PALCONV_BytesPerPixel(int format);
+
+/* Rebuilds the lookup tables from Colours_table.
+   Switching between PAL and NTSC is detected automatically; call this
+   after modifying the entries of Colours_table in place. */
+void PALCONV_UpdatePalette(void);
+
+/* Converts width x height pixels starting at src (src_pitch bytes per row)
+   into dest (dest_pitch bytes per row). With stretch set every pixel is
+   output twice horizontally, so dest must have room for 2 * width pixels
+   per row. For PALCONV_YUY2 the output width (width, or 2 * width when
+   stretched) must be even. */
+void PALCONV_Convert(int format, int stretch, const UBYTE *src, int src_pitch,
+                     void *dest, int dest_pitch, int width, int height);
+
+/* Converts the visible area of Screen_atari (Screen_visible_x1..x2,
+   Screen_visible_y1..y2) to dest, which then holds
+   (Screen_visible_x2 - Screen_visible_x1) pixels per row, or twice as many
+   with stretch set. */
+void PALCONV_ConvertScreen(int format, int stretch, void *dest, int dest_pitch);
+
+#endif /* PALCONV_H_ */
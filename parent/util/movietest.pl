@@ -0,0 +1,150 @@
+#!/usr/bin/perl -w
+# Regression tester for the Atari800 emulator: plays back input movies
+# recorded with -record in parallel and reports which of them no longer
+# produce the recorded screens.
+use strict;
+use File::Temp qw(tempdir);
+
+# defaults
+my $emulator = './atari800';
+my @emulator_args = ();
+my $jobs = 0;
+my $output = '';
+my @movies = ();
+my $help_me = 0;
+
+for (@ARGV) {
+	if (/^--emulator=(.+)/) {
+		$emulator = $1;
+	}
+	elsif (/^--args=(.*)/) {
+		push @emulator_args, split(' ', $1);
+	}
+	elsif (/^--jobs=(\d+)$/) {
+		$jobs = $1;
+	}
+	elsif (/^--output=(.+)/) {
+		$output = $1;
+	}
+	elsif (/^-?-h(elp)?$/) {
+		$help_me = 1;
+	}
+	elsif (/^-/) {
+		die "Unknown option: $_\n";
+	}
+	else {
+		push @movies, glob $_;
+	}
+}
+
+if (@movies == 0 || $help_me) {
+	print <<EOF;
+movietest.pl plays back Atari800 input movies (see -record) and checks
+that every frame looks the same as when it was recorded.
+The movies are shared among parallel emulator processes, which run
+without display synchronization (-turbo).
+
+Usage: perl movietest.pl [options] MOVIE...
+
+Available options:
+--emulator=<path>     Atari800 executable (default: $emulator)
+--args="<args>"       Additional emulator options, e.g. "-config test.cfg"
+--jobs=<n>            Number of parallel emulators (default: number of CPUs)
+--output=<filename>   Also write the report to the specified file
+
+The exit code is 1 if any movie failed.
+EOF
+	exit;
+}
+
+# number of CPUs
+if ($jobs == 0) {
+	if (open CPUINFO, '/proc/cpuinfo') {
+		$jobs = grep /^processor\s*:/, <CPUINFO>;
+		close CPUINFO;
+	}
+	$jobs ||= $ENV{'NUMBER_OF_PROCESSORS'} || 2;
+}
+
+# no window, no sound device
+$ENV{'SDL_VIDEODRIVER'} = 'dummy';
+$ENV{'SDL_AUDIODRIVER'} = 'dummy';
+
+my $tempdir = tempdir(CLEANUP => 1);
+
+# plays back one movie in a child process,
+# which writes its result to "$tempdir/$index"
+sub start_movie($) {
+	my $index = shift;
+	my $pid = fork;
+	defined $pid or die "fork failed: $!\n";
+	return $pid if $pid;
+
+	my $movie = $movies[$index];
+	my ($frames, $errors, $first) = ('?', '?', -1);
+	my $result = 'ERROR';
+	if (open EMU, '-|') {
+		while (<EMU>) {
+			if (/^Movie finished: (\d+) frames, (\d+) screen errors, first error at frame (-?\d+)/) {
+				($frames, $errors, $first) = ($1, $2, $3);
+			}
+		}
+		close EMU;
+		if ($frames ne '?') {
+			$result = $errors == 0 && $? == 0 ? 'PASS' : 'FAIL';
+		}
+	}
+	else {
+		open STDERR, '>&STDOUT';
+		exec($emulator, @emulator_args, '-turbo', '-playback', $movie)
+			or print "exec $emulator failed: $!\n";
+		exit 1;
+	}
+	open RESULT, ">$tempdir/$index" and print RESULT "$result $frames $errors $first\n" and close RESULT
+		or die "$tempdir/$index: $!\n";
+	exit 0;
+}
+
+print "Playing back ", scalar(@movies), " movies with $jobs parallel emulators\n";
+my $start_time = time;
+my %running = ();
+my $next = 0;
+while ($next < @movies || %running) {
+	while ($next < @movies && keys(%running) < $jobs) {
+		$running{start_movie($next)} = $next;
+		$next++;
+	}
+	my $pid = wait;
+	last if $pid < 0;
+	delete $running{$pid};
+}
+
+# collect the results in the original order
+my @report = ();
+my %count = ('PASS' => 0, 'FAIL' => 0, 'ERROR' => 0);
+for my $index (0 .. $#movies) {
+	my ($result, $frames, $errors, $first) = ('ERROR', '?', '?', -1);
+	if (open RESULT, "$tempdir/$index") {
+		($result, $frames, $errors, $first) = split ' ', <RESULT>;
+		close RESULT;
+	}
+	$count{$result}++;
+	my $line = sprintf '%-5s %s: ', $result, $movies[$index];
+	if ($result eq 'ERROR') {
+		$line .= 'no result from the emulator';
+	}
+	else {
+		$line .= "$frames frames";
+		$line .= ", $errors screen errors, first at frame $first" if $first >= 0;
+		$line .= ', emulator exited with an error' if $result eq 'FAIL' && $first < 0;
+	}
+	push @report, "$line\n";
+}
+push @report, sprintf "%d passed, %d failed, %d errors in %d seconds\n",
+	$count{'PASS'}, $count{'FAIL'}, $count{'ERROR'}, time - $start_time;
+
+print @report;
+if ($output) {
+	open OUT, ">$output" and print OUT @report and close OUT or die "$output: $!\n";
+}
+exit($count{'PASS'} == @movies ? 0 : 1);
@@ -220,7 +220,7 @@ void PBI_D1PutByte(UWORD addr, UBYTE byte)
 		    /* add more devices here... */
 			/* reactivate the floating point rom */
 			if (!fp_active) {
-				memcpy(MEMORY_mem + 0xd800, MEMORY_os + 0x1800, 0x800);
+				MEMORY_dCopyToMem(MEMORY_os + 0x1800, 0xd800, 0x800);
 				D(printf("Floating point rom activated\n"));
 				fp_active = TRUE;
 			}
@@ -258,7 +258,7 @@ void PBI_D6PutByte(UWORD addr, UBYTE byte)
 	}
 #endif
 	/* XLD/1090 has ram here */
-	if (PBI_D6D7ram) MEMORY_mem[addr]=byte;
+	if (PBI_D6D7ram) MEMORY_dPutByte(addr, byte);
 }
 
 /* read page $D7xx */
@@ -275,7 +275,7 @@ UBYTE PBI_D7GetByte(UWORD addr)
 void PBI_D7PutByte(UWORD addr, UBYTE byte)
 {
 	D(printf("PBI_D7PutByte:%4x <- %2x\n",addr,byte));
-	if (PBI_D6D7ram) MEMORY_mem[addr]=byte;
+	if (PBI_D6D7ram) MEMORY_dPutByte(addr, byte);
 }
 
 #ifndef BASIC
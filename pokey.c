@@ -631,6 +631,12 @@ void POKEY_StateSave(void)
 	StateSav_SaveINT(&POKEY_DivNIRQ[0], 4);
 	StateSav_SaveINT(&POKEY_DivNMax[0], 4);
 	StateSav_SaveINT(&POKEY_Base_mult[0], 1);
+
+	/* not in state files, but snapshots must replay RANDOM exactly */
+	if (StateSav_in_memory) {
+		int counter = (int) random_scanline_counter;
+		StateSav_SaveINT(&counter, 1);
+	}
 }
 
 void POKEY_StateRead(void)
@@ -662,6 +668,12 @@ void POKEY_StateRead(void)
 	StateSav_ReadINT(&POKEY_DivNIRQ[0], 4);
 	StateSav_ReadINT(&POKEY_DivNMax[0], 4);
 	StateSav_ReadINT(&POKEY_Base_mult[0], 1);
+
+	if (StateSav_in_memory) {
+		int counter;
+		StateSav_ReadINT(&counter, 1);
+		random_scanline_counter = (ULONG) counter;
+	}
 }
 
 #endif
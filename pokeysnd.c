@@ -30,6 +30,9 @@
 #include "atari.h"
 #ifndef __PLUS
 #include "sndsave.h"
+#if !defined(BASIC) && !defined(CURSES_BASIC)
+#include "vidcap.h"
+#endif
 #else
 #include "sound_win.h"
 #endif
@@ -291,6 +294,9 @@ void POKEYSND_Process(void *sndbuffer, int sndn)
 #endif
 #if !defined(__PLUS) && !defined(ASAP)
 	SndSave_WriteToSoundFile((const unsigned char *)sndbuffer, sndn);
+#if !defined(BASIC) && !defined(CURSES_BASIC)
+	VIDCAP_AddAudio((const UBYTE *) sndbuffer, (POKEYSND_snd_flags & POKEYSND_BIT16) ? sndn << 1 : sndn);
+#endif
 #endif
 }
 
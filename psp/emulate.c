@@ -12,6 +12,7 @@
 #include "pl_perf.h"
 #include "image.h"
 #include "pl_vk.h"
+#include "pl_rewind.h"
 
 #include "cpu.h"
 #include "akey.h"
@@ -21,7 +22,9 @@
 #include "input.h"
 #include "log.h"
 #include "monitor.h"
+#include "palconv.h"
 #include "screen.h"
+#include "statesav.h"
 #include "ui.h"
 #include "util.h"
 
@@ -56,7 +59,9 @@ static pl_perf_counter FpsCounter;
 static pl_vk_layout KeyboardLayout, KeypadLayout;
 static int JoyState[4] =  { 0xff, 0xff, 0xff, 0xff };
 static int TrigState[4] = { 1, 1, 1, 1 };
-static const int ScreenBufferSkip = SCREEN_BUFFER_WIDTH - Screen_WIDTH;
+static pl_rewind Rewinder;
+static int RewindReady;
+static int Rewinding;
 
 PspImage *Screen;
 
@@ -64,6 +69,9 @@ static int ParseInput();
 static void CopyScreenBuffer();
 static void AudioCallback(pl_snd_sample* buf, unsigned int samples, void *userdata);
 static inline void HandleKeyInput(unsigned int code, int on);
+static int GetRewindStateSize();
+static int SaveRewindState(void *state);
+static int LoadRewindState(void *state);
 
 /* Initialize emulation */
 int InitEmulation()
@@ -105,6 +113,10 @@ int InitEmulation()
 
   pl_snd_set_callback(0, AudioCallback, 0);
 
+  /* Initialize rewind history; emulation works without it */
+  RewindReady = pl_rewind_init(&Rewinder,
+    SaveRewindState, LoadRewindState, GetRewindStateSize);
+
   return 1;
 }
 
@@ -115,10 +127,30 @@ void TrashEmulation()
   pl_vk_destroy(&KeyboardLayout);
   pl_vk_destroy(&KeypadLayout);
 
+  if (RewindReady)
+    pl_rewind_destroy(&Rewinder);
+
   pspImageDestroy(Screen);
   Atari800_Exit(FALSE);
 }
 
+/* Rewind states are in-memory snapshots; their size only changes
+   with the machine configuration */
+static int GetRewindStateSize()
+{
+  return (int)StateSav_SaveSnapshot(NULL, 0);
+}
+
+static int SaveRewindState(void *state)
+{
+  return StateSav_SaveSnapshot((UBYTE*)state, Rewinder.state_data_size) != 0;
+}
+
+static int LoadRewindState(void *state)
+{
+  return StateSav_ReadSnapshot((const UBYTE*)state, Rewinder.state_data_size);
+}
+
 int PLATFORM_Initialise(int *argc, char *argv[])
 {
 #ifdef SOUND
@@ -136,17 +168,10 @@ int PLATFORM_Exit(int run_monitor)
 /* Copies the atari screen buffer to the image buffer */
 void CopyScreenBuffer()
 {
-  int i, j;
-  u8 *screen, *image;
-
-  screen = (u8*)Screen_atari;
-  image = (u8*)Screen->Pixels;
-
-  for (i = 0; i < Screen_HEIGHT; i++)
-  {
-    for (j = 0; j < Screen_WIDTH; j++) *image++ = *screen++;
-    image += ScreenBufferSkip;
-  }
+  /* Image is indexed; the GU applies the palette */
+  PALCONV_Convert(PALCONV_INDEXED8, FALSE, (const UBYTE*)Screen_atari,
+    Screen_WIDTH, Screen->Pixels, SCREEN_BUFFER_WIDTH,
+    Screen_WIDTH, Screen_HEIGHT);
 }
 
 void PLATFORM_DisplayScreen(void)
@@ -183,8 +208,8 @@ void PLATFORM_DisplayScreen(void)
 
   pspVideoEnd();
 
-  /* Wait if needed */
-  if (Config.FrameSync)
+  /* Wait if needed (automatic frame skip relies on Atari800_Sync) */
+  if (Config.FrameSync && !Atari800_auto_frameskip)
   {
     do { sceRtcGetCurrentTick(&CurrentTick); }
     while (CurrentTick - LastTick < TicksPerUpdate);
@@ -295,13 +320,24 @@ void RunEmulation()
 
   /* Recompute update frequency */
   TicksPerSecond = sceRtcGetTickResolution();
-  if (Config.FrameSync)
+  if (Config.FrameSync && Config.Frameskip != FRAMESKIP_AUTO)
   {
     TicksPerUpdate = TicksPerSecond
       / ((Atari800_tv_mode == Atari800_TV_NTSC) ? 60 : 50 / (Config.Frameskip + 1));
     sceRtcGetCurrentTick(&LastTick);
   }
   Frame = 0;
+
+  /* Automatic frame skip is done by the core, which then skips
+     drawing as well as displaying */
+  Atari800_auto_frameskip = (Config.Frameskip == FRAMESKIP_AUTO);
+  Atari800_refresh_rate = 1;
+
+  /* The machine may have been reconfigured in the menu */
+  if (RewindReady && GetRewindStateSize() != Rewinder.state_data_size)
+    pl_rewind_realloc(&Rewinder);
+  RewindReady = (Rewinder.buffer != NULL);
+  Rewinding = 0;
 
 #ifdef SOUND
   /* Resume sound */
@@ -314,11 +350,26 @@ void RunEmulation()
     /* Check input */
     if (ParseInput()) break;
 
+    /* Go back one state, or save the current one; the restored state
+       is shown by emulating the frame that follows it */
+    if (RewindReady)
+    {
+      if (Rewinding)
+        pl_rewind_restore(&Rewinder);
+      else
+        pl_rewind_save(&Rewinder);
+    }
+
     /* Process current frame */
     Atari800_Frame();
 
     /* Run the system emulation for a frame */
-    if (++Frame > Config.Frameskip)
+    if (Atari800_auto_frameskip)
+    {
+      if (Atari800_display_screen)
+        PLATFORM_DisplayScreen();
+    }
+    else if (++Frame > Config.Frameskip)
     {
       PLATFORM_DisplayScreen();
       Frame = 0;
@@ -366,6 +417,7 @@ int ParseInput()
   /* Clear keyboard and joystick state */
   JoyState[0] = 0xff;
   TrigState[0] = 1;
+  Rewinding = 0;
 
   if (!KybdVis)
   {
@@ -434,6 +486,9 @@ int ParseInput()
       case META_SHOW_MENU:
         if (on) return 1;
         break;
+      case META_REWIND:
+        if (on) Rewinding = 1;
+        break;
       case META_SHOW_KEYS:
         if (Config.ToggleVK)
         {
@@ -5,6 +5,8 @@
 #define DISPLAY_MODE_FIT_HEIGHT  1
 #define DISPLAY_MODE_FILL_SCREEN 2
 
+#define FRAMESKIP_AUTO -1
+
 int InitEmulation();
 void RunEmulation();
 void TrashEmulation();
@@ -42,6 +44,7 @@ void TrashEmulation();
 
 #define META_SHOW_MENU 1
 #define META_SHOW_KEYS 2
+#define META_REWIND    3
 
 typedef struct
 {
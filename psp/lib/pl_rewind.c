@@ -22,80 +22,272 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "pl_rewind.h"
 
-typedef struct rewind_state
-{
-  void *data;
-  struct rewind_state *prev;
-  struct rewind_state *next;
-} rewind_state_t;
+/* Entry layout in the ring buffer:
+     int length; unsigned char type; <length bytes of RLE data>; int length
+   The trailing length lets us walk from the newest entry backwards */
+#define ENTRY_DELTA    0
+#define ENTRY_KEYFRAME 1
+#define ENTRY_OVERHEAD ((int)(2 * sizeof(int) + 1))
 
 static int get_free_memory();
 
-int pl_rewind_init(pl_rewind *rewind,
-  int (*save_state)(void *),
-  int (*load_state)(void *),
-  int (*get_state_size)())
+/* Worst case size of rle_encode() output */
+static int rle_bound(int size)
 {
-	float memory_needed = (float)get_free_memory() * 0.85;
-  int state_data_size = get_state_size();
-  int state_count = (int)(memory_needed 
-                    / (float)(state_data_size + sizeof(rewind_state_t)));
-
-	if (state_count < 1)
-    return 0;
-
-  /* First state */
-  rewind_state_t *prev, *curr = NULL;
-  if (!(rewind->start = (rewind_state_t*)malloc(sizeof(rewind_state_t))))
-    return 0;
+  return size + 16;
+}
 
-  if (!(rewind->start->data = malloc(state_data_size)))
+static unsigned char* put_varint(unsigned char *out, unsigned int value)
+{
+  while (value >= 0x80)
   {
-    free(rewind->start);
-    rewind->start = NULL;
-    return 0;
+    *out++ = (value & 0x7f) | 0x80;
+    value >>= 7;
   }
+  *out++ = value;
+  return out;
+}
+
+static const unsigned char* get_varint(const unsigned char *in,
+  unsigned int *value)
+{
+  int shift = 0;
+  *value = 0;
+  do
+  {
+    *value |= (unsigned int)(*in & 0x7f) << shift;
+    shift += 7;
+  } while (*in++ & 0x80);
+  return in;
+}
 
-  prev = rewind->start;
+#define RLE_BYTE(i) (b ? a[i] ^ b[i] : a[i])
 
-  /* The rest */
-  int i;
-  for (i = 1; i < state_count; i++)
+/* Encode a as (zero run, literal run, literal bytes) triples, or, if b is
+   not NULL, the XOR of a and b. Runs of fewer than 4 zeroes are kept in
+   the literal so that the output never grows by more than a few bytes */
+static int rle_encode(unsigned char *out, const unsigned char *a,
+  const unsigned char *b, int size)
+{
+  unsigned char *start = out;
+  int pos = 0;
+
+  while (pos < size)
   {
-    /* If allocation fails, compose a shorter state chain */
-    if (!(curr = (rewind_state_t*)malloc(sizeof(rewind_state_t))))
-    {
-      state_count = i + 1;
+    int lit_start, lit_end, i;
+
+    /* Zero run */
+    for (lit_start = pos; lit_start < size; lit_start++)
+      if (RLE_BYTE(lit_start) != 0)
+        break;
+
+    /* Trailing zeroes aren't stored */
+    if (lit_start == size)
       break;
+
+    /* Literal run, up to the next run of 4 zeroes */
+    lit_end = lit_start + 1;
+    while (lit_end < size)
+    {
+      int zeros = 0;
+      while (zeros < 4 && lit_end + zeros < size && RLE_BYTE(lit_end + zeros) == 0)
+        zeros++;
+      if (zeros == 4 || lit_end + zeros == size)
+        break;
+      lit_end += zeros + 1;
     }
 
-    /* If allocation fails, compose a shorter state chain */
-    if (!(curr->data = malloc(state_data_size)))
+    out = put_varint(out, lit_start - pos);
+    out = put_varint(out, lit_end - lit_start);
+    if (b)
+      for (i = lit_start; i < lit_end; i++)
+        *out++ = a[i] ^ b[i];
+    else
     {
-      state_count = i + 1;
-      free(curr);
-      break;
+      memcpy(out, a + lit_start, lit_end - lit_start);
+      out += lit_end - lit_start;
     }
+    pos = lit_end;
+  }
+
+  return out - start;
+}
+
+/* Decode rle_encode() output into dest, or XOR it into dest */
+static void rle_decode(unsigned char *dest, const unsigned char *in,
+  int length, int size, int xor)
+{
+  const unsigned char *end = in + length;
+  int pos = 0;
+
+  while (in < end)
+  {
+    unsigned int zeros, literal, i;
+    in = get_varint(in, &zeros);
+    in = get_varint(in, &literal);
+
+    if (!xor)
+      memset(dest + pos, 0, zeros);
+    pos += zeros;
+
+    if (xor)
+      for (i = 0; i < literal; i++)
+        dest[pos + i] ^= in[i];
+    else
+      memcpy(dest + pos, in, literal);
+    pos += literal;
+    in += literal;
+  }
+
+  if (!xor && pos < size)
+    memset(dest + pos, 0, size - pos);
+}
+
+static int ring_offset(const pl_rewind *rewind, int offset)
+{
+  offset %= rewind->buffer_size;
+  return (offset < 0) ? offset + rewind->buffer_size : offset;
+}
+
+/* Copy to/from the ring buffer, wrapping around */
+static void ring_write(pl_rewind *rewind, int offset, const void *data,
+  int length)
+{
+  int first;
+  offset = ring_offset(rewind, offset);
+  first = rewind->buffer_size - offset;
+  if (first > length)
+    first = length;
+  memcpy(rewind->buffer + offset, data, first);
+  memcpy(rewind->buffer, (const unsigned char*)data + first, length - first);
+}
+
+static void ring_read(const pl_rewind *rewind, int offset, void *data,
+  int length)
+{
+  int first;
+  offset = ring_offset(rewind, offset);
+  first = rewind->buffer_size - offset;
+  if (first > length)
+    first = length;
+  memcpy(data, rewind->buffer + offset, first);
+  memcpy((unsigned char*)data + first, rewind->buffer, length - first);
+}
+
+static void drop_oldest(pl_rewind *rewind)
+{
+  int length;
+  ring_read(rewind, rewind->tail, &length, sizeof(int));
+  rewind->tail = ring_offset(rewind, rewind->tail + length + ENTRY_OVERHEAD);
+  rewind->used -= length + ENTRY_OVERHEAD;
+  rewind->state_count--;
+}
 
-    prev->next = curr;
-    curr->prev = prev;
-    prev = curr;
+static void push_entry(pl_rewind *rewind, unsigned char type,
+  const void *data, int length)
+{
+  int offset = rewind->head;
+
+  while (rewind->used + length + ENTRY_OVERHEAD > rewind->buffer_size)
+    drop_oldest(rewind);
+
+  ring_write(rewind, offset, &length, sizeof(int));
+  ring_write(rewind, offset + sizeof(int), &type, 1);
+  ring_write(rewind, offset + sizeof(int) + 1, data, length);
+  ring_write(rewind, offset + sizeof(int) + 1 + length, &length, sizeof(int));
+
+  rewind->head = ring_offset(rewind, offset + length + ENTRY_OVERHEAD);
+  rewind->used += length + ENTRY_OVERHEAD;
+  rewind->state_count++;
+}
+
+/* Replace the current state with the one steps entries back */
+static void pop_entries(pl_rewind *rewind, int steps)
+{
+  int offsets[PL_REWIND_KEYFRAME_INTERVAL];
+  int lengths[PL_REWIND_KEYFRAME_INTERVAL];
+  unsigned char types[PL_REWIND_KEYFRAME_INTERVAL];
+  int count = 0, i;
+
+  /* Walk back from the newest entry; a keyframe makes the newer
+     entries unnecessary, and there is one at least every
+     PL_REWIND_KEYFRAME_INTERVAL entries */
+  for (i = 0; i < steps; i++)
+  {
+    int length;
+    unsigned char type;
+
+    ring_read(rewind, rewind->head - sizeof(int), &length, sizeof(int));
+    rewind->head = ring_offset(rewind, rewind->head - length - ENTRY_OVERHEAD);
+    rewind->used -= length + ENTRY_OVERHEAD;
+    rewind->state_count--;
+
+    ring_read(rewind, rewind->head + sizeof(int), &type, 1);
+    if (type == ENTRY_KEYFRAME)
+      count = 0;
+    offsets[count] = rewind->head;
+    lengths[count] = length;
+    types[count] = type;
+    count++;
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    unsigned char *encoded = (unsigned char*)rewind->encoded;
+    ring_read(rewind, offsets[i] + sizeof(int) + 1, encoded, lengths[i]);
+    rle_decode((unsigned char*)rewind->current, encoded, lengths[i],
+      rewind->state_data_size, types[i] == ENTRY_DELTA);
+  }
+
+  /* The entries left may go back up to a whole interval without a
+     keyframe, so start the next interval with one */
+  rewind->since_keyframe = PL_REWIND_KEYFRAME_INTERVAL - 1;
+}
+
+int pl_rewind_init(pl_rewind *rewind,
+  int (*save_state)(void *),
+  int (*load_state)(void *),
+  int (*get_state_size)())
+{
+  int state_data_size = get_state_size();
+  int buffer_size = (int)((float)get_free_memory() * 0.85)
+                    - 2 * state_data_size - rle_bound(state_data_size);
+
+  /* Ring buffer should hold at least a few keyframes */
+  if (buffer_size < 4 * (rle_bound(state_data_size) + ENTRY_OVERHEAD))
+    return 0;
+
+  rewind->current = malloc(state_data_size);
+  rewind->scratch = malloc(state_data_size);
+  rewind->encoded = malloc(rle_bound(state_data_size));
+  rewind->buffer = NULL;
+
+  /* If allocation fails, use a smaller buffer */
+  if (rewind->current && rewind->scratch && rewind->encoded)
+  {
+    for (; buffer_size >= 4 * (rle_bound(state_data_size) + ENTRY_OVERHEAD);
+         buffer_size -= buffer_size / 8)
+      if ((rewind->buffer = (unsigned char*)malloc(buffer_size)))
+        break;
   }
 
-  /* Make circular */
-  rewind->start->prev = prev;
-  curr->next = rewind->start;
+  if (!rewind->buffer)
+  {
+    pl_rewind_destroy(rewind);
+    return 0;
+  }
 
   /* Init structure */
-  rewind->current = NULL;
+  rewind->buffer_size = buffer_size;
   rewind->save_state = save_state;
   rewind->load_state = load_state;
   rewind->get_state_size = get_state_size;
   rewind->state_data_size = state_data_size;
-  rewind->state_count = state_count;
+  pl_rewind_reset(rewind);
 
   return 1;
 }
@@ -111,52 +303,84 @@ void pl_rewind_realloc(pl_rewind *rewind)
 
 void pl_rewind_destroy(pl_rewind *rewind)
 {
-  rewind->start->prev->next = NULL; /* Prevent infinite loop */
-	rewind_state_t *curr, *next;
-
-  for (curr = rewind->start; curr; curr = next)
-  {
-    next = curr->next;
-    free(curr->data);
-    free(curr);
-  }
-
-  rewind->start = NULL;
+  free(rewind->buffer);
+  free(rewind->encoded);
+  free(rewind->scratch);
+  free(rewind->current);
+
+  rewind->buffer = NULL;
+  rewind->encoded = NULL;
+  rewind->scratch = NULL;
   rewind->current = NULL;
+  rewind->state_count = 0;
+  rewind->have_current = 0;
 }
 
 void pl_rewind_reset(pl_rewind *rewind)
 {
-  rewind->current = NULL;
+  rewind->head = rewind->tail = rewind->used = 0;
+  rewind->state_count = 0;
+  rewind->since_keyframe = 0;
+  rewind->have_current = 0;
 }
 
 int pl_rewind_save(pl_rewind *rewind)
 {
-  rewind_state_t *save_slot = 
-    (rewind->current) ? rewind->current->next
-                      : rewind->start;
+  unsigned char *state = (unsigned char*)rewind->scratch;
+  unsigned char *encoded = (unsigned char*)rewind->encoded;
+  int length;
 
-	if (!rewind->save_state(save_slot->data))
-    return 0;
+  if (!rewind->have_current)
+  {
+    if (!rewind->save_state(rewind->current))
+      return 0;
+    rewind->have_current = 1;
+    rewind->state_count = 1;
+    return 1;
+  }
 
-	rewind->current = save_slot;
+  if (!rewind->save_state(state))
+    return 0;
 
-  /* Move starting point forward, if we've reached the start node */
-  if (save_slot->next == rewind->start)
-    rewind->start = rewind->start->next;
+  /* Store the previous state as a delta against the new one */
+  if (rewind->since_keyframe + 1 >= PL_REWIND_KEYFRAME_INTERVAL)
+  {
+    length = rle_encode(encoded, rewind->current, NULL,
+      rewind->state_data_size);
+    push_entry(rewind, ENTRY_KEYFRAME, encoded, length);
+    rewind->since_keyframe = 0;
+  }
+  else
+  {
+    length = rle_encode(encoded, rewind->current, state,
+      rewind->state_data_size);
+    push_entry(rewind, ENTRY_DELTA, encoded, length);
+    rewind->since_keyframe++;
+  }
 
+  memcpy(rewind->current, state, rewind->state_data_size);
   return 1;
 }
 
 int pl_rewind_restore(pl_rewind *rewind)
 {
-  rewind_state_t *load_slot = rewind->current;
-  if (!(load_slot && rewind->load_state(load_slot->data)))
+  return pl_rewind_restore_steps(rewind, 1);
+}
+
+int pl_rewind_restore_steps(pl_rewind *rewind, int steps)
+{
+  if (!rewind->have_current || steps < 1)
     return 0;
 
   /* Can't go past the starting point */
-  if (load_slot != rewind->start)
-    rewind->current = rewind->current->prev;
+  if (steps > rewind->state_count)
+    steps = rewind->state_count;
+
+  pop_entries(rewind, steps - 1);
+  if (!rewind->load_state(rewind->current))
+    return 0;
+  if (rewind->state_count > 1)
+    pop_entries(rewind, 1);
 
   return 1;
 }
@@ -27,14 +27,26 @@
 extern "C" {
 #endif
 
-struct rewind_state;
+/* The newest state is kept as is; older states are kept in a ring buffer
+   as RLE-coded XOR deltas against the next newer state, with a full
+   (RLE-coded) keyframe every PL_REWIND_KEYFRAME_INTERVAL states to bound
+   the cost of going back several states at once */
+#define PL_REWIND_KEYFRAME_INTERVAL 60
 
 typedef struct
 {
   int state_data_size;
   int state_count;
-  struct rewind_state *start;
-  struct rewind_state *current;
+  void *current;      /* newest saved state */
+  void *scratch;      /* new state */
+  void *encoded;      /* entry being coded/decoded */
+  unsigned char *buffer;
+  int buffer_size;
+  int head;           /* offset past the newest entry */
+  int tail;           /* offset of the oldest entry */
+  int used;
+  int since_keyframe;
+  int have_current;
   int (*save_state)(void *);
   int (*load_state)(void *);
   int (*get_state_size)();
@@ -49,6 +61,9 @@ void pl_rewind_destroy(pl_rewind *rewind);
 void pl_rewind_reset(pl_rewind *rewind);
 int  pl_rewind_save(pl_rewind *rewind);
 int  pl_rewind_restore(pl_rewind *rewind);
+/* Same as calling pl_rewind_restore() steps times, but only the last
+   state is loaded */
+int  pl_rewind_restore_steps(pl_rewind *rewind, int steps);
 
 #ifdef __cplusplus
 }
@@ -213,6 +213,7 @@ PL_MENU_OPTIONS_BEGIN(ControlModeOptions)
   PL_MENU_OPTION("\026\241\020 cancels, \026\242\020 confirms (Japan)", 1)
 PL_MENU_OPTIONS_END
 PL_MENU_OPTIONS_BEGIN(FrameSkipOptions)
+  PL_MENU_OPTION("Auto",         FRAMESKIP_AUTO)
   PL_MENU_OPTION("No skipping",  0)
   PL_MENU_OPTION("Skip 1 frame", 1)
   PL_MENU_OPTION("Skip 2 frame", 2)
@@ -250,6 +251,7 @@ PL_MENU_OPTIONS_BEGIN(ComputerButtonMapOptions)
   /* Special keys */
   PL_MENU_OPTION("Special: Open Menu",     MET|META_SHOW_MENU)
   PL_MENU_OPTION("Special: Show Keyboard", MET|META_SHOW_KEYS)
+  PL_MENU_OPTION("Special: Rewind",        MET|META_REWIND)
   /* Console */
   PL_MENU_OPTION("Console: Reset",  SPC|-AKEY_WARMSTART)
   PL_MENU_OPTION("Console: Option", CSL|INPUT_CONSOL_OPTION)
@@ -320,6 +322,7 @@ PL_MENU_OPTIONS_BEGIN(ConsoleButtonMapOptions)
   /* Special keys */
   PL_MENU_OPTION("Special: Open Menu",     MET|META_SHOW_MENU)
   PL_MENU_OPTION("Special: Show Keyboard", MET|META_SHOW_KEYS)
+  PL_MENU_OPTION("Special: Rewind",        MET|META_REWIND)
   /* Console */
   PL_MENU_OPTION("Console: Start", KBD|AKEY_5200_START)
   PL_MENU_OPTION("Console: Pause", KBD|AKEY_5200_PAUSE)
@@ -1414,39 +1417,44 @@ int LoadState(const char *path)
   return StateSav_ReadAtariState(path, "r");
 }
 
+/* Append thumbnail to state file (called by the worker thread) */
+static int SaveStateIcon(FILE *f, void *arg)
+{
+  PspImage *thumb = (PspImage*)arg;
+  long pos = ftell(f);
+
+  /* Write the thumbnail */
+  int ok = pspImageSavePngFd(f, thumb);
+
+  /* Write the position of the icon */
+  if (ok && fwrite(&pos, sizeof(long), 1, f) != 1)
+    ok = 0;
+
+  pspImageDestroy(thumb);
+  return ok;
+}
+
 /* Save state */
 PspImage* SaveState(const char *path, PspImage *icon)
 {
-  /* Save state */
-  if (!StateSav_SaveAtariState(path, "w", 1))
-    return NULL;
-
-  /* Create thumbnail */
+  /* Create thumbnails: one for the gallery, one for the file */
   PspImage *thumb = pspImageCreateThumbnail(icon);
   if (!thumb) return NULL;
-
-  /* Reopen file in append mode */
-  FILE *f = fopen(path, "a");
-  if (!f)
+  PspImage *file_thumb = pspImageCreateThumbnail(icon);
+  if (!file_thumb)
   {
     pspImageDestroy(thumb);
     return NULL;
   }
 
-  long pos = ftell(f);
-
-  /* Write the thumbnail */
-  if (!pspImageSavePngFd(f, thumb))
+  /* Save state; compressed and written in the background */
+  if (!StateSav_SaveAtariStateAsync(path, "w", 1, SaveStateIcon, file_thumb))
   {
+    pspImageDestroy(file_thumb);
     pspImageDestroy(thumb);
-    fclose(f);
     return NULL;
   }
 
-  /* Write the position of the icon */
-  fwrite(&pos, sizeof(long), 1, f);
-
-  fclose(f);
   return thumb;
 }
 
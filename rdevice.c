@@ -937,6 +937,14 @@ void RDevice_OPEN(void)
   int  direction;
   int  devnum;
 
+  /* a connection made during run-ahead would outlive the snapshot */
+  if(Atari800_speculating)
+  {
+    CPU_regY = 138; /* device timeout */
+    CPU_SetN;
+    return;
+  }
+
   CPU_regA = 1;
   CPU_regY = 1;
   CPU_ClrN;
@@ -1447,6 +1455,11 @@ void RDevice_INIT(void)
   CPU_ClrN;
 }
 
+int RDevice_IsOpen(void)
+{
+  return connected != 0 || concurrent != 0;
+}
+
 void RDevice_Exit(void)
 {
 #ifdef WIN32
@@ -38,4 +38,7 @@ extern char RDevice_serial_device[];
 
 extern void RDevice_Exit(void);
 
+/* Returns TRUE while a connection or the serial device is open. */
+extern int RDevice_IsOpen(void);
+
 #endif /* RDEVICE_H_ */
@@ -38,10 +38,15 @@
 #include "screen.h"
 #include "sio.h"
 #include "util.h"
+#include "worker.h"
 
 #define ATARI_VISIBLE_WIDTH 336
 #define ATARI_LEFT_MARGIN 24
 
+/* Screenshots are copied into one of these buffers and encoded
+   by the worker thread. */
+#define SCREENSHOT_BUFFERS 4
+
 ULONG *Screen_atari = NULL;
 #ifdef DIRTYRECT
 UBYTE *Screen_dirty = NULL;
@@ -67,6 +72,7 @@ int Screen_visible_y2 = Screen_HEIGHT;	/* 0 .. Screen_HEIGHT */
 int Screen_show_atari_speed = FALSE;
 int Screen_show_disk_led = TRUE;
 int Screen_show_sector_counter = FALSE;
+int Screen_auto_screenshot_interval = 0;
 
 #ifdef HAVE_LIBPNG
 #define DEFAULT_SCREENSHOT_FILENAME_FORMAT "atari%03d.png"
@@ -76,6 +82,19 @@ int Screen_show_sector_counter = FALSE;
 
 static char screenshot_filename_format[FILENAME_MAX] = DEFAULT_SCREENSHOT_FILENAME_FORMAT;
 static int screenshot_no_max = 1000;
+static int auto_screenshot_counter = 0;
+
+typedef struct {
+	FILE *fp;
+	int is_png;
+	int interlaced;
+	int busy;
+	int palette[256];
+	UBYTE pixels1[ATARI_VISIBLE_WIDTH * Screen_HEIGHT];
+	UBYTE pixels2[ATARI_VISIBLE_WIDTH * Screen_HEIGHT];
+} screenshot_job;
+
+static screenshot_job *screenshot_jobs = NULL;
 
 /* converts "foo%bar##.pcx" to "foo%%bar%02d.pcx" */
 static void Screen_SetScreenshotFilenamePattern(const char *p)
@@ -130,13 +149,19 @@ int Screen_Initialise(int *argc, char *argv[])
 				Screen_SetScreenshotFilenamePattern(argv[++i]);
 			else a_m = TRUE;
 		}
-		if (strcmp(argv[i], "-showspeed") == 0) {
+		else if (strcmp(argv[i], "-autoscreenshot") == 0) {
+			if (i_a)
+				Screen_auto_screenshot_interval = Util_sscandec(argv[++i]);
+			else a_m = TRUE;
+		}
+		else if (strcmp(argv[i], "-showspeed") == 0) {
 			Screen_show_atari_speed = TRUE;
 		}
 		else {
 			if (strcmp(argv[i], "-help") == 0) {
 				help_only = TRUE;
 				Log_print("\t-screenshots <p> Set filename pattern for screenshots");
+				Log_print("\t-autoscreenshot <n> Save a screenshot every n frames");
 				Log_print("\t-showspeed       Show percentage of actual speed");
 			}
 			argv[j++] = argv[i];
@@ -383,7 +408,12 @@ static void fputw(int x, FILE *fp)
 	fputc(x >> 8, fp);
 }
 
-static void Screen_SavePCX(FILE *fp, UBYTE *ptr1, UBYTE *ptr2)
+#define PALETTE_R(x) ((UBYTE) (palette[x] >> 16))
+#define PALETTE_G(x) ((UBYTE) (palette[x] >> 8))
+#define PALETTE_B(x) ((UBYTE) palette[x])
+
+/* ptr1 and ptr2 point to ATARI_VISIBLE_WIDTH x Screen_HEIGHT color codes. */
+static void Screen_SavePCX(FILE *fp, const UBYTE *ptr1, const UBYTE *ptr2, const int *palette)
 {
 	int i;
 	int x;
@@ -416,7 +446,7 @@ static void Screen_SavePCX(FILE *fp, UBYTE *ptr1, UBYTE *ptr2)
 	for (y = 0; y < Screen_HEIGHT; ) {
 		x = 0;
 		do {
-			last = ptr2 != NULL ? (((Colours_table[*ptr1] >> plane) & 0xff) + ((Colours_table[*ptr2] >> plane) & 0xff)) >> 1 : *ptr1;
+			last = ptr2 != NULL ? (((palette[*ptr1] >> plane) & 0xff) + ((palette[*ptr2] >> plane) & 0xff)) >> 1 : *ptr1;
 			count = 0xc0;
 			do {
 				ptr1++;
@@ -424,8 +454,8 @@ static void Screen_SavePCX(FILE *fp, UBYTE *ptr1, UBYTE *ptr2)
 					ptr2++;
 				count++;
 				x++;
-			} while (last == (ptr2 != NULL ? (((Colours_table[*ptr1] >> plane) & 0xff) + ((Colours_table[*ptr2] >> plane) & 0xff)) >> 1 : *ptr1)
-						&& count < 0xff && x < ATARI_VISIBLE_WIDTH);
+			} while (x < ATARI_VISIBLE_WIDTH && count < 0xff
+						&& last == (ptr2 != NULL ? (((palette[*ptr1] >> plane) & 0xff) + ((palette[*ptr2] >> plane) & 0xff)) >> 1 : *ptr1));
 			if (count > 0xc1 || last >= 0xc0)
 				fputc(count, fp);
 			fputc(last, fp);
@@ -437,11 +467,8 @@ static void Screen_SavePCX(FILE *fp, UBYTE *ptr1, UBYTE *ptr2)
 			plane -= 8;
 		}
 		else {
-			ptr1 += Screen_WIDTH - ATARI_VISIBLE_WIDTH;
-			if (ptr2 != NULL) {
-				ptr2 += Screen_WIDTH - ATARI_VISIBLE_WIDTH;
+			if (ptr2 != NULL)
 				plane = 16;
-			}
 			y++;
 		}
 	}
@@ -450,9 +477,9 @@ static void Screen_SavePCX(FILE *fp, UBYTE *ptr1, UBYTE *ptr2)
 		/* write palette */
 		fputc(0xc, fp);
 		for (i = 0; i < 256; i++) {
-			fputc(Colours_GetR(i), fp);
-			fputc(Colours_GetG(i), fp);
-			fputc(Colours_GetB(i), fp);
+			fputc(PALETTE_R(i), fp);
+			fputc(PALETTE_G(i), fp);
+			fputc(PALETTE_B(i), fp);
 		}
 	}
 }
@@ -467,7 +494,7 @@ static int striendswith(const char *s1, const char *s2)
 }
 
 #ifdef HAVE_LIBPNG
-static void Screen_SavePNG(FILE *fp, UBYTE *ptr1, UBYTE *ptr2)
+static void Screen_SavePNG(FILE *fp, const UBYTE *ptr1, const UBYTE *ptr2, const int *palette)
 {
 	png_structp png_ptr;
 	png_infop info_ptr;
@@ -492,16 +519,16 @@ static void Screen_SavePNG(FILE *fp, UBYTE *ptr1, UBYTE *ptr2)
 	);
 	if (ptr2 == NULL) {
 		int i;
-		png_color palette[256];
+		png_color png_palette[256];
 		for (i = 0; i < 256; i++) {
-			palette[i].red = Colours_GetR(i);
-			palette[i].green = Colours_GetG(i);
-			palette[i].blue = Colours_GetB(i);
+			png_palette[i].red = PALETTE_R(i);
+			png_palette[i].green = PALETTE_G(i);
+			png_palette[i].blue = PALETTE_B(i);
 		}
-		png_set_PLTE(png_ptr, info_ptr, palette, 256);
+		png_set_PLTE(png_ptr, info_ptr, png_palette, 256);
 		for (i = 0; i < Screen_HEIGHT; i++) {
-			rows[i] = ptr1;
-			ptr1 += Screen_WIDTH;
+			rows[i] = (png_bytep) ptr1;
+			ptr1 += ATARI_VISIBLE_WIDTH;
 		}
 	}
 	else {
@@ -512,14 +539,12 @@ static void Screen_SavePNG(FILE *fp, UBYTE *ptr1, UBYTE *ptr2)
 		for (y = 0; y < Screen_HEIGHT; y++) {
 			rows[y] = ptr3;
 			for (x = 0; x < ATARI_VISIBLE_WIDTH; x++) {
-				*ptr3++ = (png_byte) ((Colours_GetR(*ptr1) + Colours_GetR(*ptr2)) >> 1);
-				*ptr3++ = (png_byte) ((Colours_GetG(*ptr1) + Colours_GetG(*ptr2)) >> 1);
-				*ptr3++ = (png_byte) ((Colours_GetB(*ptr1) + Colours_GetB(*ptr2)) >> 1);
+				*ptr3++ = (png_byte) ((PALETTE_R(*ptr1) + PALETTE_R(*ptr2)) >> 1);
+				*ptr3++ = (png_byte) ((PALETTE_G(*ptr1) + PALETTE_G(*ptr2)) >> 1);
+				*ptr3++ = (png_byte) ((PALETTE_B(*ptr1) + PALETTE_B(*ptr2)) >> 1);
 				ptr1++;
 				ptr2++;
 			}
-			ptr1 += Screen_WIDTH - ATARI_VISIBLE_WIDTH;
-			ptr2 += Screen_WIDTH - ATARI_VISIBLE_WIDTH;
 		}
 	}
 	png_set_rows(png_ptr, info_ptr, rows);
@@ -530,13 +555,63 @@ static void Screen_SavePNG(FILE *fp, UBYTE *ptr1, UBYTE *ptr2)
 }
 #endif /* HAVE_LIBPNG */
 
+/* Runs on the worker thread. */
+static void Screen_EncodeScreenshot(void *arg)
+{
+	screenshot_job *job = (screenshot_job *) arg;
+	const UBYTE *ptr2 = job->interlaced ? job->pixels2 : NULL;
+#ifdef HAVE_LIBPNG
+	if (job->is_png)
+		Screen_SavePNG(job->fp, job->pixels1, ptr2, job->palette);
+	else
+#endif
+		Screen_SavePCX(job->fp, job->pixels1, ptr2, job->palette);
+	fclose(job->fp);
+	WORKER_Lock();
+	job->busy = FALSE;
+	WORKER_Unlock();
+}
+
+/* Returns a free buffer, waiting for the encoder if all are in use. */
+static screenshot_job *Screen_GetScreenshotJob(void)
+{
+	int i;
+	if (screenshot_jobs == NULL) {
+		screenshot_jobs = (screenshot_job *) Util_malloc(SCREENSHOT_BUFFERS * sizeof(screenshot_job));
+		for (i = 0; i < SCREENSHOT_BUFFERS; i++)
+			screenshot_jobs[i].busy = FALSE;
+	}
+	for (;;) {
+		WORKER_Lock();
+		for (i = 0; i < SCREENSHOT_BUFFERS; i++) {
+			if (!screenshot_jobs[i].busy) {
+				screenshot_jobs[i].busy = TRUE;
+				WORKER_Unlock();
+				return &screenshot_jobs[i];
+			}
+		}
+		WORKER_Unlock();
+		WORKER_Flush();
+	}
+}
+
+static void Screen_CopyVisible(UBYTE *dest)
+{
+	const UBYTE *src = (const UBYTE *) Screen_atari + ATARI_LEFT_MARGIN;
+	int y;
+	for (y = 0; y < Screen_HEIGHT; y++) {
+		memcpy(dest, src, ATARI_VISIBLE_WIDTH);
+		src += Screen_WIDTH;
+		dest += ATARI_VISIBLE_WIDTH;
+	}
+}
+
 int Screen_SaveScreenshot(const char *filename, int interlaced)
 {
 	int is_png;
 	FILE *fp;
 	ULONG *main_screen_atari;
-	UBYTE *ptr1;
-	UBYTE *ptr2;
+	screenshot_job *job;
 	if (striendswith(filename, ".pcx"))
 		is_png = 0;
 #ifdef HAVE_LIBPNG
@@ -548,27 +623,22 @@ int Screen_SaveScreenshot(const char *filename, int interlaced)
 	fp = fopen(filename, "wb");
 	if (fp == NULL)
 		return FALSE;
-	main_screen_atari = Screen_atari;
-	ptr1 = (UBYTE *) Screen_atari + ATARI_LEFT_MARGIN;
+	job = Screen_GetScreenshotJob();
+	job->fp = fp;
+	job->is_png = is_png;
+	job->interlaced = interlaced;
+	memcpy(job->palette, Colours_table, sizeof(job->palette));
+	Screen_CopyVisible(job->pixels1);
 	if (interlaced) {
+		main_screen_atari = Screen_atari;
 		Screen_atari = (ULONG *) Util_malloc(Screen_WIDTH * Screen_HEIGHT);
-		ptr2 = (UBYTE *) Screen_atari + ATARI_LEFT_MARGIN;
 		ANTIC_Frame(TRUE); /* draw on Screen_atari */
-	}
-	else {
-		ptr2 = NULL;
-	}
-#ifdef HAVE_LIBPNG
-	if (is_png)
-		Screen_SavePNG(fp, ptr1, ptr2);
-	else
-#endif
-		Screen_SavePCX(fp, ptr1, ptr2);
-	fclose(fp);
-	if (interlaced) {
+		Screen_CopyVisible(job->pixels2);
 		free(Screen_atari);
 		Screen_atari = main_screen_atari;
 	}
+	if (!WORKER_Submit(Screen_EncodeScreenshot, job))
+		Screen_EncodeScreenshot(job); /* job queue full */
 	return TRUE;
 }
 
@@ -579,6 +649,16 @@ void Screen_SaveNextScreenshot(int interlaced)
 	Screen_SaveScreenshot(filename, interlaced);
 }
 
+int Screen_AutoScreenshotDue(void)
+{
+	if (Screen_auto_screenshot_interval <= 0)
+		return FALSE;
+	if (++auto_screenshot_counter < Screen_auto_screenshot_interval)
+		return FALSE;
+	auto_screenshot_counter = 0;
+	return TRUE;
+}
+
 void Screen_EntireDirty(void)
 {
 #ifdef DIRTYRECT
@@ -34,12 +34,20 @@ extern int Screen_show_atari_speed;
 extern int Screen_show_disk_led;
 extern int Screen_show_sector_counter;
 
+/* Save a screenshot every Screen_auto_screenshot_interval frames (0 = never). */
+extern int Screen_auto_screenshot_interval;
+
 int Screen_Initialise(int *argc, char *argv[]);
 void Screen_DrawAtariSpeed(double);
 void Screen_DrawDiskLED(void);
 void Screen_FindScreenshotFilename(char *buffer);
+/* The screen is copied immediately and the file is written in the background
+   (see worker.h). Returns FALSE if the file cannot be created. */
 int Screen_SaveScreenshot(const char *filename, int interlaced);
 void Screen_SaveNextScreenshot(int interlaced);
+/* Called once per frame. Returns TRUE if this frame must be drawn
+   and passed to Screen_SaveNextScreenshot(). */
+int Screen_AutoScreenshotDue(void);
 void Screen_EntireDirty(void);
 
 #endif /* SCREEN_H_ */
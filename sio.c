@@ -26,6 +26,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(HAVE_FSYNC) && defined(HAVE_UNISTD_H)
+#include <unistd.h> /* fsync */
+#endif
 
 #include "afile.h"
 #include "antic.h"  /* ANTIC_ypos */
@@ -42,6 +45,7 @@
 #include "pokeysnd.h"
 #include "sio.h"
 #include "util.h"
+#include "worker.h"
 #ifndef BASIC
 #include "statesav.h"
 #endif
@@ -78,6 +82,21 @@ typedef struct tagpro_additional_info_t {
 } pro_additional_info_t;
 static void *additional_info[SIO_MAX_DRIVES];
 
+/* The images are loaded into memory when mounted, so that sector I/O
+   doesn't need any system calls. Written sectors are marked in
+   dirty_sectors[] and written back to the still open file after
+   FLUSH_DELAY frames without writes, and when the disk is dismounted.
+   If an image doesn't fit in memory, the file is accessed directly. */
+static UBYTE *image[SIO_MAX_DRIVES];
+static ULONG image_size[SIO_MAX_DRIVES];
+static UBYTE *dirty_sectors[SIO_MAX_DRIVES];
+static int image_dirty[SIO_MAX_DRIVES];
+#define FLUSH_DELAY 50
+static int flush_delay = 0;
+static void LoadImage(int unit);
+static void FlushImage(int unit);
+static void RecoverJournal(FILE *fp, const char *filename);
+
 SIO_UnitStatus SIO_drive_status[SIO_MAX_DRIVES];
 char SIO_filename[SIO_MAX_DRIVES][FILENAME_MAX];
 
@@ -135,6 +154,9 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 	FILE *f = NULL;
 	SIO_UnitStatus status = SIO_READ_WRITE;
 	struct AFILE_ATR_Header header;
+	/* decompressed image */
+	UBYTE *data = NULL;
+	ULONG data_size = 0;
 
 	/* avoid overruns in SIO_filename[] */
 	if (strlen(filename) >= FILENAME_MAX)
@@ -159,55 +181,42 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 		return FALSE;
 	}
 
-	/* detect compressed image and uncompress */
+	/* detect compressed image and uncompress it to memory;
+	   the compressed file stays open, but is not accessed any more */
 	switch (header.magic1) {
 	case 0xf9:
 	case 0xfa:
 		/* DCM */
-		{
-			FILE *f2 = Util_tmpopen(sio_tmpbuf[diskno - 1]);
-			if (f2 == NULL)
-				return FALSE;
-			Util_rewind(f);
-			if (!CompFile_DCMtoATR(f, f2)) {
-				Util_fclose(f2, sio_tmpbuf[diskno - 1]);
-				fclose(f);
-				return FALSE;
-			}
-			fclose(f);
-			f = f2;
-		}
 		Util_rewind(f);
-		if (fread(&header, 1, sizeof(struct AFILE_ATR_Header), f) != sizeof(struct AFILE_ATR_Header)) {
-			Util_fclose(f, sio_tmpbuf[diskno - 1]);
+		data = CompFile_DCMtoATRMemory(f, &data_size);
+		if (data == NULL) {
+			fclose(f);
 			return FALSE;
 		}
-		status = SIO_READ_ONLY;
-		/* XXX: status = b_open_readonly ? SIO_READ_ONLY : SIO_READ_WRITE; */
 		break;
 	case 0x1f:
 		if (header.magic2 == 0x8b) {
 			/* ATZ/ATR.GZ, XFZ/XFD.GZ */
-			fclose(f);
-			f = Util_tmpopen(sio_tmpbuf[diskno - 1]);
-			if (f == NULL)
-				return FALSE;
-			if (!CompFile_ExtractGZ(filename, f)) {
-				Util_fclose(f, sio_tmpbuf[diskno - 1]);
-				return FALSE;
-			}
-			Util_rewind(f);
-			if (fread(&header, 1, sizeof(struct AFILE_ATR_Header), f) != sizeof(struct AFILE_ATR_Header)) {
-				Util_fclose(f, sio_tmpbuf[diskno - 1]);
+			data = CompFile_ExtractGZToMemory(filename, &data_size);
+			if (data == NULL) {
+				fclose(f);
 				return FALSE;
 			}
-			status = SIO_READ_ONLY;
-			/* XXX: status = b_open_readonly ? SIO_READ_ONLY : SIO_READ_WRITE; */
 		}
 		break;
 	default:
 		break;
 	}
+	if (data != NULL) {
+		if (data_size < sizeof(struct AFILE_ATR_Header)) {
+			free(data);
+			fclose(f);
+			return FALSE;
+		}
+		memcpy(&header, data, sizeof(struct AFILE_ATR_Header));
+		status = SIO_READ_ONLY;
+		/* XXX: status = b_open_readonly ? SIO_READ_ONLY : SIO_READ_WRITE; */
+	}
 
 	boot_sectors_type[diskno - 1] = BOOT_SECTORS_LOGICAL;
 
@@ -217,6 +226,7 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 
 		sectorsize[diskno - 1] = (header.secsizehi << 8) + header.secsizelo;
 		if (sectorsize[diskno - 1] != 128 && sectorsize[diskno - 1] != 256) {
+			free(data);
 			Util_fclose(f, sio_tmpbuf[diskno - 1]);
 			return FALSE;
 		}
@@ -243,10 +253,20 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 				   a non-zero byte in bytes 0x190-0x30f of the ATR file */
 				UBYTE buffer[0x180];
 				int i;
-				fseek(f, 0x190, SEEK_SET);
-				if (fread(buffer, 1, 0x180, f) != 0x180) {
-					Util_fclose(f, sio_tmpbuf[diskno - 1]);
-					return FALSE;
+				if (data != NULL) {
+					if (data_size < 0x310) {
+						free(data);
+						Util_fclose(f, sio_tmpbuf[diskno - 1]);
+						return FALSE;
+					}
+					memcpy(buffer, data + 0x190, 0x180);
+				}
+				else {
+					fseek(f, 0x190, SEEK_SET);
+					if (fread(buffer, 1, 0x180, f) != 0x180) {
+						Util_fclose(f, sio_tmpbuf[diskno - 1]);
+						return FALSE;
+					}
 				}
 				boot_sectors_type[diskno - 1] = BOOT_SECTORS_SIO2PC;
 				for (i = 0; i < 0x180; i++)
@@ -259,7 +279,7 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 		}
 	}
 	else {
-		int file_length = Util_flen(f);
+		int file_length = data != NULL ? (int) data_size : Util_flen(f);
 		/* check for PRO */
 		if ((file_length-16)%(128+12) == 0 &&
 				(header.magic1*256 + header.magic2 == (file_length-16)/(128+12)) &&
@@ -269,8 +289,10 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 			if (!b_open_readonly) {
 				fclose(f);
 				f = Util_fopen(filename, "rb", sio_tmpbuf[diskno - 1]);
-				if (f == NULL)
+				if (f == NULL) {
+					free(data);
 					return FALSE;
+				}
 				status = SIO_READ_ONLY;
 			}
 			image_type[diskno - 1] = IMAGE_TYPE_PRO;
@@ -321,13 +343,25 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 	SIO_format_sectorcount[diskno - 1] = sectorcount[diskno - 1];
 	strcpy(SIO_filename[diskno - 1], filename);
 	SIO_drive_status[diskno - 1] = status;
+	if (status == SIO_READ_WRITE && data == NULL)
+		RecoverJournal(f, filename);
 	disk[diskno - 1] = f;
+	image[diskno - 1] = data;
+	image_size[diskno - 1] = data_size;
+	LoadImage(diskno - 1);
 	return TRUE;
 }
 
 void SIO_Dismount(int diskno)
 {
 	if (disk[diskno - 1] != NULL) {
+		FlushImage(diskno - 1);
+		/* the file is used by the journal jobs */
+		WORKER_Flush();
+		free(image[diskno - 1]);
+		image[diskno - 1] = NULL;
+		free(dirty_sectors[diskno - 1]);
+		dirty_sectors[diskno - 1] = NULL;
 		Util_fclose(disk[diskno - 1], sio_tmpbuf[diskno - 1]);
 		disk[diskno - 1] = NULL;
 		SIO_drive_status[diskno - 1] = SIO_NO_DISK;
@@ -347,20 +381,13 @@ void SIO_DisableDrive(int diskno)
 	strcpy(SIO_filename[diskno - 1], "Off");
 }
 
-void SIO_SizeOfSector(UBYTE unit, int sector, int *sz, ULONG *ofs)
+/* Returns the size of the sector and its offset in the image. */
+static int LocateSector(int unit, int sector, ULONG *ofs)
 {
 	int size;
 	ULONG offset;
 	int header_size = (image_type[unit] == IMAGE_TYPE_ATR ? 16 : 0);
 
-	if (BINLOAD_start_binloading) {
-		if (sz)
-			*sz = 128;
-		if (ofs)
-			*ofs = 0;
-		return;
-	}
-
 	if (image_type[unit] == IMAGE_TYPE_PRO) {
 		size = 128;
 		offset = 16 + (128+12)*(sector -1); /* returns offset of header */
@@ -375,6 +402,22 @@ void SIO_SizeOfSector(UBYTE unit, int sector, int *sz, ULONG *ofs)
 		offset = header_size + (boot_sectors_type[unit] == BOOT_SECTORS_LOGICAL ? 0x180 : 0x300) + (sector - 4) * size;
 	}
 
+	*ofs = offset;
+	return size;
+}
+
+void SIO_SizeOfSector(UBYTE unit, int sector, int *sz, ULONG *ofs)
+{
+	int size;
+	ULONG offset;
+
+	if (BINLOAD_start_binloading) {
+		size = 128;
+		offset = 0;
+	}
+	else
+		size = LocateSector(unit, sector, &offset);
+
 	if (sz)
 		*sz = size;
 
@@ -382,23 +425,304 @@ void SIO_SizeOfSector(UBYTE unit, int sector, int *sz, ULONG *ofs)
 		*ofs = offset;
 }
 
-static int SeekSector(int unit, int sector)
+static int SeekSector(int unit, int sector, ULONG *offset)
 {
-	ULONG offset;
-	int size;
-
 	SIO_last_sector = sector;
 	sprintf(SIO_status, "%d: %d", unit + 1, sector);
-	SIO_SizeOfSector((UBYTE) unit, sector, &size, &offset);
-	fseek(disk[unit], offset, SEEK_SET);
+	return LocateSector(unit, sector, offset);
+}
 
-	return size;
+/* Loads the image of a freshly mounted disk into memory, if possible.
+   Compressed images are already in memory. */
+static void LoadImage(int unit)
+{
+	if (image[unit] == NULL) {
+		image_size[unit] = Util_flen(disk[unit]);
+		image[unit] = (UBYTE *) malloc(image_size[unit] > 0 ? image_size[unit] : 1);
+		if (image[unit] == NULL)
+			return;
+		Util_rewind(disk[unit]);
+		if (fread(image[unit], 1, image_size[unit], disk[unit]) != image_size[unit]) {
+			free(image[unit]);
+			image[unit] = NULL;
+			return;
+		}
+	}
+	image_dirty[unit] = FALSE;
+	dirty_sectors[unit] = (UBYTE *) Util_malloc(sectorcount[unit] + 1);
+	memset(dirty_sectors[unit], 0, sectorcount[unit] + 1);
+}
+
+/* Reads len bytes at offset. Like fread(), leaves the part of buffer
+   after the end of the image unchanged. */
+static void ReadImage(int unit, ULONG offset, UBYTE *buffer, int len)
+{
+	if (image[unit] == NULL) {
+		fseek(disk[unit], offset, SEEK_SET);
+		fread(buffer, 1, len, disk[unit]);
+		return;
+	}
+	if (offset >= image_size[unit])
+		return;
+	if ((ULONG) len > image_size[unit] - offset)
+		len = image_size[unit] - offset;
+	memcpy(buffer, image[unit] + offset, len);
+}
+
+static void WriteImage(int unit, int sector, ULONG offset, const UBYTE *buffer, int len)
+{
+	if (image[unit] == NULL) {
+		fseek(disk[unit], offset, SEEK_SET);
+		fwrite(buffer, 1, len, disk[unit]);
+		return;
+	}
+	if (offset + len > image_size[unit]) {
+		/* a truncated image grows, like the file would */
+		image[unit] = (UBYTE *) Util_realloc(image[unit], offset + len);
+		memset(image[unit] + image_size[unit], 0, offset + len - image_size[unit]);
+		image_size[unit] = offset + len;
+	}
+	memcpy(image[unit] + offset, buffer, len);
+	dirty_sectors[unit][sector] = 1;
+	image_dirty[unit] = TRUE;
+	flush_delay = FLUSH_DELAY;
+}
+
+/* The changed sectors are written to "<image>.jnl" before they overwrite
+   the image, so that a crash in the middle of the update can't leave
+   a half-written disk: the journal of a complete update is applied again
+   at the next mount, and an incomplete journal is discarded.
+   The journal consists of JOURNAL_MAGIC, runs of consecutive sectors
+   (ULONG offset, ULONG length, data) and an end marker (JOURNAL_END,
+   checksum of the runs). The journal is written and applied on the
+   worker thread. */
+#define JOURNAL_MAGIC "A8JNL1"
+#define JOURNAL_MAGIC_SIZE 6
+#define JOURNAL_END 0xffffffff
+
+typedef struct {
+	FILE *fp;
+	char filename[FILENAME_MAX + 4];
+	UBYTE *runs;
+	ULONG size;
+} journal_job;
+
+static void PutULONG(UBYTE *p, ULONG value)
+{
+	p[0] = (UBYTE) value;
+	p[1] = (UBYTE) (value >> 8);
+	p[2] = (UBYTE) (value >> 16);
+	p[3] = (UBYTE) (value >> 24);
+}
+
+static ULONG GetULONG(const UBYTE *p)
+{
+	return p[0] + (p[1] << 8) + (p[2] << 16) + ((ULONG) p[3] << 24);
+}
+
+static ULONG JournalChecksum(const UBYTE *runs, ULONG size)
+{
+	ULONG sum = 0;
+	while (size-- > 0)
+		sum = ((sum << 1) | (sum >> 31)) + *runs++;
+	return sum & 0xffffffff;
+}
+
+/* Returns TRUE if the runs are well-formed and fit in 32-bit offsets. */
+static int JournalValid(const UBYTE *runs, ULONG size)
+{
+	ULONG pos = 0;
+	while (pos < size) {
+		ULONG length;
+		if (size - pos < 8)
+			return FALSE;
+		length = GetULONG(runs + pos + 4);
+		pos += 8;
+		if (length > size - pos)
+			return FALSE;
+		pos += length;
+	}
+	return TRUE;
+}
+
+static int ApplyJournal(FILE *fp, const UBYTE *runs, ULONG size)
+{
+	ULONG pos = 0;
+	int ok = TRUE;
+	while (pos < size) {
+		ULONG offset = GetULONG(runs + pos);
+		ULONG length = GetULONG(runs + pos + 4);
+		pos += 8;
+		if (fseek(fp, offset, SEEK_SET) != 0
+		 || fwrite(runs + pos, 1, length, fp) != length)
+			ok = FALSE;
+		pos += length;
+	}
+	if (fflush(fp) != 0)
+		ok = FALSE;
+#ifdef HAVE_FSYNC
+	if (ok && fsync(fileno(fp)) != 0)
+		ok = FALSE;
+#endif
+	return ok;
+}
+
+static void JournalJobRun(void *arg)
+{
+	journal_job *job = (journal_job *) arg;
+	FILE *jf;
+	UBYTE end[8];
+	int journaled = FALSE;
+
+	jf = fopen(job->filename, "wb");
+	if (jf != NULL) {
+		PutULONG(end, JOURNAL_END);
+		PutULONG(end + 4, JournalChecksum(job->runs, job->size));
+		journaled = fwrite(JOURNAL_MAGIC, 1, JOURNAL_MAGIC_SIZE, jf) == JOURNAL_MAGIC_SIZE
+			&& fwrite(job->runs, 1, job->size, jf) == job->size
+			&& fwrite(end, 1, 8, jf) == 8
+			&& fflush(jf) == 0;
+#ifdef HAVE_FSYNC
+		if (journaled && fsync(fileno(jf)) != 0)
+			journaled = FALSE;
+#endif
+		if (fclose(jf) != 0)
+			journaled = FALSE;
+	}
+	if (!journaled) {
+		Log_print("Error writing journal %s", job->filename);
+		/* RecoverJournal() would discard it anyway */
+		if (jf != NULL)
+			remove(job->filename);
+	}
+	/* without a journal, update the image anyway, as it has always been done */
+	if (ApplyJournal(job->fp, job->runs, job->size)) {
+		if (journaled)
+			remove(job->filename);
+	}
+	else if (journaled)
+		Log_print("Error writing disk image; the changes are kept in %s and will be applied when the image is mounted again", job->filename);
+	else
+		Log_print("Error writing disk image; the changes could not be saved");
+	free(job->runs);
+	free(job);
+}
+
+/* Applies the journal left by an interrupted update of the image. */
+static void RecoverJournal(FILE *fp, const char *filename)
+{
+	char journal_filename[FILENAME_MAX + 4];
+	FILE *jf;
+	UBYTE *data;
+	ULONG size;
+
+	sprintf(journal_filename, "%s.jnl", filename);
+	jf = fopen(journal_filename, "rb");
+	if (jf == NULL)
+		return;
+	size = Util_flen(jf);
+	Util_rewind(jf);
+	data = (UBYTE *) Util_malloc(size > 0 ? size : 1);
+	if (fread(data, 1, size, jf) == size
+	 && size >= JOURNAL_MAGIC_SIZE + 8
+	 && memcmp(data, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE) == 0
+	 && GetULONG(data + size - 8) == JOURNAL_END
+	 && GetULONG(data + size - 4) == JournalChecksum(data + JOURNAL_MAGIC_SIZE, size - JOURNAL_MAGIC_SIZE - 8)
+	 && JournalValid(data + JOURNAL_MAGIC_SIZE, size - JOURNAL_MAGIC_SIZE - 8)) {
+		fclose(jf);
+		if (!ApplyJournal(fp, data + JOURNAL_MAGIC_SIZE, size - JOURNAL_MAGIC_SIZE - 8)) {
+			Log_print("Error applying journal %s", journal_filename);
+			free(data);
+			return;
+		}
+		Log_print("Recovered unsaved changes to %s", filename);
+	}
+	else {
+		fclose(jf);
+		Log_print("Discarded incomplete journal %s", journal_filename);
+	}
+	free(data);
+	remove(journal_filename);
+}
+
+/* Writes the changed sectors back to the file, through the journal. */
+static void FlushImage(int unit)
+{
+	int sector;
+	ULONG size = 0;
+	ULONG run_end = 0;
+	ULONG run_start = 0;
+	journal_job *job;
+
+	if (image[unit] == NULL || !image_dirty[unit])
+		return;
+	image_dirty[unit] = FALSE;
+
+	/* first pass: compute the size of the runs */
+	for (sector = 1; sector <= sectorcount[unit]; sector++) {
+		ULONG offset;
+		int sector_size;
+		if (!dirty_sectors[unit][sector])
+			continue;
+		sector_size = LocateSector(unit, sector, &offset);
+		if (offset + sector_size > image_size[unit])
+			continue;
+		if (size == 0 || offset != run_end)
+			size += 8;
+		size += sector_size;
+		run_end = offset + sector_size;
+	}
+	if (size == 0)
+		return;
+
+	job = (journal_job *) Util_malloc(sizeof(journal_job));
+	job->fp = disk[unit];
+	sprintf(job->filename, "%s.jnl", SIO_filename[unit]);
+	job->runs = (UBYTE *) Util_malloc(size);
+	job->size = size;
+
+	/* second pass: copy the sectors, merging consecutive ones */
+	size = 0;
+	for (sector = 1; sector <= sectorcount[unit]; sector++) {
+		ULONG offset;
+		int sector_size;
+		if (!dirty_sectors[unit][sector])
+			continue;
+		dirty_sectors[unit][sector] = 0;
+		sector_size = LocateSector(unit, sector, &offset);
+		if (offset + sector_size > image_size[unit])
+			continue;
+		if (size == 0 || offset != run_end) {
+			run_start = size;
+			PutULONG(job->runs + size, offset);
+			PutULONG(job->runs + size + 4, 0);
+			size += 8;
+		}
+		memcpy(job->runs + size, image[unit] + offset, sector_size);
+		size += sector_size;
+		PutULONG(job->runs + run_start + 4, size - run_start - 8);
+		run_end = offset + sector_size;
+	}
+
+	if (!WORKER_Submit(JournalJobRun, job))
+		JournalJobRun(job);
+}
+
+void SIO_Frame(void)
+{
+	int i;
+
+	if (flush_delay == 0 || --flush_delay > 0)
+		return;
+	for (i = 0; i < SIO_MAX_DRIVES; i++)
+		FlushImage(i);
 }
 
 /* Unit counts from zero up */
 int SIO_ReadSector(int unit, int sector, UBYTE *buffer)
 {
 	int size;
+	ULONG offset;
 	if (BINLOAD_start_binloading)
 		return BINLOAD_LoaderStart(buffer);
 
@@ -413,13 +737,14 @@ int SIO_ReadSector(int unit, int sector, UBYTE *buffer)
 	SIO_last_op_time = 1;
 	SIO_last_drive = unit + 1;
 	/* FIXME: what sector size did the user expect? */
-	size = SeekSector(unit, sector);
+	size = SeekSector(unit, sector, &offset);
 	if (image_type[unit] == IMAGE_TYPE_PRO) {
 		pro_additional_info_t *info;
 		unsigned char *count;
 		info = (pro_additional_info_t *)additional_info[unit];
 		count = info->count;
-		fread(buffer, 1, 12, disk[unit]);
+		ReadImage(unit, offset, buffer, 12);
+		offset += 12;
 		/* handle duplicate sectors */
 		if (buffer[5] != 0) {
 			int dupnum = count[sector];
@@ -434,14 +759,15 @@ int SIO_ReadSector(int unit, int sector, UBYTE *buffer)
 					Log_print("Error in .pro image: sector:%d dupnum:%d", sector, dupnum);
 					return 'E';
 				}
-				size = SeekSector(unit, sector);
+				size = SeekSector(unit, sector, &offset);
 				/* read sector header */
-				fread(buffer, 1, 12, disk[unit]);
+				ReadImage(unit, offset, buffer, 12);
+				offset += 12;
 			}
 		}
 		/* bad sector */
 		if (buffer[1] != 0xff) {
-			fread(buffer, 1, size, disk[unit]);
+			ReadImage(unit, offset, buffer, size);
 			io_success[unit] = sector;
 #ifdef DEBUG_PRO
 			Log_print("bad sector:%d", sector);
@@ -449,7 +775,7 @@ int SIO_ReadSector(int unit, int sector, UBYTE *buffer)
 			return 'E';
 		}
 	}
-	fread(buffer, 1, size, disk[unit]);
+	ReadImage(unit, offset, buffer, size);
 	io_success[unit] = 0;
 	return 'C';
 }
@@ -457,6 +783,7 @@ int SIO_ReadSector(int unit, int sector, UBYTE *buffer)
 int SIO_WriteSector(int unit, int sector, const UBYTE *buffer)
 {
 	int size;
+	ULONG offset;
 	io_success[unit] = -1;
 	if (SIO_drive_status[unit] == SIO_OFF)
 		return 0;
@@ -464,11 +791,14 @@ int SIO_WriteSector(int unit, int sector, const UBYTE *buffer)
 		return 'N';
 	if (SIO_drive_status[unit] != SIO_READ_WRITE || sector <= 0 || sector > sectorcount[unit])
 		return 'E';
+	/* run-ahead couldn't take the write back */
+	if (Atari800_speculating)
+		return 'E';
 	SIO_last_op = SIO_LAST_WRITE;
 	SIO_last_op_time = 1;
 	SIO_last_drive = unit + 1;
-	size = SeekSector(unit, sector);
-	fwrite(buffer, 1, size, disk[unit]);
+	size = SeekSector(unit, sector, &offset);
+	WriteImage(unit, sector, offset, buffer, size);
 	io_success[unit] = 0;
 	return 'C';
 }
@@ -476,7 +806,9 @@ int SIO_WriteSector(int unit, int sector, const UBYTE *buffer)
 int SIO_FormatDisk(int unit, UBYTE *buffer, int sectsize, int sectcount)
 {
 	char fname[FILENAME_MAX];
+	char tmp_fname[FILENAME_MAX + 4];
 	int is_atr;
+	int ok;
 	int save_boot_sectors_type;
 	int bootsectsize;
 	int bootsectcount;
@@ -487,11 +819,12 @@ int SIO_FormatDisk(int unit, UBYTE *buffer, int sectsize, int sectcount)
 		return 0;
 	if (disk[unit] == NULL)
 		return 'N';
-	if (SIO_drive_status[unit] != SIO_READ_WRITE)
+	if (SIO_drive_status[unit] != SIO_READ_WRITE || Atari800_speculating)
 		return 'E';
 	/* Note formatting the disk can change size of the file.
 	   There is no portable way to truncate the file at given position.
-	   We have to close the "rb+" open file and open it in "wb" mode.
+	   We have to close the "rb+" open file and write a new file, which
+	   replaces the old one only when complete.
 	   First get the information about the disk image, because we are going
 	   to umount it. */
 	memcpy(fname, SIO_filename[unit], FILENAME_MAX);
@@ -501,11 +834,13 @@ int SIO_FormatDisk(int unit, UBYTE *buffer, int sectsize, int sectcount)
 	if (sectsize == 256 && save_boot_sectors_type != BOOT_SECTORS_LOGICAL)
 		bootsectsize = 256;
 	bootsectcount = sectcount < 3 ? sectcount : 3;
-	/* Umount the file and open it in "wb" mode (it will truncate the file) */
+	/* Umount the file and write the new image next to it */
 	SIO_Dismount(unit + 1);
-	f = fopen(fname, "wb");
+	sprintf(tmp_fname, "%s.tmp", fname);
+	f = fopen(tmp_fname, "wb");
 	if (f == NULL) {
-		Log_print("SIO_FormatDisk: failed to open %s for writing", fname);
+		Log_print("SIO_FormatDisk: failed to open %s for writing", tmp_fname);
+		SIO_Mount(unit + 1, fname, FALSE);
 		return 'E';
 	}
 	/* Write ATR header if necessary */
@@ -530,8 +865,25 @@ int SIO_FormatDisk(int unit, UBYTE *buffer, int sectsize, int sectcount)
 	/* Write regular sectors */
 	for ( ; i <= sectcount; i++)
 		fwrite(buffer, 1, sectsize, f);
-	/* Close file and mount the disk back */
-	fclose(f);
+	/* Close file, replace the old image and mount the disk back */
+	ok = !ferror(f) && fflush(f) == 0;
+#ifdef HAVE_FSYNC
+	if (ok && fsync(fileno(f)) != 0)
+		ok = FALSE;
+#endif
+	if (fclose(f) != 0)
+		ok = FALSE;
+#if defined(WIN32) || defined(PSP)
+	/* rename() doesn't replace existing files */
+	if (ok)
+		remove(fname);
+#endif
+	if (!ok || rename(tmp_fname, fname) != 0) {
+		Log_print("SIO_FormatDisk: failed to write %s", fname);
+		remove(tmp_fname);
+		SIO_Mount(unit + 1, fname, FALSE);
+		return 'E';
+	}
 	SIO_Mount(unit + 1, fname, FALSE);
 	/* We want to keep the current PHYSICAL/SIO2PC boot sectors type
 	   (since the image is blank it can't be figured out by SIO_Mount) */
@@ -656,8 +1008,9 @@ int SIO_DriveStatus(int unit, UBYTE *buffer)
 	/* .PRO contains status information in the sector header */
 	if (io_success[unit] != 0  && image_type[unit] == IMAGE_TYPE_PRO) {
 		int sector = io_success[unit];
-		SeekSector(unit, sector);
-		fread(buffer, 1, 4, disk[unit]);
+		ULONG offset;
+		SeekSector(unit, sector, &offset);
+		ReadImage(unit, offset, buffer, 4);
 		return 'C';
 	}
 	buffer[0] = 16;         /* drive active */
@@ -1290,6 +1643,12 @@ void SIO_StateSave(void)
 {
 	int i;
 
+	/* the state file refers to the image files */
+	if (!StateSav_in_memory) {
+		for (i = 0; i < SIO_MAX_DRIVES; i++)
+			FlushImage(i);
+	}
+
 	for (i = 0; i < 8; i++) {
 		StateSav_SaveINT((int *) &SIO_drive_status[i], 1);
 		StateSav_SaveFNAME(SIO_filename[i]);
@@ -1311,6 +1670,11 @@ void SIO_StateRead(void)
 		if (filename[0] == 0)
 			continue;
 
+		/* A snapshot doesn't remount the disk that is still there */
+		if (StateSav_in_memory && SIO_drive_status[i] != SIO_OFF && SIO_drive_status[i] != SIO_NO_DISK
+		 && strcmp(filename, SIO_filename[i]) == 0)
+			continue;
+
 		/* If the disk drive wasn't empty or off when saved,
 		   mount the disk */
 		switch (saved_drive_status) {
@@ -32,6 +32,9 @@ void SIO_Dismount(int diskno);
 void SIO_DisableDrive(int diskno);
 int SIO_RotateDisks(void);
 void SIO_Handler(void);
+/* Called once per frame; writes changed sectors back to the image files
+   a while after the last write. */
+void SIO_Frame(void);
 
 UBYTE SIO_ChkSum(const UBYTE *buffer, int length);
 void SIO_TapeMotor(int onoff);
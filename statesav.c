@@ -53,11 +53,13 @@
 #include "cpu.h"
 #include "gtia.h"
 #include "log.h"
+#include "memory.h"
 #include "pbi.h"
 #include "pia.h"
 #include "pokey.h"
 #include "sio.h"
 #include "util.h"
+#include "worker.h"
 #ifdef PBI_MIO
 #include "pbi_mio.h"
 #endif
@@ -71,7 +73,7 @@
 #include "xep80.h"
 #endif
 
-#define SAVE_VERSION_NUMBER 6
+#define SAVE_VERSION_NUMBER 7
 
 #if defined(MEMCOMPR)
 static gzFile *mem_open(const char *name, const char *mode);
@@ -98,12 +100,46 @@ static size_t mem_write(const void *buf, size_t len, gzFile *stream);
 #define gzFile  FILE *
 #define Z_OK    0
 #endif
+#ifndef Z_BUF_ERROR
+#define Z_BUF_ERROR (-5)
+#endif
 
 static gzFile StateFile = NULL;
 static int nFileError = Z_OK;
 
+int StateSav_in_memory = FALSE;
+int StateSav_incremental = FALSE;
+int StateSav_chunk_version = 1;
+
+/* snapshot buffer used instead of StateFile if StateSav_in_memory is set */
+static UBYTE *snapshot_out = NULL;
+static const UBYTE *snapshot_in = NULL;
+static size_t snapshot_size;
+static size_t snapshot_pos;
+
+/* TRUE while StateSav_SaveAtariStateAsync() captures the state
+   in snapshot_out, which grows as needed */
+static int capturing = FALSE;
+
+/* position in the state file being read, and the end of the chunk being
+   read (0 if none) */
+static size_t read_pos;
+static size_t chunk_end;
+/* TRUE if a module tried to read past the end of its chunk */
+static int chunk_overrun = FALSE;
+
 static void GetGZErrorText(void)
 {
+	if (StateSav_in_memory || capturing) {
+		nFileError = Z_BUF_ERROR;
+		Log_print("State snapshot doesn't fit in the buffer.");
+		return;
+	}
+	if (chunk_overrun) {
+		nFileError = Z_BUF_ERROR;
+		Log_print("State file chunk is shorter than expected.");
+		return;
+	}
 #ifdef GZERROR
 	const char *error = GZERROR(StateFile, &nFileError);
 	if (nFileError == Z_ERRNO) {
@@ -120,34 +156,79 @@ static void GetGZErrorText(void)
 	Log_print("State file I/O failed.");
 }
 
+/* Returns 0 on error. */
+static size_t state_write(const void *buf, size_t len)
+{
+	if (StateSav_in_memory) {
+		if (snapshot_out != NULL) {
+			if (len > snapshot_size - snapshot_pos)
+				return 0;
+			memcpy(snapshot_out + snapshot_pos, buf, len);
+		}
+		/* with no buffer, just count the bytes */
+		snapshot_pos += len;
+		return len;
+	}
+	if (capturing) {
+		if (len > snapshot_size - snapshot_pos) {
+			snapshot_size = (snapshot_pos + len) * 2;
+			snapshot_out = (UBYTE *) Util_realloc(snapshot_out, snapshot_size);
+		}
+		memcpy(snapshot_out + snapshot_pos, buf, len);
+		snapshot_pos += len;
+		return len;
+	}
+	return GZWRITE(StateFile, buf, len);
+}
+
+/* Returns 0 on error. */
+static size_t state_read(void *buf, size_t len)
+{
+	if (StateSav_in_memory) {
+		if (len > snapshot_size - snapshot_pos)
+			return 0;
+		memcpy(buf, snapshot_in + snapshot_pos, len);
+		snapshot_pos += len;
+		return len;
+	}
+	if (chunk_end != 0 && len > chunk_end - read_pos) {
+		chunk_overrun = TRUE;
+		return 0;
+	}
+	if (GZREAD(StateFile, buf, len) == 0)
+		return 0;
+	read_pos += len;
+	return len;
+}
+
 /* Value is memory location of data, num is number of type to save */
 void StateSav_SaveUBYTE(const UBYTE *data, int num)
 {
-	if (!StateFile || nFileError != Z_OK)
+	if ((StateFile == NULL && !StateSav_in_memory && !capturing) || nFileError != Z_OK)
 		return;
 
 	/* Assumption is that UBYTE = 8bits and the pointer passed in refers
 	   directly to the active bits if in a padded location. If not (unlikely)
 	   you'll have to redefine this to save appropriately for cross-platform
 	   compatibility */
-	if (GZWRITE(StateFile, data, num) == 0)
+	if (state_write(data, num) == 0)
 		GetGZErrorText();
 }
 
 /* Value is memory location of data, num is number of type to save */
 void StateSav_ReadUBYTE(UBYTE *data, int num)
 {
-	if (!StateFile || nFileError != Z_OK)
+	if ((StateFile == NULL && !StateSav_in_memory && !capturing) || nFileError != Z_OK)
 		return;
 
-	if (GZREAD(StateFile, data, num) == 0)
+	if (state_read(data, num) == 0)
 		GetGZErrorText();
 }
 
 /* Value is memory location of data, num is number of type to save */
 void StateSav_SaveUWORD(const UWORD *data, int num)
 {
-	if (!StateFile || nFileError != Z_OK)
+	if ((StateFile == NULL && !StateSav_in_memory && !capturing) || nFileError != Z_OK)
 		return;
 
 	/* UWORDS are saved as 16bits, regardless of the size on this particular
@@ -160,14 +241,14 @@ void StateSav_SaveUWORD(const UWORD *data, int num)
 
 		temp = *data++;
 		byte = temp & 0xff;
-		if (GZWRITE(StateFile, &byte, 1) == 0) {
+		if (state_write(&byte, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
 
 		temp >>= 8;
 		byte = temp & 0xff;
-		if (GZWRITE(StateFile, &byte, 1) == 0) {
+		if (state_write(&byte, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
@@ -178,18 +259,18 @@ void StateSav_SaveUWORD(const UWORD *data, int num)
 /* Value is memory location of data, num is number of type to save */
 void StateSav_ReadUWORD(UWORD *data, int num)
 {
-	if (!StateFile || nFileError != Z_OK)
+	if ((StateFile == NULL && !StateSav_in_memory && !capturing) || nFileError != Z_OK)
 		return;
 
 	while (num > 0) {
 		UBYTE byte1, byte2;
 
-		if (GZREAD(StateFile, &byte1, 1) == 0) {
+		if (state_read(&byte1, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
 
-		if (GZREAD(StateFile, &byte2, 1) == 0) {
+		if (state_read(&byte2, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
@@ -201,7 +282,7 @@ void StateSav_ReadUWORD(UWORD *data, int num)
 
 void StateSav_SaveINT(const int *data, int num)
 {
-	if (!StateFile || nFileError != Z_OK)
+	if ((StateFile == NULL && !StateSav_in_memory && !capturing) || nFileError != Z_OK)
 		return;
 
 	/* INTs are always saved as 32bits (4 bytes) in the file. They can be any size
@@ -222,28 +303,28 @@ void StateSav_SaveINT(const int *data, int num)
 		temp = (unsigned int) temp0;
 
 		byte = temp & 0xff;
-		if (GZWRITE(StateFile, &byte, 1) == 0) {
+		if (state_write(&byte, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
 
 		temp >>= 8;
 		byte = temp & 0xff;
-		if (GZWRITE(StateFile, &byte, 1) == 0) {
+		if (state_write(&byte, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
 
 		temp >>= 8;
 		byte = temp & 0xff;
-		if (GZWRITE(StateFile, &byte, 1) == 0) {
+		if (state_write(&byte, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
 
 		temp >>= 8;
 		byte = (temp & 0x7f) | signbit;
-		if (GZWRITE(StateFile, &byte, 1) == 0) {
+		if (state_write(&byte, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
@@ -254,7 +335,7 @@ void StateSav_SaveINT(const int *data, int num)
 
 void StateSav_ReadINT(int *data, int num)
 {
-	if (!StateFile || nFileError != Z_OK)
+	if ((StateFile == NULL && !StateSav_in_memory && !capturing) || nFileError != Z_OK)
 		return;
 
 	while (num > 0) {
@@ -262,22 +343,22 @@ void StateSav_ReadINT(int *data, int num)
 		int temp;
 		UBYTE byte1, byte2, byte3, byte4;
 
-		if (GZREAD(StateFile, &byte1, 1) == 0) {
+		if (state_read(&byte1, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
 
-		if (GZREAD(StateFile, &byte2, 1) == 0) {
+		if (state_read(&byte2, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
 
-		if (GZREAD(StateFile, &byte3, 1) == 0) {
+		if (state_read(&byte3, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
 
-		if (GZREAD(StateFile, &byte4, 1) == 0) {
+		if (state_read(&byte4, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
@@ -302,10 +383,12 @@ void StateSav_SaveFNAME(const char *filename)
 
 	/* Check to see if file is in application tree, if so, just save as
 	   relative path....*/
-	getcwd(dirname, FILENAME_MAX);
-	if (strncmp(filename, dirname, strlen(dirname)) == 0)
-		/* XXX: check if '/' or '\\' follows dirname in filename? */
-		filename += strlen(dirname) + 1;
+	if (!StateSav_in_memory) {
+		getcwd(dirname, FILENAME_MAX);
+		if (strncmp(filename, dirname, strlen(dirname)) == 0)
+			/* XXX: check if '/' or '\\' follows dirname in filename? */
+			filename += strlen(dirname) + 1;
+	}
 #endif
 
 	namelen = strlen(filename);
@@ -327,162 +410,217 @@ void StateSav_ReadFNAME(char *filename)
 	filename[namelen] = 0;
 }
 
-int StateSav_SaveAtariState(const char *filename, const char *mode, UBYTE SaveVerbose)
-{
-	UBYTE StateVersion = SAVE_VERSION_NUMBER;
+/* State files from version 7 on consist of the header ("ATARI800",
+   version, SaveVerbose), a directory and the chunks listed in it.
+   The directory is a UWORD count followed by one entry per chunk:
+   a 4-character tag, a UBYTE chunk version, and ULONG offset (from the
+   start of the file) and length, all little-endian. The chunks follow
+   the directory in the same order. A reader can find one chunk without
+   parsing the others, and skips the chunks it doesn't know.
+   In-memory snapshots have no directory: the chunks are stored one
+   after another. */
+
+/* Chunks in the order of saving. The order here is important. The machine
+   chunk must be first because it saves the machine type, and decisions on what
+   to save/not save are made based off that later in the process */
+enum {
+	CHUNK_MACHINE,
+	CHUNK_CARTRIDGE,
+	CHUNK_SIO,
+	CHUNK_ANTIC,
+	CHUNK_CPU,
+	CHUNK_MEMORY,
+	CHUNK_GTIA,
+	CHUNK_PIA,
+	CHUNK_POKEY,
+	CHUNK_XEP80,
+	CHUNK_PBI,
+	CHUNK_PBI_MIO,
+	CHUNK_PBI_BB,
+	CHUNK_PBI_XLD,
+#ifdef DREAMCAST
+	CHUNK_DREAMCAST,
+#endif
+	CHUNK_COUNT
+};
+
+/* Increase a chunk's version when its layout changes. */
+static const struct {
+	char tag[5];
+	UBYTE version;
+} chunk_types[CHUNK_COUNT] = {
+	{ "MACH", 1 },
+	{ "CART", 2 },
+	{ "SIO ", 1 },
+	{ "ANTC", 1 },
+	{ "CPU ", 1 },
+	{ "MEM ", 2 },
+	{ "GTIA", 1 },
+	{ "PIA ", 1 },
+	{ "POKY", 1 },
+	{ "XEP8", 1 },
+	{ "PBI ", 1 },
+	{ "MIO ", 1 },
+	{ "BB  ", 1 },
+	{ "XLD ", 1 }
+#ifdef DREAMCAST
+	, { "DC  ", 1 }
+#endif
+};
 
-	if (StateFile != NULL) {
-		GZCLOSE(StateFile);
-		StateFile = NULL;
-	}
-	nFileError = Z_OK;
+#define HEADER_SIZE 10
+#define DIR_ENTRY_SIZE 13
 
-	StateFile = GZOPEN(filename, mode);
-	if (StateFile == NULL) {
-		Log_print("Could not open %s for state save.", filename);
-		GetGZErrorText();
-		return FALSE;
-	}
-	if (GZWRITE(StateFile, "ATARI800", 8) == 0) {
-		GetGZErrorText();
-		GZCLOSE(StateFile);
-		StateFile = NULL;
-		return FALSE;
-	}
+typedef struct {
+	char tag[4];
+	UBYTE version;
+	ULONG offset;
+	ULONG length;
+} chunk_entry;
 
-	StateSav_SaveUBYTE(&StateVersion, 1);
-	StateSav_SaveUBYTE(&SaveVerbose, 1);
-	/* The order here is important. Atari800_StateSave must be first because it saves the machine type, and
-	   decisions on what to save/not save are made based off that later in the process */
-	Atari800_StateSave();
-	CARTRIDGE_StateSave();
-	SIO_StateSave();
-	ANTIC_StateSave();
-	CPU_StateSave(SaveVerbose);
-	GTIA_StateSave();
-	PIA_StateSave();
-	POKEY_StateSave();
+static void put_ulong(UBYTE *p, ULONG value)
+{
+	p[0] = (UBYTE) value;
+	p[1] = (UBYTE) (value >> 8);
+	p[2] = (UBYTE) (value >> 16);
+	p[3] = (UBYTE) (value >> 24);
+}
+
+static ULONG get_ulong(const UBYTE *p)
+{
+	return p[0] | (p[1] << 8) | ((ULONG) p[2] << 16) | ((ULONG) p[3] << 24);
+}
+
+static void save_chunk(int type, UBYTE SaveVerbose)
+{
+	switch (type) {
+	case CHUNK_MACHINE:
+		Atari800_StateSave();
+		break;
+	case CHUNK_CARTRIDGE:
+		CARTRIDGE_StateSave();
+		break;
+	case CHUNK_SIO:
+		SIO_StateSave();
+		break;
+	case CHUNK_ANTIC:
+		ANTIC_StateSave();
+		break;
+	case CHUNK_CPU:
+		CPU_StateSave();
+		break;
+	case CHUNK_MEMORY:
+		MEMORY_StateSave(SaveVerbose);
+		break;
+	case CHUNK_GTIA:
+		GTIA_StateSave();
+		break;
+	case CHUNK_PIA:
+		PIA_StateSave();
+		break;
+	case CHUNK_POKEY:
+		POKEY_StateSave();
+		break;
+	case CHUNK_XEP80:
 #ifdef XEP80_EMULATION
-	XEP80_StateSave();
+		XEP80_StateSave();
 #else
-	{
-		int local_xep80_enabled = FALSE;
-		StateSav_SaveINT(&local_xep80_enabled, 1);
-	}
+		{
+			int local_xep80_enabled = FALSE;
+			StateSav_SaveINT(&local_xep80_enabled, 1);
+		}
 #endif /* XEP80_EMULATION */
-	PBI_StateSave();
+		break;
+	case CHUNK_PBI:
+		PBI_StateSave();
+		break;
+	case CHUNK_PBI_MIO:
 #ifdef PBI_MIO
-	PBI_MIO_StateSave();
+		PBI_MIO_StateSave();
 #else
-	{
-		int local_mio_enabled = FALSE;
-		StateSav_SaveINT(&local_mio_enabled, 1);
-	}
+		{
+			int local_mio_enabled = FALSE;
+			StateSav_SaveINT(&local_mio_enabled, 1);
+		}
 #endif /* PBI_MIO */
+		break;
+	case CHUNK_PBI_BB:
 #ifdef PBI_BB
-	PBI_BB_StateSave();
+		PBI_BB_StateSave();
 #else
-	{
-		int local_bb_enabled = FALSE;
-		StateSav_SaveINT(&local_bb_enabled, 1);
-	}
+		{
+			int local_bb_enabled = FALSE;
+			StateSav_SaveINT(&local_bb_enabled, 1);
+		}
 #endif /* PBI_BB */
+		break;
+	case CHUNK_PBI_XLD:
 #ifdef PBI_XLD
-	PBI_XLD_StateSave();
+		PBI_XLD_StateSave();
 #else
-	{
-		int local_xld_enabled = FALSE;
-		StateSav_SaveINT(&local_xld_enabled, 1);
-	}
+		{
+			int local_xld_enabled = FALSE;
+			StateSav_SaveINT(&local_xld_enabled, 1);
+		}
 #endif /* PBI_XLD */
+		break;
 #ifdef DREAMCAST
-	DCStateSave();
+	case CHUNK_DREAMCAST:
+		DCStateSave();
+		break;
 #endif
-
-	if (GZCLOSE(StateFile) != 0) {
-		StateFile = NULL;
-		return FALSE;
 	}
-	StateFile = NULL;
-
-	if (nFileError != Z_OK)
-		return FALSE;
-
-	return TRUE;
 }
 
-int StateSav_ReadAtariState(const char *filename, const char *mode)
+/* Returns FALSE if the state cannot be read by this version. */
+static int read_chunk(int type, UBYTE SaveVerbose, UBYTE StateVersion)
 {
-	char header_string[8];
-	UBYTE StateVersion = 0;  /* The version of the save file */
-	UBYTE SaveVerbose = 0;   /* Verbose mode means save basic, OS if patched */
-
-	if (StateFile != NULL) {
-		GZCLOSE(StateFile);
-		StateFile = NULL;
-	}
-	nFileError = Z_OK;
-
-	StateFile = GZOPEN(filename, mode);
-	if (StateFile == NULL) {
-		Log_print("Could not open %s for state read.", filename);
-		GetGZErrorText();
-		return FALSE;
-	}
-
-	if (GZREAD(StateFile, header_string, 8) == 0) {
-		GetGZErrorText();
-		GZCLOSE(StateFile);
-		StateFile = NULL;
-		return FALSE;
-	}
-	if (memcmp(header_string, "ATARI800", 8) != 0) {
-		Log_print("This is not an Atari800 state save file.");
-		GZCLOSE(StateFile);
-		StateFile = NULL;
-		return FALSE;
-	}
-
-	if (GZREAD(StateFile, &StateVersion, 1) == 0
-	 || GZREAD(StateFile, &SaveVerbose, 1) == 0) {
-		Log_print("Failed read from Atari state file.");
-		GetGZErrorText();
-		GZCLOSE(StateFile);
-		StateFile = NULL;
-		return FALSE;
-	}
-
-	if (StateVersion != SAVE_VERSION_NUMBER && StateVersion < 3) {
-		Log_print("Cannot read this state file because it is an incompatible version.");
-		GZCLOSE(StateFile);
-		StateFile = NULL;
-		return FALSE;
-	}
-
-	Atari800_StateRead();
-	if (StateVersion >= 4) {
+	switch (type) {
+	case CHUNK_MACHINE:
+		Atari800_StateRead();
+		break;
+	case CHUNK_CARTRIDGE:
 		CARTRIDGE_StateRead();
+		break;
+	case CHUNK_SIO:
 		SIO_StateRead();
-	}
-	ANTIC_StateRead();
-	CPU_StateRead(SaveVerbose, StateVersion);
-	GTIA_StateRead();
-	PIA_StateRead();
-	POKEY_StateRead();
-	if (StateVersion >= 6) {
+		break;
+	case CHUNK_ANTIC:
+		ANTIC_StateRead();
+		break;
+	case CHUNK_CPU:
+		CPU_StateRead(SaveVerbose, StateVersion);
+		break;
+	case CHUNK_MEMORY:
+		MEMORY_StateRead(SaveVerbose, StateVersion);
+		break;
+	case CHUNK_GTIA:
+		GTIA_StateRead();
+		break;
+	case CHUNK_PIA:
+		PIA_StateRead();
+		break;
+	case CHUNK_POKEY:
+		POKEY_StateRead();
+		break;
+	case CHUNK_XEP80:
 #ifdef XEP80_EMULATION
 		XEP80_StateRead();
 #else
-		int local_xep80_enabled;
-		StateSav_ReadINT(&local_xep80_enabled,1);
-		if (local_xep80_enabled) {
-			Log_print("Cannot read this state file because this version does not support XEP80.");
-			GZCLOSE(StateFile);
-			StateFile = NULL;
-			return FALSE;
+		{
+			int local_xep80_enabled;
+			StateSav_ReadINT(&local_xep80_enabled,1);
+			if (local_xep80_enabled) {
+				Log_print("Cannot read this state file because this version does not support XEP80.");
+				return FALSE;
+			}
 		}
 #endif /* XEP80_EMULATION */
+		break;
+	case CHUNK_PBI:
 		PBI_StateRead();
+		break;
+	case CHUNK_PBI_MIO:
 #ifdef PBI_MIO
 		PBI_MIO_StateRead();
 #else
@@ -491,12 +629,12 @@ int StateSav_ReadAtariState(const char *filename, const char *mode)
 			StateSav_ReadINT(&local_mio_enabled,1);
 			if (local_mio_enabled) {
 				Log_print("Cannot read this state file because this version does not support MIO.");
-				GZCLOSE(StateFile);
-				StateFile = NULL;
 				return FALSE;
 			}
 		}
 #endif /* PBI_MIO */
+		break;
+	case CHUNK_PBI_BB:
 #ifdef PBI_BB
 		PBI_BB_StateRead();
 #else
@@ -505,12 +643,12 @@ int StateSav_ReadAtariState(const char *filename, const char *mode)
 			StateSav_ReadINT(&local_bb_enabled,1);
 			if (local_bb_enabled) {
 				Log_print("Cannot read this state file because this version does not support the Black Box.");
-				GZCLOSE(StateFile);
-				StateFile = NULL;
 				return FALSE;
 			}
 		}
 #endif /* PBI_BB */
+		break;
+	case CHUNK_PBI_XLD:
 #ifdef PBI_XLD
 		PBI_XLD_StateRead();
 #else
@@ -519,26 +657,533 @@ int StateSav_ReadAtariState(const char *filename, const char *mode)
 			StateSav_ReadINT(&local_xld_enabled,1);
 			if (local_xld_enabled) {
 				Log_print("Cannot read this state file because this version does not support the 1400XL/1450XLD.");
-				GZCLOSE(StateFile);
-				StateFile = NULL;
 				return FALSE;
 			}
 		}
 #endif /* PBI_XLD */
-	}
+		break;
 #ifdef DREAMCAST
-	DCStateRead();
+	case CHUNK_DREAMCAST:
+		DCStateRead();
+		break;
 #endif
+	}
+	return TRUE;
+}
+
+/* Writes the header and all chunks, without a directory. */
+static int save_state(UBYTE SaveVerbose)
+{
+	UBYTE StateVersion = SAVE_VERSION_NUMBER;
+	int i;
+
+	if (state_write("ATARI800", 8) == 0) {
+		GetGZErrorText();
+		return FALSE;
+	}
+
+	StateSav_SaveUBYTE(&StateVersion, 1);
+	StateSav_SaveUBYTE(&SaveVerbose, 1);
+	for (i = 0; i < CHUNK_COUNT; i++)
+		save_chunk(i, SaveVerbose);
+	return nFileError == Z_OK;
+}
+
+/* Stores the contents of a state file in a new buffer. */
+static int capture_state(UBYTE SaveVerbose, UBYTE **data, size_t *size)
+{
+	ULONG offsets[CHUNK_COUNT + 1];
+	UBYTE *body;
+	UBYTE *p;
+	size_t header_size;
+	int i;
+
+	nFileError = Z_OK;
+	capturing = TRUE;
+	snapshot_out = NULL;
+	snapshot_size = 0;
+	snapshot_pos = 0;
+	for (i = 0; i < CHUNK_COUNT; i++) {
+		offsets[i] = (ULONG) snapshot_pos;
+		save_chunk(i, SaveVerbose);
+	}
+	offsets[CHUNK_COUNT] = (ULONG) snapshot_pos;
+	capturing = FALSE;
+	body = snapshot_out;
+	snapshot_out = NULL;
+	if (nFileError != Z_OK) {
+		free(body);
+		return FALSE;
+	}
+
+	header_size = HEADER_SIZE + 2 + CHUNK_COUNT * DIR_ENTRY_SIZE;
+	*size = header_size + offsets[CHUNK_COUNT];
+	*data = p = (UBYTE *) Util_malloc(*size);
+	memcpy(p, "ATARI800", 8);
+	p[8] = SAVE_VERSION_NUMBER;
+	p[9] = SaveVerbose;
+	p[10] = (UBYTE) CHUNK_COUNT;
+	p[11] = 0;
+	p += 12;
+	for (i = 0; i < CHUNK_COUNT; i++) {
+		memcpy(p, chunk_types[i].tag, 4);
+		p[4] = chunk_types[i].version;
+		put_ulong(p + 5, header_size + offsets[i]);
+		put_ulong(p + 9, offsets[i + 1] - offsets[i]);
+		p += DIR_ENTRY_SIZE;
+	}
+	if (offsets[CHUNK_COUNT] > 0)
+		memcpy(p, body, offsets[CHUNK_COUNT]);
+	free(body);
+	return TRUE;
+}
+
+/* Reads the state of all modules after the header of a snapshot or
+   a state file older than version 7.
+   Returns FALSE if the state cannot be read by this version. */
+static int read_modules(UBYTE StateVersion, UBYTE SaveVerbose)
+{
+	int i;
+
+	for (i = 0; i < CHUNK_COUNT; i++) {
+		/* not present in older versions */
+		if ((i == CHUNK_CARTRIDGE || i == CHUNK_SIO) && StateVersion < 4)
+			continue;
+		if (i >= CHUNK_XEP80 && i <= CHUNK_PBI_XLD && StateVersion < 6)
+			continue;
+		/* read by CPU_StateRead() before version 7 */
+		if (i == CHUNK_MEMORY && StateVersion < 7)
+			continue;
+		StateSav_chunk_version = StateSav_in_memory ? chunk_types[i].version : 1;
+		if (!read_chunk(i, SaveVerbose, StateVersion))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* Skips len bytes of the state file. */
+static int skip_bytes(size_t len)
+{
+	UBYTE buffer[256];
+
+	while (len > 0) {
+		size_t n = len < sizeof(buffer) ? len : sizeof(buffer);
+		if (state_read(buffer, n) == 0) {
+			GetGZErrorText();
+			return FALSE;
+		}
+		len -= n;
+	}
+	return TRUE;
+}
+
+/* Reads the directory and chunks of a state file. */
+static int read_chunks(UBYTE StateVersion, UBYTE SaveVerbose)
+{
+	chunk_entry *directory;
+	UWORD count = 0;
+	UBYTE entry[DIR_ENTRY_SIZE];
+	int result = TRUE;
+	int i;
+	int type;
+
+	StateSav_ReadUWORD(&count, 1);
+	if (nFileError != Z_OK)
+		return FALSE;
+	directory = (chunk_entry *) Util_malloc((count + 1) * sizeof(chunk_entry));
+	for (i = 0; i < count; i++) {
+		if (state_read(entry, DIR_ENTRY_SIZE) == 0) {
+			GetGZErrorText();
+			free(directory);
+			return FALSE;
+		}
+		memcpy(directory[i].tag, entry, 4);
+		directory[i].version = entry[4];
+		directory[i].offset = get_ulong(entry + 5);
+		directory[i].length = get_ulong(entry + 9);
+	}
+
+	for (i = 0; i < count && result; i++) {
+		if (directory[i].offset < read_pos) {
+			Log_print("Invalid state file directory.");
+			result = FALSE;
+			break;
+		}
+		if (!skip_bytes(directory[i].offset - read_pos)) {
+			result = FALSE;
+			break;
+		}
+		for (type = 0; type < CHUNK_COUNT; type++) {
+			if (memcmp(directory[i].tag, chunk_types[type].tag, 4) == 0)
+				break;
+		}
+		if (type == CHUNK_COUNT)
+			continue; /* unknown chunk, skipped */
+		if (directory[i].version > chunk_types[type].version) {
+			Log_print("Cannot read this state file because it is an incompatible version.");
+			result = FALSE;
+			break;
+		}
+		/* a module must not read past the end of its chunk */
+		chunk_end = directory[i].offset + directory[i].length;
+		StateSav_chunk_version = directory[i].version;
+		result = read_chunk(type, SaveVerbose, StateVersion) && nFileError == Z_OK;
+		chunk_end = 0;
+	}
+	free(directory);
+	return result;
+}
+
+/* Checks the header and reads the state of all modules. */
+static int read_state(void)
+{
+	char header_string[8];
+	UBYTE StateVersion = 0;  /* The version of the save file */
+	UBYTE SaveVerbose = 0;   /* Verbose mode means save basic, OS if patched */
+
+	read_pos = 0;
+	chunk_end = 0;
+	chunk_overrun = FALSE;
+	if (state_read(header_string, 8) == 0) {
+		GetGZErrorText();
+		return FALSE;
+	}
+	if (memcmp(header_string, "ATARI800", 8) != 0) {
+		Log_print("This is not an Atari800 state save file.");
+		return FALSE;
+	}
+
+	if (state_read(&StateVersion, 1) == 0
+	 || state_read(&SaveVerbose, 1) == 0) {
+		Log_print("Failed read from Atari state file.");
+		GetGZErrorText();
+		return FALSE;
+	}
+
+	if (StateVersion != SAVE_VERSION_NUMBER && StateVersion < 3) {
+		Log_print("Cannot read this state file because it is an incompatible version.");
+		return FALSE;
+	}
+
+	if (StateVersion >= 7 && !StateSav_in_memory)
+		return read_chunks(StateVersion, SaveVerbose);
+	if (!read_modules(StateVersion, SaveVerbose))
+		return FALSE;
+	return nFileError == Z_OK;
+}
+
+int StateSav_SaveAtariState(const char *filename, const char *mode, UBYTE SaveVerbose)
+{
+	UBYTE *data;
+	size_t size;
+	int result;
+
+	if (StateFile != NULL) {
+		GZCLOSE(StateFile);
+		StateFile = NULL;
+	}
+
+	if (!capture_state(SaveVerbose, &data, &size))
+		return FALSE;
+
+	StateFile = GZOPEN(filename, mode);
+	if (StateFile == NULL) {
+		Log_print("Could not open %s for state save.", filename);
+		GetGZErrorText();
+		free(data);
+		return FALSE;
+	}
+
+	result = TRUE;
+	if (GZWRITE(StateFile, data, size) == 0) {
+		GetGZErrorText();
+		result = FALSE;
+	}
+
+	if (GZCLOSE(StateFile) != 0)
+		result = FALSE;
+	StateFile = NULL;
+	free(data);
+
+	return result;
+}
+
+UBYTE *StateSav_ReadChunk(const char *filename, const char *tag, size_t *size, int *version)
+{
+	UBYTE header[HEADER_SIZE + 2];
+	UBYTE entry[DIR_ENTRY_SIZE];
+	UBYTE *data = NULL;
+	int count;
+	int i;
+
+	/* the file may still be being written */
+	WORKER_Flush();
+
+	if (StateFile != NULL) {
+		GZCLOSE(StateFile);
+		StateFile = NULL;
+	}
+	nFileError = Z_OK;
+	read_pos = 0;
+	chunk_end = 0;
+
+	StateFile = GZOPEN(filename, "rb");
+	if (StateFile == NULL)
+		return NULL;
+
+	if (state_read(header, HEADER_SIZE + 2) != 0
+	 && memcmp(header, "ATARI800", 8) == 0 && header[8] >= 7) {
+		count = header[10] | (header[11] << 8);
+		for (i = 0; i < count; i++) {
+			ULONG offset;
+			ULONG length;
+			if (state_read(entry, DIR_ENTRY_SIZE) == 0)
+				break;
+			if (memcmp(entry, tag, 4) != 0)
+				continue;
+			offset = get_ulong(entry + 5);
+			length = get_ulong(entry + 9);
+			if (offset < read_pos || !skip_bytes(offset - read_pos))
+				break;
+			/* one more byte, so an empty chunk is not a NULL pointer */
+			data = (UBYTE *) Util_malloc(length + 1);
+			if (length > 0 && state_read(data, length) == 0) {
+				free(data);
+				data = NULL;
+				break;
+			}
+			*size = length;
+			if (version != NULL)
+				*version = entry[4];
+			break;
+		}
+	}
 
 	GZCLOSE(StateFile);
 	StateFile = NULL;
+	return data;
+}
 
-	if (nFileError != Z_OK)
+int StateSav_ReadAtariState(const char *filename, const char *mode)
+{
+	int result;
+
+	/* the file may still be being written */
+	WORKER_Flush();
+
+	if (StateFile != NULL) {
+		GZCLOSE(StateFile);
+		StateFile = NULL;
+	}
+	nFileError = Z_OK;
+
+	StateFile = GZOPEN(filename, mode);
+	if (StateFile == NULL) {
+		Log_print("Could not open %s for state read.", filename);
+		GetGZErrorText();
 		return FALSE;
+	}
+
+	result = read_state();
+
+	GZCLOSE(StateFile);
+	StateFile = NULL;
+
+	return result;
+}
+
+static size_t save_snapshot(UBYTE *buffer, size_t size, int incremental)
+{
+	int result;
+
+	nFileError = Z_OK;
+	StateSav_in_memory = TRUE;
+	StateSav_incremental = incremental;
+	snapshot_out = buffer;
+	snapshot_size = size;
+	snapshot_pos = 0;
+
+	/* ROMs don't change within a session, so the snapshot doesn't need them */
+	result = save_state(FALSE);
+
+	StateSav_in_memory = FALSE;
+	StateSav_incremental = FALSE;
+	snapshot_out = NULL;
+	if (!result)
+		return 0;
+	/* Full snapshots (run-ahead, movies) don't start a new increment,
+	   and neither does measuring the size. */
+	if (incremental && buffer != NULL)
+		MEMORY_ClearDirty();
+	return snapshot_pos;
+}
+
+size_t StateSav_SaveSnapshot(UBYTE *buffer, size_t size)
+{
+	return save_snapshot(buffer, size, FALSE);
+}
+
+size_t StateSav_SaveIncrementalSnapshot(UBYTE *buffer, size_t size)
+{
+	return save_snapshot(buffer, size, TRUE);
+}
+
+int StateSav_ReadSnapshot(const UBYTE *buffer, size_t size)
+{
+	int result;
+
+	nFileError = Z_OK;
+	StateSav_in_memory = TRUE;
+	snapshot_in = buffer;
+	snapshot_size = size;
+	snapshot_pos = 0;
+
+	result = read_state();
+
+	StateSav_in_memory = FALSE;
+	snapshot_in = NULL;
+	return result;
+}
 
+#ifndef MEMCOMPR
+
+typedef struct {
+	FILE *fp;
+	char filename[FILENAME_MAX];
+	char temp_filename[FILENAME_MAX + 16];
+	UBYTE *data;
+	size_t size;
+	int level;
+	StateSav_trailer_func_t trailer;
+	void *trailer_arg;
+} save_job;
+
+#ifdef HAVE_LIBZ
+/* Writes data to fp as a gzip stream, like gzwrite() does. */
+static int write_compressed(FILE *fp, const UBYTE *data, size_t size, int level)
+{
+	z_stream z;
+	UBYTE out[16384];
+	int status;
+
+	memset(&z, 0, sizeof(z));
+	if (deflateInit2(&z, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return FALSE;
+	z.next_in = (Bytef *) data;
+	z.avail_in = (uInt) size;
+	do {
+		size_t len;
+		z.next_out = out;
+		z.avail_out = sizeof(out);
+		status = deflate(&z, Z_FINISH);
+		len = sizeof(out) - z.avail_out;
+		if (status == Z_STREAM_ERROR || fwrite(out, 1, len, fp) != len) {
+			deflateEnd(&z);
+			return FALSE;
+		}
+	} while (status != Z_STREAM_END);
+	deflateEnd(&z);
 	return TRUE;
 }
+#endif /* HAVE_LIBZ */
+
+/* Runs on the worker thread. */
+static void save_job_run(void *arg)
+{
+	save_job *job = (save_job *) arg;
+	int result;
+
+#ifdef HAVE_LIBZ
+	result = write_compressed(job->fp, job->data, job->size, job->level);
+#else
+	result = fwrite(job->data, 1, job->size, job->fp) == job->size;
+#endif
+	if (job->trailer != NULL && !job->trailer(job->fp, job->trailer_arg))
+		result = FALSE;
+	if (fflush(job->fp) != 0)
+		result = FALSE;
+#ifdef HAVE_FSYNC
+	/* the new file must be on the disk before it replaces the old one */
+	if (result && fsync(fileno(job->fp)) != 0)
+		result = FALSE;
+#endif
+	if (fclose(job->fp) != 0)
+		result = FALSE;
+	if (result) {
+#if defined(WIN32) || defined(PSP)
+		/* rename() doesn't replace existing files here */
+		remove(job->filename);
+#endif
+		if (rename(job->temp_filename, job->filename) != 0)
+			result = FALSE;
+	}
+	if (!result) {
+		Log_print("Could not save state to %s.", job->filename);
+		remove(job->temp_filename);
+	}
+	free(job->data);
+	free(job);
+}
+
+#endif /* MEMCOMPR */
 
+int StateSav_SaveAtariStateAsync(const char *filename, const char *mode, UBYTE SaveVerbose,
+                                 StateSav_trailer_func_t trailer, void *trailer_arg)
+{
+#ifdef MEMCOMPR
+	/* the VMU file is written by mem_close() */
+	FILE *fp;
+	if (!StateSav_SaveAtariState(filename, mode, SaveVerbose))
+		return FALSE;
+	if (trailer != NULL) {
+		fp = fopen(filename, "ab");
+		if (fp == NULL || !trailer(fp, trailer_arg))
+			Log_print("Could not save state to %s.", filename);
+		if (fp != NULL)
+			fclose(fp);
+	}
+	return TRUE;
+#else
+	static unsigned int temp_counter = 0;
+	save_job *job;
+
+	if (strlen(filename) >= FILENAME_MAX) {
+		Log_print("Could not open %s for state save.", filename);
+		return FALSE;
+	}
+	job = (save_job *) Util_malloc(sizeof(save_job));
+	strcpy(job->filename, filename);
+	/* a distinct name for each save, as earlier ones may still be pending */
+	sprintf(job->temp_filename, "%s.%u.tmp", filename, temp_counter++);
+	job->fp = fopen(job->temp_filename, "wb");
+	if (job->fp == NULL) {
+		Log_print("Could not open %s for state save.", job->temp_filename);
+		free(job);
+		return FALSE;
+	}
+#ifdef HAVE_LIBZ
+	/* the compression level, as in gzopen() */
+	job->level = Z_DEFAULT_COMPRESSION;
+	for (; *mode != '\0'; mode++) {
+		if (*mode >= '0' && *mode <= '9')
+			job->level = *mode - '0';
+	}
+#endif
+	job->trailer = trailer;
+	job->trailer_arg = trailer_arg;
+
+	if (!capture_state(SaveVerbose, &job->data, &job->size)) {
+		fclose(job->fp);
+		remove(job->temp_filename);
+		free(job);
+		return FALSE;
+	}
+
+	if (!WORKER_Submit(save_job_run, job))
+		save_job_run(job); /* job queue full */
+	return TRUE;
+#endif /* MEMCOMPR */
+}
 
 /* hack to compress in memory before writing
  * - for DREAMCAST only
@@ -6,6 +6,53 @@
 int StateSav_SaveAtariState(const char *filename, const char *mode, UBYTE SaveVerbose);
 int StateSav_ReadAtariState(const char *filename, const char *mode);
 
+/* Returns the contents of one chunk of a state file, or NULL if the file
+   or the chunk doesn't exist. tag is the chunk's 4-character name, e.g.
+   "CPU " or "MEM " (see statesav.c). Only the directory and the data before
+   the chunk are read, nothing is parsed. The caller must free the result. */
+UBYTE *StateSav_ReadChunk(const char *filename, const char *tag, size_t *size, int *version);
+
+/* Called on the worker thread after the state has been written to fp,
+   to append extra data (e.g. a thumbnail). It must free arg. Returns FALSE
+   on error. */
+typedef int (*StateSav_trailer_func_t)(FILE *fp, void *arg);
+
+/* Like StateSav_SaveAtariState(), but only captures the state in memory;
+   compression and writing are done by the worker thread, so the emulation
+   doesn't stall. The file is written under a temporary name, synced to disk
+   and then renamed, so an existing state file is only ever replaced by
+   a complete one. Returns FALSE if the state couldn't be captured or
+   the file couldn't be created; later write errors are only logged.
+   If it returns TRUE, trailer (if not NULL) is called once. */
+int StateSav_SaveAtariStateAsync(const char *filename, const char *mode, UBYTE SaveVerbose,
+                                 StateSav_trailer_func_t trailer, void *trailer_arg);
+
+/* Fast snapshots for rewind, run-ahead and the like: the state is stored
+   uncompressed in a caller-provided buffer, without the ROMs and without
+   any file I/O. StateSav_SaveSnapshot() returns the number of bytes used,
+   or 0 if the buffer is too small. Pass NULL to get the required size.
+   A snapshot can only be read in the same session, with the same ROMs. */
+size_t StateSav_SaveSnapshot(UBYTE *buffer, size_t size);
+int StateSav_ReadSnapshot(const UBYTE *buffer, size_t size);
+
+/* Like StateSav_SaveSnapshot(), but stores only the memory pages changed
+   since the previous incremental snapshot (or since the last state read).
+   StateSav_ReadSnapshot() applies it over the state of the previous
+   snapshot in the chain, which may be a full one, so a chain must be read
+   in order. Full snapshots don't affect the chain, but there can only be
+   one chain at a time; movie recording (movie.c) uses it. */
+size_t StateSav_SaveIncrementalSnapshot(UBYTE *buffer, size_t size);
+
+/* TRUE while a snapshot is saved or read. Modules may skip reloading media
+   that is already in place, and data kept only for compatibility. */
+extern int StateSav_in_memory;
+/* TRUE while an incremental snapshot is saved. */
+extern int StateSav_incremental;
+/* Layout version of the chunk being read: the one in the file's directory,
+   1 for files older than version 7 and the current one for snapshots.
+   Modules read the fields added in later versions only if it's high enough. */
+extern int StateSav_chunk_version;
+
 void StateSav_SaveUBYTE(const UBYTE *data, int num);
 void StateSav_SaveUWORD(const UWORD *data, int num);
 void StateSav_SaveINT(const int *data, int num);
@@ -51,6 +51,9 @@
 #include "ui.h"
 #include "ui_basic.h"
 #include "util.h"
+#if !defined(CURSES_BASIC) && !defined(DREAMCAST)
+#include "vidcap.h"
+#endif
 #ifdef SOUND
 #include "pokeysnd.h"
 #include "sndsave.h"
@@ -1092,12 +1095,12 @@ static void SaveState(void)
 {
 	if (UI_driver->fGetSaveFilename(state_filename, UI_saved_files_dir, UI_n_saved_files_dir)) {
 		int result;
-		UI_driver->fMessage("Please wait while saving...", 0);
 #ifdef XEP80_EMULATION
 		/* Save true XEP80 state */
 		PLATFORM_xep80 = saved_xep80;
 #endif
-		result = StateSav_SaveAtariState(state_filename, "wb", TRUE);
+		/* compressed and written in the background */
+		result = StateSav_SaveAtariStateAsync(state_filename, "wb", TRUE, NULL, NULL);
 #ifdef XEP80_EMULATION
 		PLATFORM_xep80 = FALSE;
 #endif
@@ -1588,6 +1591,37 @@ static void Screenshot(int interlaced)
 	}
 }
 
+static void VideoRecording(void)
+{
+	if (!VIDCAP_IsRecording()) {
+		int no = 0;
+		do {
+			char buffer[32];
+			sprintf(buffer, "atari%03d.a8v", no);
+			if (!Util_fileexists(buffer)) {
+				/* file does not exist - we can create it */
+				FilenameMessage(VIDCAP_Start(buffer)
+					? "Recording video to file \"%s\""
+					: "Can't write to file \"%s\"", buffer);
+				return;
+			}
+		} while (++no < 1000);
+		UI_driver->fMessage("All atariXXX.a8v files exist!", 1);
+	}
+	else {
+		char msg[64];
+		int ok = VIDCAP_Stop();
+		if (!ok)
+			UI_driver->fMessage("Error writing video file", 1);
+		else if (VIDCAP_dropped_frames > 0) {
+			sprintf(msg, "Recording stopped, %d frames dropped", VIDCAP_dropped_frames);
+			UI_driver->fMessage(msg, 1);
+		}
+		else
+			UI_driver->fMessage("Recording stopped", 1);
+	}
+}
+
 #endif /* !defined(CURSES_BASIC) && !defined(DREAMCAST) */
 
 static void AboutEmulator(void)
@@ -1613,7 +1647,7 @@ static void AboutEmulator(void)
 
 void UI_Run(void)
 {
-#define MENU_CONTROLLER 19
+#define MENU_CONTROLLER 20
 	static UI_tMenuItem menu_array[] = {
 		UI_MENU_FILESEL_ACCEL(UI_MENU_RUN, "Run Atari Program", "Alt+R"),
 		UI_MENU_SUBMENU_ACCEL(UI_MENU_DISK, "Disk Management", "Alt+D"),
@@ -1644,6 +1678,7 @@ void UI_Run(void)
 		UI_MENU_FILESEL_ACCEL(UI_MENU_PCX, "PCX Screenshot", "F10"),
 		UI_MENU_FILESEL_ACCEL(UI_MENU_PCXI, "PCX Interlaced Screenshot", "Shift+F10"),
 #endif
+		UI_MENU_ACTION(UI_MENU_VIDEO_RECORDING, "Video Recording Start/Stop"),
 #endif
 		UI_MENU_ACTION_ACCEL(UI_MENU_BACK, "Back to Emulated Atari", "Esc"),
 		UI_MENU_ACTION_ACCEL(UI_MENU_RESETW, "Reset (Warm Start)", "F5"),
@@ -1748,6 +1783,9 @@ void UI_Run(void)
 		case UI_MENU_PCXI:
 			Screenshot(TRUE);
 			break;
+		case UI_MENU_VIDEO_RECORDING:
+			VideoRecording();
+			break;
 #endif
 #endif
 #ifndef USE_CURSES
@@ -75,6 +75,7 @@ int GetRawKey(void);
 #define UI_MENU_ABOUT            16
 #define UI_MENU_EXIT             17
 #define UI_MENU_CASSETTE         18
+#define UI_MENU_VIDEO_RECORDING  19
 
 /* Structure of menu item. Each menu is just an array of items of this structure
    terminated by UI_MENU_END */
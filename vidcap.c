@@ -0,0 +1,390 @@
+/*
+ * vidcap.c - lossless video recording
+ *
+ * Copyright (C) 2026 Atari800 development team (see DOC/CREDITS)
+ *
+ * This file is part of the Atari800 emulator project which emulates
+ * the Atari 400, 800, 800XL, 130XE, and 5200 8-bit computers.
+ *
+ * Atari800 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Atari800 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atari800; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atari.h"
+#include "colours.h"
+#include "log.h"
+#include "screen.h"
+#include "util.h"
+#include "vidcap.h"
+#include "worker.h"
+#ifdef SOUND
+#include "pokeysnd.h"
+#endif
+
+/*
+	File format (all numbers little endian):
+
+	  0   6 bytes  "A8VID\x1a"
+	  6   1 byte   format version (1)
+	  7   1 byte   flags: bit 0 = 16-bit samples, bit 1 = audio present
+	  8   2 bytes  frame width (336)
+	 10   2 bytes  frame height (240)
+	 12   4 bytes  frame rate in millihertz
+	 16   4 bytes  audio sample rate
+	 20   1 byte   audio channels
+	 21 768 bytes  initial palette, R G B for each colour code
+
+	followed by records: 1 byte type, 4 bytes payload length, payload.
+
+	'K'  key frame: the frame's colour codes, RLE packed
+	'D'  delta frame: frame XOR previous frame, RLE packed
+	'R'  repeat of the previous frame (no payload)
+	'A'  sound samples belonging to the preceding frame
+	'P'  new palette (768 bytes), applies to the following frames
+	'E'  end: 4 bytes frame count, 4 bytes dropped frame count
+
+	RLE packing: control byte n < 128 is followed by n + 1 literal bytes,
+	n >= 128 is followed by one byte repeated n - 126 times.
+*/
+
+#define FRAME_LEFT         24
+#define FRAME_WIDTH        336
+#define FRAME_SIZE         (FRAME_WIDTH * Screen_HEIGHT)
+#define PACKED_SIZE        (FRAME_SIZE + FRAME_SIZE / 128 + 1)
+#define AUDIO_SIZE         16384
+#define SLOTS              8
+#define KEYFRAME_INTERVAL  300
+
+typedef struct {
+	UBYTE pixels[FRAME_SIZE];
+	UBYTE audio[AUDIO_SIZE];
+	unsigned int audio_size;
+	int palette[256];
+	int palette_changed;
+	int drawn;
+	int repeats;	/* frames dropped just before this one */
+	int busy;
+} frame_slot;
+
+int VIDCAP_frames = 0;
+int VIDCAP_dropped_frames = 0;
+
+/* Emulation side */
+static int recording = FALSE;
+static frame_slot *slots = NULL;
+static int next_slot;
+static int pending_repeats;
+static int last_palette[256];
+
+/* Shared with the audio thread, protected by WORKER_Lock() */
+static UBYTE audio_pending[AUDIO_SIZE];
+static unsigned int audio_pending_size;
+
+/* Encoder side */
+static FILE *fp = NULL;
+static UBYTE *prev_frame = NULL;
+static UBYTE *work = NULL;
+static UBYTE *packed = NULL;
+static int frames_since_key;
+static int write_error;
+
+static void write32(ULONG x, UBYTE *p)
+{
+	p[0] = (UBYTE) x;
+	p[1] = (UBYTE) (x >> 8);
+	p[2] = (UBYTE) (x >> 16);
+	p[3] = (UBYTE) (x >> 24);
+}
+
+static void write_record(int type, const UBYTE *data, unsigned int size)
+{
+	UBYTE header[5];
+	if (write_error)
+		return;
+	header[0] = (UBYTE) type;
+	write32(size, header + 1);
+	if (fwrite(header, 1, 5, fp) != 5 || (size > 0 && fwrite(data, 1, size, fp) != size)) {
+		Log_print("Video recording: write error");
+		write_error = TRUE;
+	}
+}
+
+static void write_palette(const int *palette)
+{
+	UBYTE rgb[768];
+	int i;
+	for (i = 0; i < 256; i++) {
+		rgb[i * 3] = (UBYTE) (palette[i] >> 16);
+		rgb[i * 3 + 1] = (UBYTE) (palette[i] >> 8);
+		rgb[i * 3 + 2] = (UBYTE) palette[i];
+	}
+	write_record('P', rgb, 768);
+}
+
+static unsigned int pack_rle(const UBYTE *src, unsigned int len, UBYTE *dest)
+{
+	UBYTE *d = dest;
+	unsigned int i = 0;
+	while (i < len) {
+		unsigned int run = 1;
+		while (i + run < len && run < 129 && src[i + run] == src[i])
+			run++;
+		if (run >= 2) {
+			*d++ = (UBYTE) (run + 126);
+			*d++ = src[i];
+			i += run;
+		}
+		else {
+			unsigned int start = i;
+			unsigned int lit = 0;
+			/* a literal is only interrupted by a run of 3 or more bytes,
+			   so the packed data is never more than 1/128 larger */
+			do {
+				i++;
+				lit++;
+			} while (i < len && lit < 128 && !(i + 2 < len && src[i + 1] == src[i] && src[i + 2] == src[i]));
+			*d++ = (UBYTE) (lit - 1);
+			memcpy(d, src + start, lit);
+			d += lit;
+		}
+	}
+	return d - dest;
+}
+
+/* Runs on the worker thread. */
+static void encode_slot(void *arg)
+{
+	frame_slot *slot = (frame_slot *) arg;
+	int i;
+
+	for (i = 0; i < slot->repeats; i++)
+		write_record('R', NULL, 0);
+	if (slot->palette_changed)
+		write_palette(slot->palette);
+
+	if (!slot->drawn || memcmp(slot->pixels, prev_frame, FRAME_SIZE) == 0)
+		write_record('R', NULL, 0);
+	else if (frames_since_key >= KEYFRAME_INTERVAL) {
+		write_record('K', packed, pack_rle(slot->pixels, FRAME_SIZE, packed));
+		frames_since_key = 0;
+		memcpy(prev_frame, slot->pixels, FRAME_SIZE);
+	}
+	else {
+		const ULONG *cur = (const ULONG *) slot->pixels;
+		const ULONG *prev = (const ULONG *) prev_frame;
+		ULONG *delta = (ULONG *) work;
+		for (i = 0; i < FRAME_SIZE / 4; i++)
+			delta[i] = cur[i] ^ prev[i];
+		write_record('D', packed, pack_rle(work, FRAME_SIZE, packed));
+		memcpy(prev_frame, slot->pixels, FRAME_SIZE);
+	}
+	frames_since_key++;
+
+	if (slot->audio_size > 0)
+		write_record('A', slot->audio, slot->audio_size);
+
+	WORKER_Lock();
+	slot->busy = FALSE;
+	WORKER_Unlock();
+}
+
+static void free_buffers(void)
+{
+	free(slots);
+	free(prev_frame);
+	free(work);
+	free(packed);
+	slots = NULL;
+	prev_frame = work = packed = NULL;
+}
+
+int VIDCAP_Start(const char *filename)
+{
+	UBYTE header[21];
+	int flags = 0;
+	int rate = 0;
+	int channels = 0;
+
+	if (recording)
+		VIDCAP_Stop();
+	fp = fopen(filename, "wb");
+	if (fp == NULL)
+		return FALSE;
+
+	slots = (frame_slot *) Util_malloc(SLOTS * sizeof(frame_slot));
+	memset(slots, 0, SLOTS * sizeof(frame_slot));
+	prev_frame = (UBYTE *) Util_malloc(FRAME_SIZE);
+	work = (UBYTE *) Util_malloc(FRAME_SIZE);
+	packed = (UBYTE *) Util_malloc(PACKED_SIZE);
+	next_slot = 0;
+	pending_repeats = 0;
+	audio_pending_size = 0;
+	/* the first frame differing from "previous" is written as a key frame */
+	frames_since_key = KEYFRAME_INTERVAL;
+	memset(prev_frame, 0, FRAME_SIZE);
+	write_error = FALSE;
+	VIDCAP_frames = 0;
+	VIDCAP_dropped_frames = 0;
+
+#ifdef SOUND
+	if (POKEYSND_snd_flags & POKEYSND_BIT16)
+		flags |= 1;
+	flags |= 2;
+	rate = POKEYSND_playback_freq;
+	channels = POKEYSND_num_pokeys;
+#endif
+	memcpy(header, "A8VID\x1a\x01", 7);
+	header[7] = (UBYTE) flags;
+	header[8] = FRAME_WIDTH & 0xff;
+	header[9] = FRAME_WIDTH >> 8;
+	header[10] = Screen_HEIGHT & 0xff;
+	header[11] = Screen_HEIGHT >> 8;
+	write32(Atari800_tv_mode == Atari800_TV_PAL ? 49860 : 59923, header + 12);
+	write32(rate, header + 16);
+	header[20] = (UBYTE) channels;
+	if (fwrite(header, 1, 21, fp) != 21) {
+		fclose(fp);
+		fp = NULL;
+		free_buffers();
+		return FALSE;
+	}
+	memcpy(last_palette, Colours_table, sizeof(last_palette));
+	{
+		UBYTE rgb[768];
+		int i;
+		for (i = 0; i < 256; i++) {
+			rgb[i * 3] = Colours_GetR(i);
+			rgb[i * 3 + 1] = Colours_GetG(i);
+			rgb[i * 3 + 2] = Colours_GetB(i);
+		}
+		if (fwrite(rgb, 1, 768, fp) != 768) {
+			fclose(fp);
+			fp = NULL;
+			free_buffers();
+			return FALSE;
+		}
+	}
+
+	WORKER_Lock();
+	recording = TRUE;
+	WORKER_Unlock();
+	return TRUE;
+}
+
+int VIDCAP_Stop(void)
+{
+	UBYTE end[8];
+	int result;
+
+	if (!recording)
+		return TRUE;
+	WORKER_Lock();
+	recording = FALSE;
+	WORKER_Unlock();
+	WORKER_Flush();
+
+	/* the encoder is idle now, so we can write from this thread */
+	while (pending_repeats-- > 0)
+		write_record('R', NULL, 0);
+	write32(VIDCAP_frames, end);
+	write32(VIDCAP_dropped_frames, end + 4);
+	write_record('E', end, 8);
+	if (fclose(fp) != 0)
+		write_error = TRUE;
+	fp = NULL;
+	free_buffers();
+
+	if (VIDCAP_dropped_frames > 0)
+		Log_print("Video recording: %d of %d frames dropped", VIDCAP_dropped_frames, VIDCAP_frames);
+	result = !write_error;
+	return result;
+}
+
+int VIDCAP_IsRecording(void)
+{
+	return recording;
+}
+
+void VIDCAP_Frame(int drawn)
+{
+	frame_slot *slot;
+
+	if (!recording)
+		return;
+	VIDCAP_frames++;
+
+	WORKER_Lock();
+	slot = &slots[next_slot];
+	if (slot->busy) {
+		/* encoder is behind; keep the sound for the next frame */
+		WORKER_Unlock();
+		VIDCAP_dropped_frames++;
+		pending_repeats++;
+		return;
+	}
+	slot->busy = TRUE;
+	memcpy(slot->audio, audio_pending, audio_pending_size);
+	slot->audio_size = audio_pending_size;
+	audio_pending_size = 0;
+	WORKER_Unlock();
+
+	slot->drawn = drawn;
+	slot->repeats = pending_repeats;
+	pending_repeats = 0;
+	if (drawn) {
+		const UBYTE *src = (const UBYTE *) Screen_atari + FRAME_LEFT;
+		UBYTE *dest = slot->pixels;
+		int y;
+		for (y = 0; y < Screen_HEIGHT; y++) {
+			memcpy(dest, src, FRAME_WIDTH);
+			src += Screen_WIDTH;
+			dest += FRAME_WIDTH;
+		}
+	}
+	slot->palette_changed = memcmp(last_palette, Colours_table, sizeof(last_palette)) != 0;
+	if (slot->palette_changed) {
+		memcpy(last_palette, Colours_table, sizeof(last_palette));
+		memcpy(slot->palette, last_palette, sizeof(last_palette));
+	}
+
+	if (WORKER_Submit(encode_slot, slot))
+		next_slot = (next_slot + 1) % SLOTS;
+	else {
+		/* job queue full - drop the frame (its sound is lost) */
+		pending_repeats += slot->repeats + 1;
+		VIDCAP_dropped_frames++;
+		if (slot->palette_changed)
+			memset(last_palette, 0, sizeof(last_palette));
+		WORKER_Lock();
+		slot->busy = FALSE;
+		WORKER_Unlock();
+	}
+}
+
+void VIDCAP_AddAudio(const UBYTE *buffer, unsigned int size)
+{
+	WORKER_Lock();
+	if (recording) {
+		if (size > AUDIO_SIZE - audio_pending_size)
+			size = AUDIO_SIZE - audio_pending_size;
+		memcpy(audio_pending + audio_pending_size, buffer, size);
+		audio_pending_size += size;
+	}
+	WORKER_Unlock();
+}
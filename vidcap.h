@@ -0,0 +1,34 @@
+#ifndef VIDCAP_H_
+#define VIDCAP_H_
+
+#include "atari.h"
+
+/* Lossless video capture of Screen_atari and the POKEY output.
+   Frames are copied in VIDCAP_Frame() and compressed by the background
+   worker (see worker.h), so recording doesn't slow down the emulation.
+   If the encoder falls behind, frames are dropped and counted in
+   VIDCAP_dropped_frames; a dropped frame is stored as a repeat of the
+   previous one so the timing of the recording stays correct. */
+
+/* Number of emulated frames written to the current/last recording. */
+extern int VIDCAP_frames;
+/* Number of frames dropped because the encoder was busy. */
+extern int VIDCAP_dropped_frames;
+
+/* Starts recording to filename. Returns FALSE on error. */
+int VIDCAP_Start(const char *filename);
+
+/* Finishes the recording. Returns FALSE if a write error occurred. */
+int VIDCAP_Stop(void);
+
+/* Returns TRUE if a recording is in progress. */
+int VIDCAP_IsRecording(void);
+
+/* Called at the end of each Atari800_Frame(). If drawn is FALSE,
+   Screen_atari was not updated in this frame (frame skip). */
+void VIDCAP_Frame(int drawn);
+
+/* Called with each sound buffer produced by POKEYSND_Process(). */
+void VIDCAP_AddAudio(const UBYTE *buffer, unsigned int size);
+
+#endif /* VIDCAP_H_ */
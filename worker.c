@@ -0,0 +1,161 @@
+/*
+ * worker.c - background job thread
+ *
+ * Copyright (C) 2026 Atari800 development team (see DOC/CREDITS)
+ *
+ * This file is part of the Atari800 emulator project which emulates
+ * the Atari 400, 800, 800XL, 130XE, and 5200 8-bit computers.
+ *
+ * Atari800 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Atari800 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atari800; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "config.h"
+#include <stdio.h>
+
+#include "atari.h"
+#include "log.h"
+#include "worker.h"
+
+#ifdef WORKER_THREADED
+
+#include <pthread.h>
+
+static struct {
+	WORKER_func_t func;
+	void *arg;
+} queue[WORKER_QUEUE_SIZE];
+static int queue_head = 0;
+static int queue_count = 0;
+static int job_running = FALSE;
+
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t data_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t thread;
+static int thread_started = FALSE;
+static int thread_quit = FALSE;
+
+static void *thread_main(void *unused)
+{
+	pthread_mutex_lock(&queue_mutex);
+	for (;;) {
+		WORKER_func_t func;
+		void *arg;
+		while (queue_count == 0 && !thread_quit)
+			pthread_cond_wait(&queue_cond, &queue_mutex);
+		if (queue_count == 0)
+			break;
+		func = queue[queue_head].func;
+		arg = queue[queue_head].arg;
+		queue_head = (queue_head + 1) % WORKER_QUEUE_SIZE;
+		queue_count--;
+		job_running = TRUE;
+		pthread_mutex_unlock(&queue_mutex);
+
+		func(arg);
+
+		pthread_mutex_lock(&queue_mutex);
+		job_running = FALSE;
+		if (queue_count == 0)
+			pthread_cond_broadcast(&idle_cond);
+	}
+	pthread_cond_broadcast(&idle_cond);
+	pthread_mutex_unlock(&queue_mutex);
+	return NULL;
+}
+
+int WORKER_Submit(WORKER_func_t func, void *arg)
+{
+	pthread_mutex_lock(&queue_mutex);
+	if (!thread_started) {
+		thread_quit = FALSE;
+		if (pthread_create(&thread, NULL, thread_main, NULL) != 0) {
+			pthread_mutex_unlock(&queue_mutex);
+			Log_print("Cannot start worker thread, running job synchronously");
+			func(arg);
+			return TRUE;
+		}
+		thread_started = TRUE;
+	}
+	if (queue_count == WORKER_QUEUE_SIZE) {
+		pthread_mutex_unlock(&queue_mutex);
+		return FALSE;
+	}
+	queue[(queue_head + queue_count) % WORKER_QUEUE_SIZE].func = func;
+	queue[(queue_head + queue_count) % WORKER_QUEUE_SIZE].arg = arg;
+	queue_count++;
+	pthread_cond_signal(&queue_cond);
+	pthread_mutex_unlock(&queue_mutex);
+	return TRUE;
+}
+
+void WORKER_Flush(void)
+{
+	pthread_mutex_lock(&queue_mutex);
+	while (thread_started && (queue_count > 0 || job_running))
+		pthread_cond_wait(&idle_cond, &queue_mutex);
+	pthread_mutex_unlock(&queue_mutex);
+}
+
+void WORKER_Lock(void)
+{
+	pthread_mutex_lock(&data_mutex);
+}
+
+void WORKER_Unlock(void)
+{
+	pthread_mutex_unlock(&data_mutex);
+}
+
+void WORKER_Exit(void)
+{
+	pthread_mutex_lock(&queue_mutex);
+	if (!thread_started) {
+		pthread_mutex_unlock(&queue_mutex);
+		return;
+	}
+	thread_quit = TRUE;
+	pthread_cond_signal(&queue_cond);
+	pthread_mutex_unlock(&queue_mutex);
+	pthread_join(thread, NULL);
+	thread_started = FALSE;
+}
+
+#else /* WORKER_THREADED */
+
+int WORKER_Submit(WORKER_func_t func, void *arg)
+{
+	func(arg);
+	return TRUE;
+}
+
+void WORKER_Flush(void)
+{
+}
+
+void WORKER_Lock(void)
+{
+}
+
+void WORKER_Unlock(void)
+{
+}
+
+void WORKER_Exit(void)
+{
+}
+
+#endif /* WORKER_THREADED */
@@ -0,0 +1,36 @@
+#ifndef WORKER_H_
+#define WORKER_H_
+
+#include "config.h"
+
+/* Background worker thread for jobs that must not stall the emulation
+   loop (encoding, compression, file writes). Jobs run one at a time in
+   submission order. On platforms without thread support jobs run
+   synchronously inside WORKER_Submit(). */
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#define WORKER_THREADED
+#endif
+
+typedef void (*WORKER_func_t)(void *arg);
+
+/* Maximum number of jobs waiting in the queue. */
+#define WORKER_QUEUE_SIZE 64
+
+/* Queues func(arg) for execution on the worker thread, starting the thread
+   on first use. Returns FALSE if the queue is full; the job is then not
+   run and the caller keeps ownership of arg. */
+int WORKER_Submit(WORKER_func_t func, void *arg);
+
+/* Waits until all submitted jobs have completed. */
+void WORKER_Flush(void);
+
+/* Lock protecting data shared between the emulation and the worker jobs.
+   Never call WORKER_Submit() or WORKER_Flush() while holding it. */
+void WORKER_Lock(void);
+void WORKER_Unlock(void);
+
+/* Finishes pending jobs and stops the thread. */
+void WORKER_Exit(void);
+
+#endif /* WORKER_H_ */